@@ -1,15 +1,20 @@
 #include <proto.pb.h>
 #include <asio.hpp>
 #include <common/connection.h>
+#include <common/crc32c.h>
 #include <common/log.h>
 #include <common/protocol.h>
 #include <common/util.h>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <memory>
 
 auto master_conn = std::shared_ptr<common::connection>{};
 
+/* 流式上传时最多在途的数据块数量 */
+auto upload_window = 8u;
+
 auto upload_file(std::string path) -> asio::awaitable<void> {
   if (!std::filesystem::exists(path)) {
     LOG_ERROR("invalid file ", path);
@@ -55,14 +60,17 @@ auto upload_file(std::string path) -> asio::awaitable<void> {
     co_return;
   });
 
-  /* 开始上传 */
+  /* 开始上传，每 ack_every 个数据块确认一次，最多 upload_window 个数据块在途。storage 不支持流式上传时每个数据块都确认 */
   LOG_INFO(std::format("start upload file"));
-  request_to_send = std::shared_ptr<common::proto_frame>{(common::proto_frame *)malloc(sizeof(common::proto_frame) + sizeof(uint64_t)), free};
-  *request_to_send = {
-      .cmd = common::proto_cmd::cs_upload_start,
-      .data_len = sizeof(uint64_t),
+  auto stream = conn->capabilities().has(common::CAP_STREAM_UPLOAD);
+  auto window = stream ? upload_window : 1u;
+  auto ack_every = std::max(window / 2, 1u);
+  request_to_send = common::create_frame(common::proto_cmd::cs_upload_start, common::frame_type::request, sizeof(common::cs_upload_start_request));
+  *((common::cs_upload_start_request *)request_to_send->data) = {
+      .file_size = common::htonll(std::filesystem::file_size(path)),
+      .mode = static_cast<common::upload_mode>(htonl(std::to_underlying(stream ? common::upload_mode::stream : common::upload_mode::normal))),
+      .ack_every = htonl(ack_every),
   };
-  *((uint64_t *)request_to_send->data) = common::htonll(std::filesystem::file_size(path));
   id = co_await conn->send_request(request_to_send);
   if (!id) {
     LOG_ERROR("failed to send cs_upload_start request");
@@ -78,54 +86,89 @@ auto upload_file(std::string path) -> asio::awaitable<void> {
     LOG_ERROR(std::format("cs_upload_start response stat {}", response_recved->stat));
     co_return;
   }
+  if (response_recved->data_len != sizeof(uint32_t)) {
+    LOG_ERROR("invalid cs_upload_start response");
+    co_return;
+  }
+  auto transfer_id = *(uint32_t *)response_recved->data; /* 保持网络字节序，直接填入 cs_upload_chunk_header */
 
   /* 上传数据 */
   bool ok = true;
-  request_to_send = std::shared_ptr<common::proto_frame>{(common::proto_frame *)malloc(sizeof(common::proto_frame) + 5_MB), free};
-  auto idx = 0;
+  request_to_send = common::create_frame(common::proto_cmd::cs_upload, common::frame_type::request, sizeof(common::cs_upload_chunk_header) + 5_MB);
+  auto chunk_header = (common::cs_upload_chunk_header *)request_to_send->data;
+  auto chunk_data = request_to_send->data + sizeof(common::cs_upload_chunk_header);
+  auto ack_ids = std::deque<uint16_t>{};
+  auto seq = 0u;
   auto ifs = std::ifstream{std::string{path}, std::ios::binary};
   if (!ifs) {
     LOG_ERROR(std::format("failed open file {}", strerror(errno)));
     co_return;
   }
   while (!ifs.eof()) {
-    LOG_INFO(std::format("upload file trunk {}", idx++));
+    auto data_len = (uint32_t)ifs.readsome(chunk_data, 5_MB);
+    if (data_len == 0) {
+      break;
+    }
+    LOG_INFO(std::format("upload file trunk {}", seq));
     *request_to_send = common::proto_frame{
         .cmd = common::proto_cmd::cs_upload,
-        .data_len = (uint32_t)ifs.readsome(request_to_send->data, 5_MB),
+        .data_len = (uint32_t)sizeof(common::cs_upload_chunk_header) + data_len,
     };
-    if (request_to_send->data_len == 0) {
-      break;
-    }
+    *chunk_header = {.transfer_id = transfer_id, .seq = htonl(seq)};
 
-    id = co_await conn->send_request(request_to_send);
-    if (!id) {
+    /* 只有需要确认的数据块才等待响应 */
+    if ((seq + 1) % ack_every == 0) {
+      id = co_await conn->send_request(request_to_send);
+      if (!id) {
+        LOG_ERROR("failed to send cs_upload request");
+        ok = false;
+        break;
+      }
+      ack_ids.push_back(id.value());
+    } else if (!co_await conn->send_request_without_response(request_to_send)) {
       LOG_ERROR("failed to send cs_upload request");
       ok = false;
       break;
     }
+    ++seq;
 
-    response_recved = co_await conn->recv_response(id.value());
-    if (!response_recved) {
-      LOG_ERROR("failed to recv cs_upload response");
-      ok = false;
+    /* 在途数据块达到窗口大小，等待最早的确认 */
+    while (ok && ack_ids.size() * ack_every >= window) {
+      response_recved = co_await conn->recv_response(ack_ids.front());
+      ack_ids.pop_front();
+      if (!response_recved || response_recved->stat != common::FRAME_STAT_OK) {
+        LOG_ERROR("cs_upload response stat {}", response_recved ? response_recved->stat : -1);
+        ok = false;
+      }
+    }
+    if (!ok) {
       break;
     }
-    if (response_recved->stat != 0) {
-      LOG_ERROR(std::format("cs_upload response stat {}", response_recved->stat));
+  }
+
+  /* 等待剩余的确认 */
+  while (ok && !ack_ids.empty()) {
+    response_recved = co_await conn->recv_response(ack_ids.front());
+    ack_ids.pop_front();
+    if (!response_recved || response_recved->stat != common::FRAME_STAT_OK) {
+      LOG_ERROR("cs_upload response stat {}", response_recved ? response_recved->stat : -1);
       ok = false;
-      break;
     }
   }
   if (!ok) {
+    /* 放弃未确认的数据块，释放其响应槽 */
+    for (auto ack_id : ack_ids) {
+      co_await conn->abandon_response(ack_id);
+    }
     co_return;
   }
 
-  /* 结束上传 */
+  /* 结束上传，seq 为数据块总数 */
   LOG_INFO(std::format("close upload"));
   auto file_name = path.substr(path.find_last_of('/') + 1);
-  request_to_send = common::create_frame(common::proto_cmd::cs_upload, common::frame_type::request, file_name.size(), common::FRAME_STAT_FINISH);
-  std::copy(file_name.begin(), file_name.end(), request_to_send->data);
+  request_to_send = common::create_frame(common::proto_cmd::cs_upload, common::frame_type::request, sizeof(common::cs_upload_chunk_header) + file_name.size(), common::FRAME_STAT_FINISH);
+  *(common::cs_upload_chunk_header *)request_to_send->data = {.transfer_id = transfer_id, .seq = htonl(seq)};
+  std::copy(file_name.begin(), file_name.end(), request_to_send->data + sizeof(common::cs_upload_chunk_header));
 
   response_recved = co_await conn->send_request_and_wait_response(request_to_send);
   if (!response_recved || response_recved->stat != common::FRAME_STAT_OK) {
@@ -185,10 +228,19 @@ auto download_file(std::string src, std::string dst) -> asio::awaitable<void> {
       continue;
     }
 
-    /* 下载数据 */
+    /* 下载数据，每个请求都携带 transfer_id */
     LOG_INFO(std::format("start download filesize {}", common::ntohll(*(uint64_t *)response_recved->data)));
+    auto download_request = common::create_frame(common::proto_cmd::cs_download, common::frame_type::request, sizeof(uint32_t));
+    *(uint32_t *)download_request->data = *(uint32_t *)(response_recved->data + sizeof(uint64_t));
+
+    /* 响应携带 crc32c 时边下载边校验 */
+    auto expected_crc = std::optional<uint32_t>{};
+    if (response_recved->data_len >= sizeof(uint64_t) + 2 * sizeof(uint32_t)) {
+      expected_crc = ntohl(*(uint32_t *)(response_recved->data + sizeof(uint64_t) + sizeof(uint32_t)));
+    }
+    auto crc = uint32_t{0};
     while (true) {
-      response_recved = co_await conn->send_request_and_wait_response({.cmd = common::proto_cmd::cs_download});
+      response_recved = co_await conn->send_request_and_wait_response(download_request);
       if (!response_recved) {
         LOG_ERROR("failed to recv cs_download response");
         break;
@@ -197,8 +249,13 @@ auto download_file(std::string src, std::string dst) -> asio::awaitable<void> {
       if (response_recved->stat == common::FRAME_STAT_OK ||
           response_recved->stat == common::FRAME_STAT_FINISH) {
         ofs.write(response_recved->data, response_recved->data_len);
+        crc = common::crc32c(crc, {response_recved->data, response_recved->data_len});
         if (response_recved->stat == common::FRAME_STAT_FINISH) {
           ofs.close();
+          if (expected_crc && crc != expected_crc) {
+            LOG_ERROR(std::format("download {} crc32c mismatch, expected {:08x}, actual {:08x}", src, expected_crc.value(), crc));
+            break;
+          }
           LOG_INFO("download finished");
           break;
         }
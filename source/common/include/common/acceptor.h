@@ -1,27 +1,76 @@
 #pragma once
 
 #include "connection.h"
+#include <asio/experimental/concurrent_channel.hpp>
+#include <chrono>
+
+namespace common_detail
+{
+
+  /* 握手超过该时长的 socket 直接关闭 */
+  constexpr auto acceptor_handshake_timeout = std::chrono::seconds{5};
+
+  /* 已完成握手、等待调用方取走的连接数量上限，超过时握手协程等待 */
+  constexpr auto acceptor_ready_capacity = 128uz;
+
+} // namespace common_detail
 
 namespace common
 {
 
+  /**
+   * @brief 监听端口，建立心跳后交给调用方
+   *
+   * 接受循环在构造时启动，每个 socket 在独立的协程中握手，慢速或恶意的对端不会阻塞后续的连接。
+   * 完成握手的连接通过 channel 交给 accept 的调用方。
+   */
   class acceptor
   {
   public:
+    /**
+     * @param reuse_port 设置 SO_REUSEPORT，多个 acceptor 监听同一端口，由内核分配新连接
+     */
     acceptor(asio::any_io_executor io,
              const std::string &ip, uint16_t port,
-             uint32_t heart_timeout, uint32_t heart_interval);
+             uint32_t heart_timeout, uint32_t heart_interval,
+             bool reuse_port = false);
+
+    /* 接受循环持有 this */
+    acceptor(const acceptor &) = delete;
+    auto operator=(const acceptor &) -> acceptor & = delete;
 
     /**
-     * @brief 接受一个新连接，且建立心跳
+     * @brief 取出一个已经建立心跳的新连接
      *
      */
     auto accept() -> asio::awaitable<std::shared_ptr<connection>>;
 
   private:
+    /**
+     * @brief 接受 socket，为每个 socket 启动握手协程
+     *
+     */
+    auto accept_loop() -> asio::awaitable<void>;
+
+    /**
+     * @brief 带超时的握手，成功时将连接送入 channel
+     *
+     */
+    auto handshake_with_timeout(asio::ip::tcp::socket sock) -> asio::awaitable<void>;
+
+    /**
+     * @brief 建立心跳并协商能力
+     *
+     * @return 失败时返回 nullptr
+     */
+    auto handshake(asio::ip::tcp::socket &sock) -> asio::awaitable<std::shared_ptr<connection>>;
+
+  private:
+    asio::any_io_executor m_io;
     asio::ip::tcp::acceptor m_acceptor;
     uint32_t m_heart_timeout;
     uint32_t m_heart_interval;
+    asio::experimental::concurrent_channel<void(asio::error_code, std::shared_ptr<connection>)> m_ready;
   };
 
 } // namespace common
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "protocol.h"
+#include <cstdint>
+#include <span>
+
+namespace common
+{
+
+  /**
+   * @brief payload 压缩算法
+   *
+   * @param name                算法名
+   * @param cap                 对应的能力位，双方都支持时才会使用
+   * @param compress_bound      压缩后的最大长度
+   * @param compress            压缩，返回压缩后的长度，失败返回 0
+   * @param decompress          解压，解压后的长度必须恰好为 raw_len
+   */
+  struct frame_codec
+  {
+    const char *name;
+    uint32_t cap;
+    auto (*compress_bound)(uint32_t raw_len) -> uint32_t;
+    auto (*compress)(const char *src, uint32_t src_len, char *dst, uint32_t dst_cap) -> uint32_t;
+    auto (*decompress)(const char *src, uint32_t src_len, char *dst, uint32_t raw_len) -> bool;
+  };
+
+  /**
+   * @brief 压缩后 payload 的头部，之后为压缩数据
+   *
+   * @param raw_len   压缩前的长度
+   */
+  struct frame_compress_header
+  {
+    uint32_t raw_len;
+  };
+
+  /**
+   * @brief 所有支持的压缩算法，按优先级排序
+   *
+   */
+  auto frame_codecs() -> std::span<const frame_codec>;
+
+  /**
+   * @brief 根据协商的能力选择压缩算法
+   *
+   * @return 没有双方都支持的算法时返回 nullptr
+   */
+  auto select_frame_codec(const xx_heart_establish_caps &caps) -> const frame_codec *;
+
+} // namespace common
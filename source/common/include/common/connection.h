@@ -1,13 +1,16 @@
 #pragma once
 
+#include "codec.h"
 #include "log.h"
 #include "protocol.h"
-#include <any>
+#include <array>
 #include <asio.hpp>
+#include <deque>
 #include <map>
 #include <memory>
 #include <source_location>
-#include <stacktrace>
+#include <span>
+#include <vector>
 
 namespace common
 {
@@ -17,26 +20,67 @@ namespace common
   using connection_ptr = std::shared_ptr<connection>;
 
   /**
-   * @brief connection 使用同步的方式发送数据，异步的方式接收数据
+   * @brief 连接的会话状态，各角色继承后直接以字段保存自己需要的数据
+   *
+   */
+  class session
+  {
+  public:
+    virtual ~session() = default;
+  };
+
+  using session_ptr = std::shared_ptr<session>;
+
+  /**
+   * @brief payload 零拷贝接收的目标文件
+   *
+   * @param fd        目标文件
+   * @param offset    payload 头之后的数据写入的偏移
+   * @param on_done   接收完成后在 strand 中调用，参数为是否全部写入文件
+   * @param write     执行管道到文件的写入并返回是否成功，写入磁盘可能阻塞，应交给 I/O 线程池执行。为空时在 strand 中直接写入
+   */
+  struct splice_target
+  {
+    int fd;
+    off_t offset;
+    std::function<asio::awaitable<void>(bool)> on_done;
+    std::function<asio::awaitable<bool>(std::function<bool()>)> write;
+  };
+
+  /**
+   * @brief 根据帧头和 payload 头选择零拷贝接收的目标，返回 std::nullopt 时按普通 frame 接收
+   *
+   */
+  using splice_selector = std::function<std::optional<splice_target>(const proto_frame &header, std::span<const char> prefix, std::shared_ptr<connection> conn)>;
+
+  /**
+   * @brief 设置通过 MSG_ZEROCOPY 发送的 payload 长度下限，0 表示关闭。应在建立连接前设置
+   *
+   */
+  auto set_zerocopy_send_min_len(uint32_t min_len) -> void;
+
+  /**
+   * @brief connection 使用异步的方式发送和接收数据
    *
    * 在异步发送数据时，asio::asyc_write 内部会多次调用 asio::async_write_some，因此如果有多个协程同时进行异步发送，会导致数据错乱
    *
-   * 有两种解决方案：
+   * 因此所有待发送的 frame 都会先进入发送队列，由唯一的发送协程（start_send）依次写入 socket。
    *
-   *      1. 异步 + 缓冲队列。但是对于当前协议格式，对于具有相同 payload 的 frame，也需要构造多个 frame（因为 frame 中包含了 id），且这种方式会导致发送的数据延迟增加。因此不考虑。
+   * frame_header 会拷贝一份并转换为网络字节序，和 payload 作为 scatter-gather 缓冲区一起发送，因此无需原地转换 frame 的字节序。
    *
-   *          也可以尝试将 frame_header 和 payload 分开处理，但是这样会导致发送数据的复杂度增加，且不符合当前的设计。
+   * 发送方会等待自己的 frame 写入完成后再返回，因此 payload 在发送期间始终有效，且慢速的对端只会阻塞自己的发送协程，而不会阻塞 io 线程。
    *
-   *      2. 同步发送数据。
+   * 通过 MSG_ZEROCOPY 发送时，内核在发送完成前仍会引用 payload，因此发送方会等到从错误队列中读取到完成通知后才返回。
    */
   class connection : public std::enable_shared_from_this<connection>
   {
 
   public:
     connection(asio::ip::tcp::socket &&sock,
-               uint32_t heart_timeout, uint32_t heart_interval);
+               uint32_t heart_timeout, uint32_t heart_interval,
+               xx_heart_establish_caps caps = {});
 
-    ~connection() = default;
+    ~connection();
 
     /**
      * @brief 开始处理接受数据和心跳
@@ -44,12 +88,27 @@ namespace common
      */
     auto start(std::function<asio::awaitable<void>(std::shared_ptr<proto_frame>, connection_ptr)> on_recv_request) -> void;
 
+    /**
+     * @brief 设置零拷贝接收，在 strand 中生效，之后收到的 frame 按新的设置接收
+     *
+     *        prefix_lens 为需要零拷贝接收的请求命令及其 payload 头的长度。payload 足够大时，只有 payload 头会读入内存并交由 selector
+     *        选择目标文件，其余部分经管道通过 splice 直接写入文件，此时不会再调用 start 的回调
+     */
+    auto set_splice_selector(std::map<proto_cmd, uint32_t> prefix_lens, splice_selector selector) -> void;
+
     /**
      * @brief 接受响应
      *
      */
     auto recv_response(uint16_t id) -> asio::awaitable<std::shared_ptr<proto_frame>>;
 
+    /**
+     * @brief 不再等待请求的响应，释放其响应槽，之后收到的响应会被丢弃
+     *
+     * send_request 返回的 id 必须调用 recv_response 或 abandon_response 之一，否则响应槽无法复用
+     */
+    auto abandon_response(uint16_t id) -> asio::awaitable<void>;
+
     /**
      * @brief 发送请求，frame 只需要设置 cmd 和 data_len 字段。保证发送前后的 frame 一致
      *
@@ -59,6 +118,18 @@ namespace common
     auto send_request(proto_frame frame, std::source_location loc = std::source_location::current()) -> asio::awaitable<std::optional<uint16_t>>;
     auto send_request_without_data(proto_frame frame, std::source_location loc = std::source_location::current()) -> asio::awaitable<std::optional<uint16_t>>;
 
+    /**
+     * @brief 发送不需要响应的请求，对端不会为该请求发送响应，因此也不会占用响应缓冲
+     *
+     */
+    auto send_request_without_response(proto_frame_ptr frame, std::source_location loc = std::source_location::current()) -> asio::awaitable<bool>;
+
+    /**
+     * @brief 发送请求，payload 为文件 file_fd 从 offset 开始的 frame.data_len 字节，通过 sendfile 零拷贝发送
+     *
+     */
+    auto send_request_with_file(proto_frame frame, int file_fd, off_t offset, std::source_location loc = std::source_location::current()) -> asio::awaitable<std::optional<uint16_t>>;
+
     /**
      * @brief 发送响应，frame 只需要设置 sta 和 data_len。保证发送前后的 frame 一致。
      *
@@ -68,6 +139,12 @@ namespace common
     auto send_response(const proto_frame &req_frame, std::source_location loc = std::source_location::current()) -> asio::awaitable<bool>;
     auto send_response_without_data(proto_frame frame, const proto_frame &req_frame, std::source_location loc = std::source_location::current()) -> asio::awaitable<bool>;
 
+    /**
+     * @brief 发送响应，payload 为文件 file_fd 从 offset 开始的 frame.data_len 字节，通过 sendfile 零拷贝发送
+     *
+     */
+    auto send_response_with_file(proto_frame frame, const proto_frame &req_frame, int file_fd, off_t offset, std::source_location loc = std::source_location::current()) -> asio::awaitable<bool>;
+
     /**
      * @brief 发送请求并等待响应
      *
@@ -101,48 +178,30 @@ namespace common
     auto address() -> std::string { return std::format("{}:{}", ip(), port()); }
 
     /**
-     * @brief 设置用户数据
+     * @brief 握手时协商的能力，对端为旧版本时不包含任何能力
      *
      */
-    template <typename T>
-    auto set_data(uint64_t key, T value) -> void
-    {
-      m_datas[key] = std::move(value);
-    }
+    auto capabilities() -> const xx_heart_establish_caps & { return m_caps; }
 
     /**
-     * @brief 获取用户数据
+     * @brief 发送 len 字节的 payload 时是否会尝试压缩，会被压缩的数据应读到内存中发送，不使用 sendfile
      *
      */
-    template <typename T>
-    auto get_data(uint64_t key) -> std::optional<T>
-    try
-    {
-      auto it = m_datas.find(key);
-      if (it == m_datas.end())
-      {
-        return std::nullopt;
-      }
-      return std::any_cast<T>(it->second);
-    }
-    catch (const std::bad_any_cast &ec)
-    {
-      auto entry = std::stacktrace::current(1, 1).at(0);
-      LOG_CRITICAL("[{}:{}] get key {} invalid type {}", entry.source_file(), entry.source_line(), key, typeid(T).name());
-      return std::nullopt;
-    }
+    auto compresses(uint64_t len) -> bool { return m_codec != nullptr && len >= compress_min_len; }
 
     /**
-     * @brief 判断用户数据是否存在
+     * @brief 设置会话状态，连接的角色变化时替换为新角色的会话
      *
      */
-    auto has_data(uint64_t key) -> bool { return m_datas.contains(key); }
+    auto set_session(session_ptr session) -> void { m_session = std::move(session); }
 
     /**
-     * @brief 删除用户数据
+     * @brief 获取会话状态，T 必须是当前会话的实际类型或其基类
      *
+     * @return 未设置会话时返回 nullptr
      */
-    auto del_data(uint64_t key) -> void { m_datas.erase(key); }
+    template <typename T>
+    auto get_session() -> std::shared_ptr<T> { return std::static_pointer_cast<T>(m_session); }
 
     /**
      * @brief 关闭连接
@@ -166,7 +225,7 @@ namespace common
 
   private:
     /**
-     * @brief 开启心跳
+     * @brief 开启心跳，heart_interval 内发送过数据时不发送心跳
      *
      */
     auto start_heart() -> asio::awaitable<void>;
@@ -177,13 +236,175 @@ namespace common
      */
     auto start_recv() -> asio::awaitable<void>;
 
+    /**
+     * @brief 空闲检测，超过 heart_timeout 没有收到任何数据时断开连接
+     *
+     */
+    auto start_watchdog() -> asio::awaitable<void>;
+
+    /**
+     * @brief 开始发送消息，依次发送队列中的 frame
+     *
+     */
+    auto start_send() -> asio::awaitable<void>;
+
+    /**
+     * @brief 读取 MSG_ZEROCOPY 的完成通知，唤醒对应的发送方
+     *
+     */
+    auto start_zerocopy_reaper() -> asio::awaitable<void>;
+
+    /**
+     * @brief 通过 MSG_ZEROCOPY 发送，内核的 optmem 不足时剩余部分使用普通方式发送
+     *
+     * @return <错误码, 发送的字节数, 其中通过 MSG_ZEROCOPY 发送的字节数>
+     */
+    auto send_zerocopy(std::vector<asio::const_buffer> buffers) -> asio::awaitable<std::tuple<asio::error_code, size_t, size_t>>;
+
+    /**
+     * @brief 从错误队列中读取所有完成通知
+     *
+     */
+    auto reap_zerocopy() -> void;
+
     /**
      * @brief 发送帧
      *
-     * @param frame 会将 frame_header 和 payload 一起发送，且发送前和发送后都会转换 frame_header 的字节序
+     * @param frame 会将 frame_header 和 payload 一起发送，frame 本身不会被修改
      */
     auto send_frame(proto_frame_ptr frame, std::source_location loc) -> asio::awaitable<bool>;
 
+    /**
+     * @brief 发送帧头，如果 file_fd 有效，帧头之后会通过 sendfile 发送文件 offset 开始的 header.data_len 字节
+     *
+     */
+    auto send_frame(const proto_frame &header, int file_fd, off_t offset, std::source_location loc) -> asio::awaitable<bool>;
+
+    /**
+     * @brief 待发送的 frame
+     *
+     * @param header    网络字节序的帧头
+     * @param payload   持有 payload，为 nullptr 表示没有内存中的 payload
+     * @param file_fd   不为 -1 时，帧头之后通过 sendfile 发送文件数据
+     * @param waiter    等待发送完成的协程，以发送结果调用，为空表示发送方不等待
+     */
+    struct send_entry
+    {
+      proto_frame header;
+      proto_frame_ptr payload;
+      int file_fd = -1;
+      off_t file_offset = 0;
+      asio::any_completion_handler<void(bool)> waiter;
+    };
+
+    /**
+     * @brief 等待完成通知的 MSG_ZEROCOPY 发送
+     *
+     * @param seq       最后一次 sendmsg 对应的通知序号
+     * @param bytes     发送的字节数
+     * @param entries   发送的 frame，完成后才释放 payload 和唤醒发送方
+     */
+    struct zerocopy_pending
+    {
+      uint32_t seq;
+      uint64_t bytes;
+      std::vector<send_entry> entries;
+    };
+
+    /**
+     * @brief 加入发送队列，并等待发送完成
+     *
+     */
+    auto push_send_entry(send_entry entry) -> asio::awaitable<bool>;
+
+    /**
+     * @brief 以发送结果唤醒等待的发送方
+     *
+     */
+    auto complete_send_entry(send_entry &entry, bool ok) -> void;
+
+    /**
+     * @brief 使用协商的算法压缩 payload
+     *
+     * @return 未协商压缩、payload 太小或压缩率不足时返回 nullptr，此时原样发送
+     */
+    auto compress_frame(const proto_frame &frame) -> proto_frame_ptr;
+
+    /**
+     * @brief 解压收到的 payload，返回的 frame 帧头与 frame 相同
+     *
+     */
+    auto decompress_frame(const proto_frame_ptr &frame) -> proto_frame_ptr;
+
+    /**
+     * @brief 设置 TCP_CORK，取消时发送剩余的数据
+     *
+     */
+    auto set_cork(bool cork) -> bool;
+
+    /**
+     * @brief 通过 sendfile 发送文件数据
+     *
+     */
+    auto send_file(int file_fd, off_t offset, uint64_t len) -> asio::awaitable<bool>;
+
+    /**
+     * @brief 读取 payload，每收到一段数据都刷新 m_last_recv
+     *
+     */
+    auto recv_payload(char *dst, size_t len) -> asio::awaitable<bool>;
+
+    /**
+     * @brief 将 socket 中接下来的 len 字节经管道 splice 到 target 的文件 offset 处，管道到文件的部分通过 target.write 执行
+     *
+     */
+    auto splice_payload(const splice_target &target, uint64_t len) -> asio::awaitable<bool>;
+
+    /**
+     * @brief 分配请求 id 并占用对应的响应槽，所有槽都在等待响应时挂起，直到有槽被释放
+     *
+     * @return 连接已关闭返回 std::nullopt
+     */
+    auto alloc_response_slot() -> asio::awaitable<std::optional<uint16_t>>;
+
+    /**
+     * @brief 释放响应槽，唤醒一个等待分配的协程
+     *
+     */
+    auto release_response_slot(uint16_t id) -> void;
+
+    /**
+     * @brief 响应槽，请求 id 对 response_slot_count 取模后得到槽的下标
+     *
+     * @param id      占用该槽的请求 id
+     * @param busy    是否有请求占用该槽
+     * @param frame   收到的响应
+     * @param waiter  等待响应的协程，收到响应或连接关闭时调用
+     */
+    struct response_slot
+    {
+      uint16_t id = 0;
+      bool busy = false;
+      std::shared_ptr<proto_frame> frame;
+      asio::any_completion_handler<void()> waiter;
+    };
+
+    /* payload 小于该值时不压缩 */
+    static constexpr auto compress_min_len = 4 * 1024u;
+
+    /* 压缩率不足时，之后的若干个 frame 不再尝试压缩 */
+    static constexpr auto compress_skip_frames = 8u;
+
+    /* 同时等待响应的请求数上限，必须整除 65536，保证 id 回绕后映射到同一个槽 */
+    static constexpr auto response_slot_count = 1024uz;
+
+    /* payload 头的长度上限，以及 payload 头之后的数据小于该值时不零拷贝接收 */
+    static constexpr auto splice_max_prefix_len = 64uz;
+    static constexpr auto splice_min_len = 64 * 1024u;
+
+    /* splice 管道的容量 */
+    static constexpr auto splice_pipe_size = 1024 * 1024;
+
   private:
     asio::ip::tcp::socket m_sock;
 
@@ -202,14 +423,44 @@ namespace common
     uint32_t m_heart_timeout = -1;
     uint32_t m_heart_interval = -1;
 
+    /* 最近一次收到和发送数据的时间，收到任何数据都会推迟空闲超时 */
+    std::chrono::steady_clock::time_point m_last_recv;
+    std::chrono::steady_clock::time_point m_last_send;
+    std::unique_ptr<asio::steady_timer> m_idle_timer;
+
+    /* 协商的能力 */
+    xx_heart_establish_caps m_caps;
+
+    /* 协商的压缩算法，nullptr 表示不压缩 */
+    const frame_codec *m_codec = nullptr;
+    uint32_t m_compress_skip = 0;
+
+    /* 发送队列，只由发送协程写入 socket */
+    std::deque<send_entry> m_send_queue;
+    std::unique_ptr<asio::steady_timer> m_send_timer;
+
+    /* MSG_ZEROCOPY 发送，m_zerocopy_seq 为下一次 sendmsg 的通知序号，与内核的计数保持一致 */
+    bool m_zerocopy = false;
+    uint32_t m_zerocopy_seq = 0;
+    std::deque<zerocopy_pending> m_zerocopy_pending;
+    std::unique_ptr<asio::steady_timer> m_zerocopy_timer;
+
     /* 关闭连接 */
     bool m_closed = false;
 
-    /* 用户定义数据 */
-    std::map<uint64_t, std::any> m_datas;
+    /* 会话状态 */
+    session_ptr m_session;
+
+    /* 响应槽，只在 strand 中访问 */
+    std::array<response_slot, response_slot_count> m_response_slots;
+
+    /* 等待空闲响应槽的协程，按先后顺序唤醒，只在 strand 中访问 */
+    std::deque<asio::any_completion_handler<void()>> m_slot_waiters;
 
-    /* 响应 frame 缓冲 */
-    std::map<uint16_t, std::pair<std::shared_ptr<proto_frame>, std::unique_ptr<asio::steady_timer>>> m_response_frames;
+    /* 零拷贝接收，管道在第一次 splice 时创建 */
+    std::map<proto_cmd, uint32_t> m_splice_prefix_lens;
+    splice_selector m_splice_selector;
+    std::array<int, 2> m_splice_pipe = {-1, -1};
 
     /* 收到 request 后的回调 */
     std::function<asio::awaitable<void>(std::shared_ptr<proto_frame>, connection_ptr)> m_on_recv_request;
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace common_detail
+{
+
+  /**
+   * @brief 查表实现，适用于所有平台
+   *
+   */
+  auto crc32c_sw(uint32_t crc, const char *data, size_t len) -> uint32_t;
+
+  /**
+   * @brief SSE4.2 crc32 指令实现，只能在支持 SSE4.2 的 CPU 上调用
+   *
+   */
+  auto crc32c_hw(uint32_t crc, const char *data, size_t len) -> uint32_t;
+
+  /**
+   * @brief 当前 CPU 是否支持 crc32c_hw
+   *
+   */
+  auto crc32c_hw_supported() -> bool;
+
+} // namespace common_detail
+
+namespace common
+{
+
+  /**
+   * @brief 增量计算 CRC32C（Castagnoli），运行时选择硬件或查表实现
+   *
+   * @param crc   之前数据的 CRC32C，第一段数据传 0
+   */
+  auto crc32c(uint32_t crc, std::span<const char> data) -> uint32_t;
+
+} // namespace common
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "connection.h"
+#include "protocol.h"
+#include <array>
+#include <bit>
+#include <cstring>
+#include <initializer_list>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace common
+{
+
+  /**
+   * @brief 请求的处理函数
+   *
+   */
+  using request_handle_fn = auto (*)(proto_frame_ptr, connection_ptr) -> asio::awaitable<bool>;
+
+  /**
+   * @brief 按 proto_cmd 下标索引的处理函数表，未注册的命令为 nullptr
+   *
+   */
+  using dispatch_table = std::array<request_handle_fn, std::to_underlying(proto_cmd::sentinel)>;
+
+  /**
+   * @brief 编译期构造处理函数表，同一命令注册两次时编译失败
+   *
+   */
+  consteval auto make_dispatch_table(std::initializer_list<std::pair<proto_cmd, request_handle_fn>> entries) -> dispatch_table
+  {
+    auto table = dispatch_table{};
+    for (auto [cmd, handle] : entries)
+    {
+      if (cmd >= proto_cmd::sentinel || table[std::to_underlying(cmd)] != nullptr)
+      {
+        throw "invalid or duplicate proto_cmd in dispatch table";
+      }
+      table[std::to_underlying(cmd)] = handle;
+    }
+    return table;
+  }
+
+  /**
+   * @brief 查找命令的处理函数
+   *
+   * @return 命令越界或未注册时返回 nullptr
+   */
+  constexpr auto find_handle(const dispatch_table &table, proto_cmd cmd) -> request_handle_fn
+  {
+    return cmd < proto_cmd::sentinel ? table[std::to_underlying(cmd)] : nullptr;
+  }
+
+  /**
+   * @brief 命令的 request payload，特化时提供 type 和 static auto decode(const proto_frame &) -> std::optional<type>
+   *
+   * 未特化的命令由处理函数自行解析 payload
+   */
+  template <proto_cmd Cmd>
+  struct request_payload;
+
+  /**
+   * @brief 网络字节序的定长整数
+   *
+   */
+  template <typename T>
+    requires std::is_unsigned_v<T>
+  struct integer_payload
+  {
+    using type = T;
+
+    static auto decode(const proto_frame &frame) -> std::optional<type>
+    {
+      if (frame.data_len != sizeof(T))
+      {
+        return std::nullopt;
+      }
+      auto value = T{};
+      std::memcpy(&value, frame.data, sizeof(T));
+      if constexpr (std::endian::native == std::endian::little)
+      {
+        value = std::byteswap(value);
+      }
+      return value;
+    }
+  };
+
+  /**
+   * @brief protobuf 消息
+   *
+   */
+  template <typename Message>
+  struct proto_payload
+  {
+    using type = Message;
+
+    static auto decode(const proto_frame &frame) -> std::optional<type>
+    {
+      auto message = Message{};
+      if (!message.ParseFromArray(frame.data, frame.data_len))
+      {
+        return std::nullopt;
+      }
+      return message;
+    }
+  };
+
+  template <>
+  struct request_payload<proto_cmd::cm_fetch_one_storage> : integer_payload<uint64_t>
+  {
+  };
+
+  template <>
+  struct request_payload<proto_cmd::cm_fetch_group_storages> : integer_payload<uint32_t>
+  {
+  };
+
+  /**
+   * @brief 解码 payload 后调用 Handle，payload 无效时以 stat 1 响应
+   *
+   * Handle 的参数为 (proto_frame_ptr, connection_ptr, request_payload<Cmd>::type)
+   */
+  template <proto_cmd Cmd, auto Handle>
+  auto typed_handle(proto_frame_ptr request, connection_ptr conn) -> asio::awaitable<bool>
+  {
+    auto payload = request_payload<Cmd>::decode(*request);
+    if (!payload)
+    {
+      LOG_ERROR("invalid payload of {} from {}", *request, conn->address());
+      co_await conn->send_response(proto_frame{.stat = 1}, *request);
+      co_return false;
+    }
+    co_return co_await Handle(std::move(request), std::move(conn), std::move(payload.value()));
+  }
+
+} // namespace common
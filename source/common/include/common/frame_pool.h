@@ -0,0 +1,87 @@
+#pragma once
+
+#include "json.h"
+#include "protocol.h"
+#include <array>
+#include <atomic>
+
+namespace common_detail
+{
+
+  /* payload 小于该值的 frame 直接使用 malloc，glibc 对小内存的分配本身足够高效 */
+  constexpr auto frame_pool_small_limit = uint32_t{64 * 1024};
+
+  /* 为 payload 头（如 cs_upload_chunk_header）预留的额外空间 */
+  constexpr auto frame_pool_headroom = uint32_t{4 * 1024};
+
+  /* 缓冲池的容量等级，对应 1MB 和 5MB 的数据块 */
+  constexpr auto frame_pool_classes = std::array<uint32_t, 2>{
+      1024 * 1024 + frame_pool_headroom,
+      5 * 1024 * 1024 + frame_pool_headroom,
+  };
+
+  /* 每个线程缓存的 buffer 数量上限 */
+  constexpr auto frame_pool_thread_limit = std::array<size_t, frame_pool_classes.size()>{4, 2};
+
+  /* 所有线程共享缓存的 buffer 数量上限 */
+  constexpr auto frame_pool_global_limit = std::array<size_t, frame_pool_classes.size()>{64, 16};
+
+  /**
+   * @brief 缓冲池相关的指标
+   *
+   * @param alloc     通过缓冲池分配的次数
+   * @param hit       命中缓存的次数
+   * @param unpooled  大小不属于任何容量等级，直接使用 malloc 的次数
+   * @param pooled    缓冲池持有的字节数，包括正在使用和已缓存的 buffer
+   */
+  inline struct frame_pool_metrics_t
+  {
+    std::atomic_uint64_t alloc;
+    std::atomic_uint64_t hit;
+    std::atomic_uint64_t unpooled;
+    std::atomic_uint64_t pooled;
+  } frame_pool_metrics;
+
+  /**
+   * @brief 释放 frame 时将 buffer 归还到缓冲池
+   *
+   */
+  struct frame_pool_deleter
+  {
+    size_t class_idx;
+
+    auto operator()(common::proto_frame *frame) const -> void;
+  };
+
+  /**
+   * @brief 从缓存中获取 buffer，优先当前线程的缓存
+   *
+   * @return 缓存为空时返回 nullptr
+   */
+  auto frame_pool_get(size_t class_idx) -> void *;
+
+  /**
+   * @brief 归还 buffer，缓存已满时直接释放
+   *
+   */
+  auto frame_pool_put(size_t class_idx, void *buffer) -> void;
+
+} // namespace common_detail
+
+namespace common
+{
+
+  /**
+   * @brief 分配 payload 容量至少为 data_len 的 frame，frame 释放时 buffer 会归还到缓冲池
+   *
+   * @return 分配失败返回 nullptr，frame_header 未初始化
+   */
+  auto alloc_frame(uint32_t data_len) -> proto_frame_ptr;
+
+  /**
+   * @brief 获取缓冲池指标
+   *
+   */
+  auto get_frame_pool_metrics() -> nlohmann::json;
+
+} // namespace common
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <asio.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace common
+{
+
+  /**
+   * @brief 将当前线程绑定到 cpu % 在线 CPU 数量 上
+   *
+   * @return 是否绑定成功
+   */
+  auto pin_thread_to_cpu(uint32_t cpu) -> bool;
+
+  /**
+   * @brief 每个线程独占一个 io_context 的执行模型
+   *
+   * 每个 io_context 只由一个绑定到固定 CPU 的线程运行，以 concurrency_hint 1 创建，调度器只运行一个线程，但内部队列仍然加锁。
+   * 持久化线程、下载缓存的等待者和 run_io 的完成回调都会从其它线程 post 到分片中，不能改用 ASIO_CONCURRENCY_HINT_UNSAFE。
+   * 每个分片各自持有一个 SO_REUSEPORT 的 acceptor，由内核在分片之间分配新连接，连接此后一直在接受它的线程上处理。
+   */
+  class io_shards
+  {
+  public:
+    io_shards(uint32_t count);
+
+    /**
+     * @brief 分片数量
+     *
+     */
+    auto size() const -> uint32_t { return (uint32_t)m_contexts.size(); }
+
+    /**
+     * @brief 第 idx 个分片的 io_context
+     *
+     */
+    auto context(uint32_t idx) -> asio::io_context & { return *m_contexts[idx]; }
+
+    /**
+     * @brief 为分片 1 到 size - 1 各启动一个线程，分片 0 在调用线程中运行，直到 io_context 停止
+     *
+     */
+    auto run() -> int;
+
+  private:
+    std::vector<std::unique_ptr<asio::io_context>> m_contexts;
+    std::vector<asio::executor_work_guard<asio::io_context::executor_type>> m_guards;
+  };
+
+} // namespace common
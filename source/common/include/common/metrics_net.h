@@ -1,7 +1,9 @@
 #pragma once
 
 #include "json.h"
+#include <array>
 #include <asio.hpp>
+#include <atomic>
 #include <mutex>
 
 namespace common_detail
@@ -17,6 +19,67 @@ namespace common_detail
 
   inline auto net_metrics_lock = std::mutex{};
 
+  /**
+   * @brief frame 压缩相关的指标
+   *
+   * @param send_raw          压缩发送的 payload 压缩前的字节数
+   * @param send_compressed   压缩发送的 payload 压缩后的字节数
+   * @param send_skipped      压缩率不足而原样发送的字节数
+   * @param recv_raw          接收的压缩 payload 解压后的字节数
+   * @param recv_compressed   接收的压缩 payload 的字节数
+   */
+  inline struct net_compress_metrics_t
+  {
+    std::atomic_uint64_t send_raw;
+    std::atomic_uint64_t send_compressed;
+    std::atomic_uint64_t send_skipped;
+    std::atomic_uint64_t recv_raw;
+    std::atomic_uint64_t recv_compressed;
+  } net_compress_metrics;
+
+  /**
+   * @brief 零拷贝收发相关的指标
+   *
+   * @param splice_recv_frames          通过 splice 直接写入文件的 frame 数量
+   * @param splice_recv_bytes           通过 splice 直接写入文件的字节数
+   * @param send_copy_bytes             普通方式发送的内存数据字节数
+   * @param send_zerocopy_bytes         通过 MSG_ZEROCOPY 发送且内核没有拷贝的字节数
+   * @param send_zerocopy_copied_bytes  通过 MSG_ZEROCOPY 发送但内核仍然拷贝的字节数（如回环网卡）
+   */
+  inline struct net_zero_copy_metrics_t
+  {
+    std::atomic_uint64_t splice_recv_frames;
+    std::atomic_uint64_t splice_recv_bytes;
+    std::atomic_uint64_t send_copy_bytes;
+    std::atomic_uint64_t send_zerocopy_bytes;
+    std::atomic_uint64_t send_zerocopy_copied_bytes;
+  } net_zero_copy_metrics;
+
+  /* 握手延迟直方图的桶数量，第 i 个桶为 [2^(i-1), 2^i) 毫秒，第 0 个桶为 1 毫秒以内，最后一个桶包含更长的延迟 */
+  constexpr auto accept_latency_buckets = 14uz;
+
+  /**
+   * @brief 接受连接相关的指标
+   *
+   * @param accepted      accept 返回的 socket 数量
+   * @param handshaking   正在握手的 socket 数量
+   * @param ready         已完成握手、等待调用方取走的连接数量
+   * @param established   完成握手的连接数量
+   * @param failed        握手失败的 socket 数量
+   * @param timeout       握手超时的 socket 数量
+   * @param latency_ms    握手耗时的直方图
+   */
+  inline struct net_accept_metrics_t
+  {
+    std::atomic_uint64_t accepted;
+    std::atomic_int64_t handshaking;
+    std::atomic_int64_t ready;
+    std::atomic_uint64_t established;
+    std::atomic_uint64_t failed;
+    std::atomic_uint64_t timeout;
+    std::array<std::atomic_uint64_t, accept_latency_buckets> latency_ms{};
+  } net_accept_metrics;
+
   /**
    * @brief 解析 /proc/net/dev
    *
@@ -19,7 +19,11 @@ namespace common
     /**
      * @brief 建立心跳，由服务端发起
      *
+     *        request 的 stat 为 HEART_ESTABLISH_V2 时表示服务端支持能力协商，客户端可以在 response 中携带自己的能力，
+     *        服务端随后再发送一个 response，payload 为双方协商后的能力。旧版本的客户端忽略 stat，响应无 payload，此时不启用任何能力。
+     *
      * @param request   xx_heart_establish_request
+     * @param response  无 payload 或 xx_heart_establish_caps
      */
     xx_heart_establish,
 
@@ -47,14 +51,15 @@ namespace common
     /**
      * @brief 开始同步上传的文件（多个文件同步的过程是同步进行的，而非并行）
      *
-     * @param request     { uint64 filesize, string relpath }
+     * @param request     { uint64 filesize, string relpath }，协商了 CAP_CHECKSUM_CRC32C 时为 { uint64 filesize, uint32 crc32c, string relpath }
      */
     ss_upload_sync_start,
 
     /**
      * @brief 发送同步文件的数据。
      *
-     * @param request { array data }。stat == STAT_FINISH 表示同步完成
+     * @param request { array data }。stat == STAT_FINISH 表示同步完成，此时 data 为最后一段数据。
+     *                接收端在同步完成时校验 crc32c，不一致时删除文件并以 stat 4 响应
      */
     ss_upload_sync,
 
@@ -89,30 +94,38 @@ namespace common
     cm_fetch_group_storages,
 
     /**
-     * @brief 开始上传文件（不能并行上传多个文件）
+     * @brief 开始上传文件
      *
-     * @param request { uint64 filesize }
+     * @param request   { uint64 filesize } 或 cs_upload_start_request，前者等价于 upload_mode::normal。
+     *                  前者为旧版本的请求，同一连接上不能与其他上传并行；后者分配 transfer_id，同一连接上可以并行上传多个文件
+     * @param response  请求为 cs_upload_start_request 时为 { uint32 transfer_id }
      */
     cs_upload_start,
 
     /**
-     * @brief 上传数据（不能并行上传多个数据块）。
+     * @brief 上传数据
      *
      * @param request { array data }。stat == STAT_FINISH 表示上传完成，且此时 data 为文件名
+     *
+     *        通过 cs_upload_start_request 开始的上传为 { cs_upload_chunk_header, array data }。
+     *        upload_mode::stream 时只有 (seq + 1) % ack_every == 0 的数据块和 STAT_FINISH 需要响应，STAT_FINISH 时 seq 为数据块总数。
+     * @param response upload_mode::stream 且 stat == STAT_OK 时为 { uint32 acked }，表示已写入的数据块数量
      */
     cs_upload,
 
     /**
-     * @brief 开始下载文件
+     * @brief 开始下载文件，同一连接上可以并行下载多个文件
      *
      * @param request   { string rel_path }
-     * @param response  { uint64 filesize }
+     * @param response  { uint64 filesize, uint32 transfer_id }。连接上没有进行中的下载时 transfer_id 为 0。
+     *                  协商了 CAP_CHECKSUM_CRC32C 时为 { uint64 filesize, uint32 transfer_id, uint32 crc32c }
      */
     cs_download_start,
 
     /**
      * @brief 下载数据
      *
+     * @param request   { uint32 transfer_id }，为空时等价于 transfer_id 为 0
      * @param response  { array data }。stat == STAT_FINISH 表示下载完成
      */
     cs_download,
@@ -143,7 +156,77 @@ namespace common
     uint32_t interval;
   };
 
+  /**
+   * @brief 能力协商的 payload，网络字节序传输
+   *
+   * @param version         握手版本，旧版本的对端为 0
+   * @param flags           CAP_??? 的组合
+   * @param max_frame_len   能接收的最大 payload 长度，0 表示未协商。接收方始终按自身的值检查，超过时断开连接，不需要单独的能力位
+   * @param chunk_size      期望的数据块大小，0 表示未协商
+   */
+  struct xx_heart_establish_caps
+  {
+    uint32_t version;
+    uint32_t flags;
+    uint32_t max_frame_len;
+    uint32_t chunk_size;
+
+    auto has(uint32_t cap) const -> bool { return (flags & cap) == cap; }
+  };
+  static_assert(sizeof(xx_heart_establish_caps) == 16);
+
+  constexpr auto HEART_ESTABLISH_V2 = uint8_t{2};
+
+  /* 能力位 */
+  constexpr auto CAP_COMPRESS_LZ4 = uint32_t{1} << 0;
+  constexpr auto CAP_CHECKSUM_CRC32C = uint32_t{1} << 1;
+  constexpr auto CAP_STREAM_UPLOAD = uint32_t{1} << 2;
+
+  /**
+   * @brief 上传模式
+   *
+   * normal   每个数据块都需要等待响应后才能发送下一个
+   * stream   客户端保持多个数据块在途，服务端按序号检查顺序，并且每 ack_every 个数据块累计确认一次
+   */
+  enum class upload_mode : uint32_t
+  {
+    normal,
+    stream,
+    sentinel,
+  };
+
+  /**
+   * @brief cs_upload_start 的 payload
+   *
+   * @param file_size   文件大小
+   * @param mode        上传模式 upload_mode
+   * @param ack_every   upload_mode::stream 时，每 ack_every 个数据块确认一次
+   */
+  struct cs_upload_start_request
+  {
+    uint64_t file_size;
+    upload_mode mode;
+    uint32_t ack_every;
+  };
+  static_assert(sizeof(cs_upload_start_request) == 16);
+
+  /**
+   * @brief 通过 cs_upload_start_request 开始的上传，cs_upload 的 payload 头
+   *
+   * @param transfer_id   cs_upload_start 响应的 transfer_id
+   * @param seq           数据块序号，从 0 开始，只在 upload_mode::stream 时检查
+   */
+  struct cs_upload_chunk_header
+  {
+    uint32_t transfer_id;
+    uint32_t seq;
+  };
+
   constexpr auto FRAME_MAGIC = uint16_t{0x55aa};
+
+  /* type 字节的高位用作 frame 标志，只在传输时出现，接收后由 connection 去除 */
+  constexpr auto FRAME_TYPE_MASK = uint8_t{0x0f};
+  constexpr auto FRAME_FLAG_COMPRESSED = uint8_t{0x80};
   constexpr auto FRAME_STAT_OK = uint8_t{0};
   constexpr auto FRAME_STAT_FINISH = uint8_t{255};
 
@@ -180,7 +263,27 @@ namespace common
   auto trans_frame_to_host(proto_frame *frame) -> void;
 
   /**
-   * @brief 构造 frame
+   * @brief 能力的字节序转换
+   *
+   */
+  auto trans_caps_to_net(xx_heart_establish_caps *caps) -> void;
+  auto trans_caps_to_host(xx_heart_establish_caps *caps) -> void;
+
+  /**
+   * @brief 本端支持的能力，握手时提供给对端。应在建立连接前设置
+   *
+   */
+  auto local_capabilities() -> xx_heart_establish_caps;
+  auto set_local_capabilities(xx_heart_establish_caps caps) -> void;
+
+  /**
+   * @brief 协商双方都支持的能力，长度取较小的非 0 值
+   *
+   */
+  auto negotiate_capabilities(const xx_heart_establish_caps &local, const xx_heart_establish_caps &peer) -> xx_heart_establish_caps;
+
+  /**
+   * @brief 构造 frame，payload 从缓冲池中分配
    *
    */
   auto create_frame(proto_cmd cmd, frame_type type, uint32_t data_len, uint8_t stat = FRAME_STAT_OK) -> std::shared_ptr<proto_frame>;
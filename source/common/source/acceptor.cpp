@@ -1,17 +1,26 @@
+#include <asio/experimental/awaitable_operators.hpp>
+#include <bit>
 #include <common/acceptor.h>
+#include <common/exception.h>
+#include <common/metrics_net.h>
 
 namespace common
 {
 
   acceptor::acceptor(asio::any_io_executor io,
                      const std::string &ip, uint16_t port,
-                     uint32_t heart_timeout, uint32_t heart_interval)
+                     uint32_t heart_timeout, uint32_t heart_interval,
+                     bool reuse_port)
   try
-      : m_acceptor{io}, m_heart_timeout{heart_timeout}, m_heart_interval{heart_interval}
+      : m_io{io}, m_acceptor{io}, m_heart_timeout{heart_timeout}, m_heart_interval{heart_interval}, m_ready{io, common_detail::acceptor_ready_capacity}
   {
     auto ep = asio::ip::tcp::endpoint(asio::ip::make_address(ip), port);
     m_acceptor.open(ep.protocol());
     m_acceptor.set_option(asio::socket_base::reuse_address(true));
+    if (reuse_port)
+    {
+      m_acceptor.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+    }
     m_acceptor.bind(ep);
     m_acceptor.listen();
     if (!m_acceptor.is_open())
@@ -20,6 +29,7 @@ namespace common
       exit(-1);
     }
     LOG_INFO(std::format("accept at {}:{}", ip, port));
+    asio::co_spawn(m_io, accept_loop(), exception_handle);
   }
   catch (const std::runtime_error &ec)
   {
@@ -27,53 +37,140 @@ namespace common
     exit(-1);
   }
 
+
   auto acceptor::accept() -> asio::awaitable<std::shared_ptr<connection>>
+  {
+    auto [ec, conn] = co_await m_ready.async_receive(asio::as_tuple(asio::use_awaitable));
+    --common_detail::net_accept_metrics.ready;
+    co_return conn;
+  }
+
+  auto acceptor::accept_loop() -> asio::awaitable<void>
   {
     while (true)
     {
-      auto sock = asio::ip::tcp::socket{co_await asio::this_coro::executor};
-      auto [ec] = co_await m_acceptor.async_accept(sock, asio::as_tuple(asio::use_awaitable));
+      auto [ec, sock] = co_await m_acceptor.async_accept(asio::as_tuple(asio::use_awaitable));
       if (ec)
       {
         LOG_DEBUG(std::format("acceptor accept failed, {}", ec.message()));
         continue;
       }
 
-      /* 建立心跳 */
-      char request_to_send[sizeof(proto_frame) + sizeof(xx_heart_establish_request)];
-      auto req_frame = (proto_frame *)request_to_send;
-      *req_frame = {
-          .cmd = proto_cmd::xx_heart_establish,
-          .type = frame_type::request,
-          .data_len = sizeof(xx_heart_establish_request),
-      };
-      trans_frame_to_net(req_frame);
-      *(xx_heart_establish_request *)req_frame->data = {
-          .timeout = htonl(m_heart_timeout),
-          .interval = htonl(m_heart_interval),
-      };
-      auto [ec_1, n_1] = co_await asio::async_write(sock, asio::const_buffer(request_to_send, sizeof(request_to_send)), asio::as_tuple(asio::use_awaitable));
-      if (ec_1 || n_1 != sizeof(request_to_send))
+      /* 每个 socket 在自己的 strand 上握手，互不阻塞 */
+      ++common_detail::net_accept_metrics.accepted;
+      asio::co_spawn(asio::make_strand(m_io), handshake_with_timeout(std::move(sock)), exception_handle);
+    }
+  }
+
+  auto acceptor::handshake_with_timeout(asio::ip::tcp::socket sock) -> asio::awaitable<void>
+  {
+    using namespace asio::experimental::awaitable_operators;
+    using common_detail::net_accept_metrics;
+
+    auto begin = std::chrono::steady_clock::now();
+    auto timer = asio::steady_timer{co_await asio::this_coro::executor, common_detail::acceptor_handshake_timeout};
+    ++net_accept_metrics.handshaking;
+    auto res = co_await (handshake(sock) || timer.async_wait(asio::use_awaitable));
+    --net_accept_metrics.handshaking;
+
+    /* 超时时握手的读写已被取消 */
+    if (res.index() == 1)
+    {
+      LOG_DEBUG("acceptor handshake timeout");
+      ++net_accept_metrics.timeout;
+      sock.close();
+      co_return;
+    }
+
+    auto conn = std::get<0>(res);
+    if (!conn)
+    {
+      ++net_accept_metrics.failed;
+      co_return;
+    }
+
+    auto ms = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    ++net_accept_metrics.latency_ms[std::min<size_t>(std::bit_width(ms), common_detail::accept_latency_buckets - 1)];
+    ++net_accept_metrics.established;
+    ++net_accept_metrics.ready;
+    co_await m_ready.async_send(asio::error_code{}, conn, asio::as_tuple(asio::use_awaitable));
+  }
+
+  auto acceptor::handshake(asio::ip::tcp::socket &sock) -> asio::awaitable<std::shared_ptr<connection>>
+  {
+    /* 建立心跳 */
+    char request_to_send[sizeof(proto_frame) + sizeof(xx_heart_establish_request)];
+    auto req_frame = (proto_frame *)request_to_send;
+    *req_frame = {
+        .cmd = proto_cmd::xx_heart_establish,
+        .type = frame_type::request,
+        .stat = HEART_ESTABLISH_V2,
+        .data_len = sizeof(xx_heart_establish_request),
+    };
+    trans_frame_to_net(req_frame);
+    *(xx_heart_establish_request *)req_frame->data = {
+        .timeout = htonl(m_heart_timeout),
+        .interval = htonl(m_heart_interval),
+    };
+    auto [ec_1, n_1] = co_await asio::async_write(sock, asio::const_buffer(request_to_send, sizeof(request_to_send)), asio::as_tuple(asio::use_awaitable));
+    if (ec_1 || n_1 != sizeof(request_to_send))
+    {
+      LOG_DEBUG(std::format("acceptor send establish heart failed, {} {}", ec_1.message(), n_1));
+      sock.close();
+      co_return nullptr;
+    }
+
+    /* 旧版本的客户端响应无 payload，新版本的客户端携带自己的能力 */
+    char response_recved[sizeof(proto_frame) + sizeof(xx_heart_establish_caps)];
+    auto res_frame = (proto_frame *)response_recved;
+    auto [ec_2, n_2] = co_await asio::async_read(sock, asio::mutable_buffer{res_frame, sizeof(proto_frame)}, asio::as_tuple(asio::use_awaitable));
+    trans_frame_to_host(res_frame);
+    if (ec_2 || n_2 != sizeof(proto_frame) || res_frame->magic != FRAME_MAGIC || res_frame->cmd != proto_cmd::xx_heart_establish || res_frame->stat != 0 ||
+        (res_frame->data_len != 0 && res_frame->data_len != sizeof(xx_heart_establish_caps)))
+    {
+      LOG_DEBUG(std::format("acceptor recv establish heart failed, {} {}", ec_2.message(), n_2));
+      sock.close();
+      co_return nullptr;
+    }
+
+    auto caps = xx_heart_establish_caps{};
+    if (res_frame->data_len != 0)
+    {
+      auto [ec_3, n_3] = co_await asio::async_read(sock, asio::mutable_buffer{res_frame->data, sizeof(xx_heart_establish_caps)}, asio::as_tuple(asio::use_awaitable));
+      if (ec_3 || n_3 != sizeof(xx_heart_establish_caps))
       {
-        LOG_DEBUG(std::format("acceptor send establish heart failed, {} {}", ec_1.message(), n_1));
+        LOG_DEBUG(std::format("acceptor recv establish capabilities failed, {} {}", ec_3.message(), n_3));
         sock.close();
-        continue;
+        co_return nullptr;
       }
 
-      auto response_recved = proto_frame{};
-      auto [ec_2, n_2] = co_await asio::async_read(sock, asio::mutable_buffer{&response_recved, sizeof(response_recved)}, asio::as_tuple(asio::use_awaitable));
-      trans_frame_to_host(&response_recved);
-      if (ec_2 || n_2 != sizeof(response_recved) || response_recved.magic != FRAME_MAGIC || response_recved.cmd != proto_cmd::xx_heart_establish || response_recved.stat != 0 || response_recved.data_len != 0)
+      auto peer_caps = *(xx_heart_establish_caps *)res_frame->data;
+      trans_caps_to_host(&peer_caps);
+      caps = negotiate_capabilities(local_capabilities(), peer_caps);
+
+      /* 发送协商后的能力 */
+      char caps_to_send[sizeof(proto_frame) + sizeof(xx_heart_establish_caps)];
+      auto caps_frame = (proto_frame *)caps_to_send;
+      *caps_frame = {
+          .cmd = proto_cmd::xx_heart_establish,
+          .type = frame_type::response,
+          .data_len = sizeof(xx_heart_establish_caps),
+      };
+      trans_frame_to_net(caps_frame);
+      *(xx_heart_establish_caps *)caps_frame->data = caps;
+      trans_caps_to_net((xx_heart_establish_caps *)caps_frame->data);
+      auto [ec_4, n_4] = co_await asio::async_write(sock, asio::const_buffer(caps_to_send, sizeof(caps_to_send)), asio::as_tuple(asio::use_awaitable));
+      if (ec_4 || n_4 != sizeof(caps_to_send))
       {
-        LOG_DEBUG(std::format("acceptor recv establish heart failed, {} {}", ec_2.message(), n_2));
+        LOG_DEBUG(std::format("acceptor send establish capabilities failed, {} {}", ec_4.message(), n_4));
         sock.close();
-        continue;
+        co_return nullptr;
       }
-
-      auto conn = std::make_shared<connection>(std::move(sock), m_heart_timeout, m_heart_interval);
-      LOG_INFO(std::format("accept new connection {}", conn->address()));
-      co_return conn;
     }
+
+    auto conn = std::make_shared<connection>(std::move(sock), m_heart_timeout, m_heart_interval, caps);
+    LOG_INFO("accept new connection {} with capabilities {:#x}", conn->address(), caps.flags);
+    co_return conn;
   }
 
-} // namespace common
\ No newline at end of file
+} // namespace common
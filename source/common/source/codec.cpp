@@ -0,0 +1,55 @@
+#include <array>
+#include <common/codec.h>
+#include <lz4.h>
+
+namespace common_detail
+{
+
+  auto lz4_compress_bound(uint32_t raw_len) -> uint32_t
+  {
+    return (uint32_t)LZ4_compressBound((int)raw_len);
+  }
+
+  auto lz4_compress(const char *src, uint32_t src_len, char *dst, uint32_t dst_cap) -> uint32_t
+  {
+    return (uint32_t)LZ4_compress_default(src, dst, (int)src_len, (int)dst_cap);
+  }
+
+  auto lz4_decompress(const char *src, uint32_t src_len, char *dst, uint32_t raw_len) -> bool
+  {
+    return LZ4_decompress_safe(src, dst, (int)src_len, (int)raw_len) == (int)raw_len;
+  }
+
+  constexpr auto frame_codecs = std::array{
+      common::frame_codec{
+          .name = "lz4",
+          .cap = common::CAP_COMPRESS_LZ4,
+          .compress_bound = lz4_compress_bound,
+          .compress = lz4_compress,
+          .decompress = lz4_decompress,
+      },
+  };
+
+} // namespace common_detail
+
+namespace common
+{
+
+  auto frame_codecs() -> std::span<const frame_codec>
+  {
+    return common_detail::frame_codecs;
+  }
+
+  auto select_frame_codec(const xx_heart_establish_caps &caps) -> const frame_codec *
+  {
+    for (const auto &codec : common_detail::frame_codecs)
+    {
+      if (caps.has(codec.cap))
+      {
+        return &codec;
+      }
+    }
+    return nullptr;
+  }
+
+} // namespace common
@@ -1,20 +1,81 @@
 #include <common/connection.h>
 #include <common/exception.h>
+#include <common/frame_pool.h>
+#include <common/metrics_net.h>
 #include <common/util.h>
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
 
 namespace common
 {
 
+  /* 0 表示不使用 MSG_ZEROCOPY */
+  auto zerocopy_send_min_len = uint32_t{0};
+
+  auto set_zerocopy_send_min_len(uint32_t min_len) -> void { zerocopy_send_min_len = min_len; }
+
   connection::connection(asio::ip::tcp::socket &&sock,
-                         uint32_t heart_timeout, uint32_t heart_interval)
+                         uint32_t heart_timeout, uint32_t heart_interval,
+                         xx_heart_establish_caps caps)
       : m_sock{std::move(sock)},
         m_port{m_sock.remote_endpoint().port()},
         m_ip{m_sock.remote_endpoint().address().to_string()},
         m_strand{asio::make_strand(m_sock.get_executor())},
         m_heat_timer{std::make_unique<asio::steady_timer>(m_strand)},
         m_heart_timeout{heart_timeout},
-        m_heart_interval{heart_interval}
+        m_heart_interval{heart_interval},
+        m_last_recv{std::chrono::steady_clock::now()},
+        m_last_send{m_last_recv},
+        m_idle_timer{std::make_unique<asio::steady_timer>(m_strand)},
+        m_caps{caps},
+        m_codec{select_frame_codec(caps)},
+        m_send_timer{std::make_unique<asio::steady_timer>(m_strand)},
+        m_zerocopy_timer{std::make_unique<asio::steady_timer>(m_strand)}
   {
+    /* sendfile 遇到 EAGAIN 时通过 async_wait 等待可写，而不是阻塞 io 线程 */
+    m_sock.non_blocking(true);
+
+    if (zerocopy_send_min_len != 0)
+    {
+      auto value = 1;
+      m_zerocopy = setsockopt(m_sock.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) == 0;
+      if (!m_zerocopy)
+      {
+        LOG_WARN("set SO_ZEROCOPY of {} failed, {}", address(), strerror(errno));
+      }
+    }
+  }
+
+  connection::~connection()
+  {
+    for (auto fd : m_splice_pipe)
+    {
+      if (fd != -1)
+      {
+        ::close(fd);
+      }
+    }
+  }
+
+  auto connection::set_splice_selector(std::map<proto_cmd, uint32_t> prefix_lens, splice_selector selector) -> void
+  {
+    for (const auto &[cmd, prefix_len] : prefix_lens)
+    {
+      if (prefix_len > splice_max_prefix_len)
+      {
+        LOG_ERROR("splice prefix of {} too long, {}", enum_name(cmd), prefix_len);
+        return;
+      }
+    }
+
+    asio::post(m_strand, [self = shared_from_this(), prefix_lens = std::move(prefix_lens), selector = std::move(selector)]() mutable
+               {
+                 self->m_splice_prefix_lens = std::move(prefix_lens);
+                 self->m_splice_selector = std::move(selector); });
   }
 
   auto connection::start(std::function<asio::awaitable<void>(std::shared_ptr<proto_frame>, std::shared_ptr<connection>)> on_recv_request) -> void
@@ -23,8 +84,17 @@ namespace common
     auto self = shared_from_this();
     asio::co_spawn(m_strand, [self]
                    { return self->start_recv(); }, exception_handle);
+    asio::co_spawn(m_strand, [self]
+                   { return self->start_send(); }, exception_handle);
     asio::co_spawn(m_strand, [self]
                    { return self->start_heart(); }, exception_handle);
+    asio::co_spawn(m_strand, [self]
+                   { return self->start_watchdog(); }, exception_handle);
+    if (m_zerocopy)
+    {
+      asio::co_spawn(m_strand, [self]
+                     { return self->start_zerocopy_reaper(); }, exception_handle);
+    }
   }
 
   auto connection::close() -> asio::awaitable<void>
@@ -34,11 +104,22 @@ namespace common
       co_return;
     }
     m_closed = true;
-    for (auto &_ : m_response_frames)
+    for (auto &slot : m_response_slots)
+    {
+      if (slot.waiter)
+      {
+        asio::post(m_strand, std::move(slot.waiter));
+      }
+    }
+    for (auto &waiter : m_slot_waiters)
     {
-      _.second.second->cancel();
+      asio::post(m_strand, std::move(waiter));
     }
+    m_slot_waiters.clear();
     m_heat_timer->cancel();
+    m_idle_timer->cancel();
+    m_send_timer->cancel();
+    m_zerocopy_timer->cancel();
     m_sock.close();
     co_await m_on_recv_request(nullptr, shared_from_this());
   }
@@ -46,18 +127,36 @@ namespace common
   auto connection::recv_response(uint16_t id) -> asio::awaitable<std::shared_ptr<proto_frame>>
   {
     co_await asio::post(m_strand, asio::use_awaitable);
-    auto &[frame, waiter] = m_response_frames[id];
-    if (frame == nullptr)
+    auto &slot = m_response_slots[id % response_slot_count];
+    if (!slot.busy || slot.id != id)
     {
-      co_await waiter->async_wait(asio::as_tuple(asio::use_awaitable));
-      if (m_closed)
-      {
-        co_return nullptr;
-      }
+      LOG_ERROR("recv response {} from {} failed, no such request", id, address());
+      co_return nullptr;
+    }
+
+    if (slot.frame == nullptr && !m_closed)
+    {
+      co_await asio::async_initiate<decltype(asio::use_awaitable), void()>(
+          [&slot](auto handler)
+          { slot.waiter = std::move(handler); },
+          asio::use_awaitable);
+    }
+
+    /* 连接关闭时 frame 为 nullptr */
+    auto frame = std::move(slot.frame);
+    release_response_slot(id);
+    co_return frame;
+  }
+
+  auto connection::abandon_response(uint16_t id) -> asio::awaitable<void>
+  {
+    co_await asio::post(m_strand, asio::use_awaitable);
+    auto &slot = m_response_slots[id % response_slot_count];
+    if (!slot.busy || slot.id != id || slot.waiter)
+    {
+      co_return;
     }
-    auto ret = frame;
-    m_response_frames.erase(id);
-    co_return ret;
+    release_response_slot(id);
   }
 
   auto connection::send_request(proto_frame_ptr frame, std::source_location loc) -> asio::awaitable<std::optional<uint16_t>>
@@ -68,15 +167,22 @@ namespace common
       co_return std::nullopt;
     }
 
+    /* !!响应槽在 write 之前占用，防止收到了 response 但还没有对应的槽 */
+    auto id = co_await alloc_response_slot();
+    if (!id)
+    {
+      co_return std::nullopt;
+    }
+
     frame->magic = FRAME_MAGIC;
-    frame->id = m_request_frame_id++;
+    frame->id = id.value();
     frame->type = frame_type::request;
-    m_response_frames[frame->id] = {nullptr, std::make_unique<asio::steady_timer>(m_strand, std::chrono::years{1})}; // !!waiter 初始化放在 write 之前，防止收到了 response 但还没有初始化 waiter
 
     if (co_await send_frame(frame, loc))
     {
       co_return frame->id;
     }
+    release_response_slot(frame->id);
     co_return std::nullopt;
   }
 
@@ -85,6 +191,20 @@ namespace common
     co_return co_await send_request(std::make_shared<proto_frame>(frame), loc);
   }
 
+  auto connection::send_request_without_response(proto_frame_ptr frame, std::source_location loc) -> asio::awaitable<bool>
+  {
+    co_await asio::post(m_strand, asio::use_awaitable);
+    if (m_closed)
+    {
+      co_return false;
+    }
+
+    frame->magic = FRAME_MAGIC;
+    frame->id = m_request_frame_id++;
+    frame->type = frame_type::request;
+    co_return co_await send_frame(frame, loc);
+  }
+
   auto connection::send_request_without_data(proto_frame frame, std::source_location loc) -> asio::awaitable<std::optional<uint16_t>>
   {
     co_await asio::post(m_strand, asio::use_awaitable);
@@ -93,25 +213,48 @@ namespace common
       co_return std::nullopt;
     }
 
+    auto id = co_await alloc_response_slot();
+    if (!id)
+    {
+      co_return std::nullopt;
+    }
+
     frame.magic = FRAME_MAGIC;
-    frame.id = m_request_frame_id++;
+    frame.id = id.value();
     frame.type = frame_type::request;
-    m_response_frames[frame.id] = {nullptr, std::make_unique<asio::steady_timer>(m_strand, std::chrono::days{365})};
-    trans_frame_to_net(&frame);
 
-    auto ec = asio::error_code{};
-    auto n = asio::write(m_sock, asio::const_buffer(&frame, sizeof(proto_frame)), ec);
-    trans_frame_to_host(&frame);
+    if (co_await send_frame(frame, -1, 0, loc))
+    {
+      co_return frame.id;
+    }
+    release_response_slot(frame.id);
+    co_return std::nullopt;
+  }
 
-    if (ec || n != sizeof(proto_frame))
+  auto connection::send_request_with_file(proto_frame frame, int file_fd, off_t offset, std::source_location loc) -> asio::awaitable<std::optional<uint16_t>>
+  {
+    co_await asio::post(m_strand, asio::use_awaitable);
+    if (m_closed)
+    {
+      co_return std::nullopt;
+    }
+
+    auto id = co_await alloc_response_slot();
+    if (!id)
     {
-      LOG_ERROR("[{}:{}] send {} to {} failed, {}", loc.file_name(), loc.line(), frame, address(), ec.message());
-      co_await close();
       co_return std::nullopt;
     }
 
-    LOG_DEBUG("[{}:{}] send {} to {}", loc.file_name(), loc.line(), frame, address());
-    co_return frame.id;
+    frame.magic = FRAME_MAGIC;
+    frame.id = id.value();
+    frame.type = frame_type::request;
+
+    if (co_await send_frame(frame, file_fd, offset, loc))
+    {
+      co_return frame.id;
+    }
+    release_response_slot(frame.id);
+    co_return std::nullopt;
   }
 
   auto connection::send_response(proto_frame_ptr frame, const proto_frame &req_frame, std::source_location loc) -> asio::awaitable<bool>
@@ -141,25 +284,34 @@ namespace common
 
   auto connection::send_response_without_data(proto_frame frame, const proto_frame &req_frame, std::source_location loc) -> asio::awaitable<bool>
   {
+    co_await asio::post(m_strand, asio::use_awaitable);
+    if (m_closed)
+    {
+      co_return false;
+    }
+
     frame.magic = FRAME_MAGIC;
     frame.id = req_frame.id;
     frame.type = frame_type::response;
     frame.cmd = req_frame.cmd;
-    trans_frame_to_net(&frame);
 
-    auto ec = asio::error_code{};
-    auto n = asio::write(m_sock, asio::const_buffer(&frame, sizeof(proto_frame)));
-    trans_frame_to_host(&frame);
+    co_return co_await send_frame(frame, -1, 0, loc);
+  }
 
-    if (ec || n != sizeof(proto_frame))
+  auto connection::send_response_with_file(proto_frame frame, const proto_frame &req_frame, int file_fd, off_t offset, std::source_location loc) -> asio::awaitable<bool>
+  {
+    co_await asio::post(m_strand, asio::use_awaitable);
+    if (m_closed)
     {
-      LOG_ERROR("[{}:{}] send {} to {} failed, {}", loc.file_name(), loc.line(), (frame), address(), ec.message());
-      co_await close();
       co_return false;
     }
 
-    LOG_DEBUG("[{}:{}] send {} to {}", loc.file_name(), loc.line(), (frame), address());
-    co_return true;
+    frame.magic = FRAME_MAGIC;
+    frame.id = req_frame.id;
+    frame.type = frame_type::response;
+    frame.cmd = req_frame.cmd;
+
+    co_return co_await send_frame(frame, file_fd, offset, loc);
   }
 
   auto connection::send_request_and_wait_response(proto_frame_ptr frame, std::source_location loc) -> asio::awaitable<std::shared_ptr<proto_frame>>
@@ -219,19 +371,50 @@ namespace common
       co_return nullptr;
     }
 
-    auto res_header = proto_frame{.cmd = proto_cmd::xx_heart_establish};
-    trans_frame_to_host(&res_header);
-    std::tie(ec, n) = co_await asio::async_write(sock, asio::const_buffer(&res_header, sizeof(res_header)), asio::as_tuple(asio::use_awaitable));
-    if (n != sizeof(proto_frame))
+    /* 服务端支持能力协商时，在响应中携带本端的能力 */
+    auto v2 = req_header->stat == HEART_ESTABLISH_V2;
+    char response_to_send[sizeof(proto_frame) + sizeof(xx_heart_establish_caps)];
+    auto res_header = (proto_frame *)response_to_send;
+    *res_header = {
+        .cmd = proto_cmd::xx_heart_establish,
+        .type = frame_type::response,
+        .data_len = v2 ? (uint32_t)sizeof(xx_heart_establish_caps) : 0,
+    };
+    auto res_len = sizeof(proto_frame) + res_header->data_len;
+    trans_frame_to_net(res_header);
+    *(xx_heart_establish_caps *)res_header->data = local_capabilities();
+    trans_caps_to_net((xx_heart_establish_caps *)res_header->data);
+    std::tie(ec, n) = co_await asio::async_write(sock, asio::const_buffer(response_to_send, res_len), asio::as_tuple(asio::use_awaitable));
+    if (n != res_len)
     {
       LOG_ERROR(std::format("send establish heart failed {}", ec.message()));
       sock.close();
       co_return nullptr;
     }
 
+    /* 接收协商后的能力 */
+    auto caps = xx_heart_establish_caps{};
+    if (v2)
+    {
+      char caps_recved[sizeof(proto_frame) + sizeof(xx_heart_establish_caps)];
+      std::tie(ec, n) = co_await asio::async_read(sock, asio::mutable_buffer(caps_recved, sizeof(caps_recved)), asio::as_tuple(asio::use_awaitable));
+      auto caps_header = (proto_frame *)caps_recved;
+      trans_frame_to_host(caps_header);
+      if (n != sizeof(caps_recved) || caps_header->magic != FRAME_MAGIC || caps_header->cmd != proto_cmd::xx_heart_establish ||
+          caps_header->data_len != sizeof(xx_heart_establish_caps))
+      {
+        LOG_ERROR("recv establish capabilities failed {}", ec.message());
+        sock.close();
+        co_return nullptr;
+      }
+      caps = *(xx_heart_establish_caps *)caps_header->data;
+      trans_caps_to_host(&caps);
+    }
+
     auto req_data = (xx_heart_establish_request *)req_header->data;
     auto conn = std::make_shared<connection>(std::move(sock),
-                                             ntohl(req_data->timeout), ntohl(req_data->interval));
+                                             ntohl(req_data->timeout), ntohl(req_data->interval), caps);
+    LOG_DEBUG("connect to {} with capabilities {:#x}", conn->address(), caps.flags);
     co_return conn;
   }
 
@@ -239,17 +422,27 @@ namespace common
   {
     auto frame = proto_frame{.cmd = proto_cmd::xx_heart_ping};
     trans_frame_to_net(&frame);
+    auto interval = std::chrono::milliseconds{m_heart_interval};
     while (!m_closed)
     {
-      m_heat_timer->expires_after(std::chrono::milliseconds{m_heart_interval});
+      m_heat_timer->expires_at(m_last_send + interval);
       co_await m_heat_timer->async_wait(asio::as_tuple(asio::use_awaitable));
-
-      auto [ec, n] = co_await asio::async_write(m_sock, asio::const_buffer(&frame, sizeof(frame)), asio::as_tuple(asio::use_awaitable));
-      if (ec || n != sizeof(frame))
+      if (m_closed)
       {
-        co_await close();
         co_return;
       }
+
+      /* 期间发送过数据，对端已经可以确认连接存活 */
+      auto now = std::chrono::steady_clock::now();
+      if (now - m_last_send < interval)
+      {
+        continue;
+      }
+
+      /* 心跳无需等待发送完成，发送失败时由发送协程关闭连接 */
+      m_send_queue.push_back({.header = frame});
+      m_send_timer->cancel();
+      m_last_send = now;
     }
   }
 
@@ -258,24 +451,20 @@ namespace common
     auto frame_header = proto_frame{};
     while (!m_closed)
     {
-      /* 超时异步读取 */
-      auto timer = asio::steady_timer{m_strand, std::chrono::milliseconds{m_heart_timeout}};
-      timer.async_wait([this](const asio::error_code &ec)
-                       {
-        if (!ec) {
-          m_sock.cancel();
-          LOG_CRITICAL(std::format("recv frame timeout"));
-        } });
-
+      /* 读取超时由 start_watchdog 负责 */
       auto [ec, n] = co_await asio::async_read(m_sock, asio::mutable_buffer(&frame_header, sizeof(proto_frame)), asio::as_tuple(asio::use_awaitable));
       if (n != sizeof(proto_frame))
       {
-        timer.cancel();
         co_await close();
         co_return;
       }
+      m_last_recv = std::chrono::steady_clock::now();
       trans_frame_to_host(&frame_header);
 
+      /* 去除 type 中的标志位 */
+      auto flags = std::to_underlying(frame_header.type) & ~FRAME_TYPE_MASK;
+      frame_header.type = static_cast<frame_type>(std::to_underlying(frame_header.type) & FRAME_TYPE_MASK);
+
       /* 校验 magic */
       if (frame_header.magic != FRAME_MAGIC || (frame_header.type != frame_type::request && frame_header.type != frame_type::response))
       {
@@ -292,22 +481,65 @@ namespace common
 
       /* 读取 payload */
       // LOG_DEBUG("recv frame header {}", (frame_header));
-      auto frame = std::shared_ptr<proto_frame>{(proto_frame *)malloc(sizeof(proto_frame) + frame_header.data_len), free};
+      if (auto max_frame_len = local_capabilities().max_frame_len; max_frame_len != 0 && frame_header.data_len > max_frame_len)
+      {
+        LOG_ERROR("recv frame from {} too large, data_len {}", address(), frame_header.data_len);
+        co_await close();
+        co_return;
+      }
+
+      /* 零拷贝接收时先只读取 payload 头，由 selector 决定其余部分是否直接写入文件 */
+      auto prefix = std::array<char, splice_max_prefix_len>{};
+      auto prefix_len = 0u;
+      if (auto it = m_splice_prefix_lens.find(frame_header.cmd);
+          it != m_splice_prefix_lens.end() && flags == 0 && frame_header.type == frame_type::request &&
+          frame_header.data_len >= it->second + splice_min_len)
+      {
+        prefix_len = it->second;
+        if (!co_await recv_payload(prefix.data(), prefix_len))
+        {
+          co_await close();
+          co_return;
+        }
+
+        if (auto target = m_splice_selector(frame_header, {prefix.data(), prefix_len}, shared_from_this()))
+        {
+          auto ok = co_await splice_payload(target.value(), frame_header.data_len - prefix_len);
+          asio::co_spawn(m_strand, target->on_done(ok), exception_handle);
+          if (!ok)
+          {
+            co_await close();
+            co_return;
+          }
+          continue;
+        }
+      }
+
+      auto frame = alloc_frame(frame_header.data_len);
       if (frame == nullptr)
       {
         LOG_ERROR(std::format("alloc memory failed, requested size is {}MB", frame_header.data_len / 1024 / 1024));
         co_return;
       }
 
-      std::tie(ec, n) = co_await asio::async_read(m_sock, asio::mutable_buffer(frame.get()->data, frame_header.data_len), asio::as_tuple(asio::use_awaitable));
-      if (n != frame_header.data_len)
+      std::copy_n(prefix.data(), prefix_len, frame->data);
+      if (!co_await recv_payload(frame->data + prefix_len, frame_header.data_len - prefix_len))
       {
-        LOG_ERROR(std::format("recv payload failed {}", ec.message()));
         co_await close();
         co_return;
       }
       *frame = frame_header;
 
+      if (flags & FRAME_FLAG_COMPRESSED)
+      {
+        frame = decompress_frame(frame);
+        if (frame == nullptr)
+        {
+          co_await close();
+          co_return;
+        }
+      }
+
       LOG_DEBUG("recv {} from {}", (*frame), address());
       if (frame->type == frame_type::request)
       {
@@ -315,33 +547,365 @@ namespace common
       }
       else if (frame->type == frame_type::response)
       {
-        auto &[res_frame, waiter] = m_response_frames[frame->id];
-        res_frame = frame;
-        if (waiter != nullptr)
+        auto &slot = m_response_slots[frame->id % response_slot_count];
+        if (!slot.busy || slot.id != frame->id || slot.frame != nullptr)
         {
-          waiter->cancel();
+          LOG_ERROR("recv unexpected response {} from {}", *frame, address());
+          continue;
         }
-        else
+
+        slot.frame = frame;
+        if (slot.waiter)
         {
-          LOG_CRITICAL("waiter is nullptr");
-          exit(-1);
+          asio::post(m_strand, std::move(slot.waiter));
         }
       }
     }
   }
 
-  auto connection::send_frame(proto_frame_ptr frame, std::source_location loc) -> asio::awaitable<bool>
+  auto connection::recv_payload(char *dst, size_t len) -> asio::awaitable<bool>
   {
-    auto message_len = sizeof(proto_frame) + frame->data_len;
-    trans_frame_to_net(frame.get());
-    auto ec = asio::error_code{};
-    auto n = asio::write(m_sock, asio::const_buffer(frame.get(), message_len), ec);
-    trans_frame_to_host(frame.get());
+    /* 分段读取，慢速链路上的大 frame 不会被误判为超时 */
+    auto recved = 0uz;
+    while (recved < len)
+    {
+      auto [ec, n] = co_await m_sock.async_read_some(asio::mutable_buffer(dst + recved, len - recved), asio::as_tuple(asio::use_awaitable));
+      if (ec)
+      {
+        LOG_ERROR(std::format("recv payload failed {}", ec.message()));
+        co_return false;
+      }
+      recved += n;
+      m_last_recv = std::chrono::steady_clock::now();
+    }
+    co_return true;
+  }
+
+  auto connection::splice_payload(const splice_target &target, uint64_t len) -> asio::awaitable<bool>
+  {
+    if (m_splice_pipe[0] == -1)
+    {
+      if (pipe2(m_splice_pipe.data(), O_CLOEXEC | O_NONBLOCK) != 0)
+      {
+        LOG_ERROR("create splice pipe failed, {}", strerror(errno));
+        co_return false;
+      }
+      fcntl(m_splice_pipe[1], F_SETPIPE_SZ, splice_pipe_size);
+    }
+
+    auto offset = target.offset;
+    auto left = len;
+    while (left > 0)
+    {
+      /* socket -> 管道，没有可读数据时等待可读，而不是阻塞 io 线程 */
+      auto n = splice(native_socket(), nullptr, m_splice_pipe[1], nullptr, std::min<uint64_t>(left, splice_pipe_size), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (n < 0 && (errno == EAGAIN || errno == EINTR))
+      {
+        auto [ec] = co_await m_sock.async_wait(asio::socket_base::wait_read, asio::as_tuple(asio::use_awaitable));
+        if (ec)
+        {
+          LOG_ERROR("wait for {} readable failed, {}", address(), ec.message());
+          co_return false;
+        }
+        continue;
+      }
+      if (n <= 0)
+      {
+        LOG_ERROR("splice from {} failed, {}", address(), n == 0 ? "peer closed" : strerror(errno));
+        co_return false;
+      }
+      left -= n;
+      m_last_recv = std::chrono::steady_clock::now();
+
+      /* 管道 -> 文件，每次都清空管道。写入期间协程挂起，不会再读取 socket 或使用管道 */
+      auto drain = [this, &target, &offset, n]() mutable
+      {
+        while (n > 0)
+        {
+          auto written = splice(m_splice_pipe[0], nullptr, target.fd, &offset, n, SPLICE_F_MOVE);
+          if (written < 0 && errno == EINTR)
+          {
+            continue;
+          }
+          if (written <= 0)
+          {
+            LOG_ERROR("splice to file failed, {}", strerror(errno));
+            return false;
+          }
+          n -= written;
+        }
+        return true;
+      };
+      if (!(target.write ? co_await target.write(drain) : drain()))
+      {
+        co_return false;
+      }
+    }
+
+    ++net_zero_copy_metrics.splice_recv_frames;
+    net_zero_copy_metrics.splice_recv_bytes += len;
+    co_return true;
+  }
 
-    if (ec || n != message_len)
+  auto connection::start_watchdog() -> asio::awaitable<void>
+  {
+    auto timeout = std::chrono::milliseconds{m_heart_timeout};
+    while (!m_closed)
     {
-      LOG_ERROR("[{}:{}] send {} to {} failed, {}", loc.file_name(), loc.line(), *frame, address(), ec.message());
+      m_idle_timer->expires_at(m_last_recv + timeout);
+      co_await m_idle_timer->async_wait(asio::as_tuple(asio::use_awaitable));
+      if (m_closed)
+      {
+        co_return;
+      }
+
+      /* 等待期间收到过数据，按新的截止时间重新等待 */
+      if (std::chrono::steady_clock::now() - m_last_recv < timeout)
+      {
+        continue;
+      }
+
+      /* 直接关闭连接，cancel 只中止正在进行的操作，没有挂起的读取时连接不会关闭 */
+      LOG_CRITICAL("recv frame from {} timeout", address());
       co_await close();
+      co_return;
+    }
+  }
+
+  auto connection::start_send() -> asio::awaitable<void>
+  {
+    auto buffers = std::vector<asio::const_buffer>{};
+    while (!m_closed)
+    {
+      if (m_send_queue.empty())
+      {
+        m_send_timer->expires_at(asio::steady_timer::time_point::max());
+        co_await m_send_timer->async_wait(asio::as_tuple(asio::use_awaitable));
+        continue;
+      }
+
+      /* 合并队列中的多个 frame，一次写入。需要 sendfile 的 frame 只能作为最后一个 */
+      buffers.clear();
+      auto count = 0uz;
+      auto bytes_to_send = 0uz;
+      auto zerocopy = false;
+      for (auto &entry : m_send_queue)
+      {
+        buffers.emplace_back(&entry.header, sizeof(proto_frame));
+        bytes_to_send += sizeof(proto_frame);
+        if (entry.payload && entry.payload->data_len > 0)
+        {
+          buffers.emplace_back(entry.payload->data, entry.payload->data_len);
+          bytes_to_send += entry.payload->data_len;
+          zerocopy = zerocopy || (m_zerocopy && entry.payload->data_len >= zerocopy_send_min_len);
+        }
+
+        if (++count == 64 || entry.file_fd != -1)
+        {
+          break;
+        }
+      }
+
+      /* deque 尾部插入不会使已有元素的引用失效 */
+      auto &last = m_send_queue[count - 1];
+
+      /* 帧头与 sendfile 的文件数据合并为完整的报文段发送，而不是单独发送一个小报文段 */
+      auto corked = last.file_fd != -1 && set_cork(true);
+
+      auto ec = asio::error_code{};
+      auto n = 0uz;
+      auto zerocopy_bytes = 0uz;
+      if (zerocopy)
+      {
+        std::tie(ec, n, zerocopy_bytes) = co_await send_zerocopy(buffers);
+      }
+      else
+      {
+        std::tie(ec, n) = co_await asio::async_write(m_sock, buffers, asio::as_tuple(asio::use_awaitable));
+        net_zero_copy_metrics.send_copy_bytes += n;
+      }
+      m_last_send = std::chrono::steady_clock::now();
+      auto ok = !ec && n == bytes_to_send;
+      if (!ok)
+      {
+        LOG_ERROR("send {} frames to {} failed, {}", count, address(), ec.message());
+      }
+
+      if (ok && last.file_fd != -1)
+      {
+        ok = co_await send_file(last.file_fd, last.file_offset, ntohl(last.header.data_len));
+      }
+      if (corked)
+      {
+        set_cork(false);
+      }
+
+      /* 内核发送完成前仍引用 payload，收到完成通知后才释放 payload 并唤醒发送方 */
+      if (ok && zerocopy_bytes > 0)
+      {
+        auto pending = zerocopy_pending{.seq = m_zerocopy_seq - 1, .bytes = zerocopy_bytes};
+        for (auto i = 0uz; i < count; ++i)
+        {
+          pending.entries.push_back(std::move(m_send_queue.front()));
+          m_send_queue.pop_front();
+        }
+        m_zerocopy_pending.push_back(std::move(pending));
+        m_zerocopy_timer->cancel();
+        continue;
+      }
+
+      for (auto i = 0uz; i < count; ++i)
+      {
+        complete_send_entry(m_send_queue.front(), ok);
+        m_send_queue.pop_front();
+      }
+
+      if (!ok)
+      {
+        co_await close();
+      }
+    }
+
+    /* 连接已关闭，唤醒所有等待的发送方 */
+    while (!m_send_queue.empty())
+    {
+      complete_send_entry(m_send_queue.front(), false);
+      m_send_queue.pop_front();
+    }
+  }
+
+  auto connection::send_zerocopy(std::vector<asio::const_buffer> buffers) -> asio::awaitable<std::tuple<asio::error_code, size_t, size_t>>
+  {
+    auto sent = 0uz;
+    auto zerocopy_sent = 0uz;
+    while (!buffers.empty())
+    {
+      auto [ec, n] = co_await m_sock.async_send(buffers, MSG_ZEROCOPY, asio::as_tuple(asio::use_awaitable));
+      if (ec == asio::error::no_buffer_space)
+      {
+        /* 等待完成通知的数据超出了 optmem 限制，剩余部分直接拷贝发送 */
+        auto [ec_, n_] = co_await asio::async_write(m_sock, buffers, asio::as_tuple(asio::use_awaitable));
+        net_zero_copy_metrics.send_copy_bytes += n_;
+        co_return std::tuple{ec_, sent + n_, zerocopy_sent};
+      }
+      if (ec)
+      {
+        co_return std::tuple{ec, sent, zerocopy_sent};
+      }
+
+      /* 每次成功的 sendmsg 对应一个通知序号 */
+      ++m_zerocopy_seq;
+      sent += n;
+      zerocopy_sent += n;
+
+      auto consumed = 0uz;
+      while (consumed < buffers.size() && n >= buffers[consumed].size())
+      {
+        n -= buffers[consumed++].size();
+      }
+      buffers.erase(buffers.begin(), buffers.begin() + consumed);
+      if (n > 0)
+      {
+        buffers.front() += n;
+      }
+    }
+    co_return std::tuple{asio::error_code{}, sent, zerocopy_sent};
+  }
+
+  auto connection::start_zerocopy_reaper() -> asio::awaitable<void>
+  {
+    while (!m_closed)
+    {
+      /* 没有等待完成的发送时，等待发送协程唤醒 */
+      if (m_zerocopy_pending.empty())
+      {
+        m_zerocopy_timer->expires_at(asio::steady_timer::time_point::max());
+        co_await m_zerocopy_timer->async_wait(asio::as_tuple(asio::use_awaitable));
+        continue;
+      }
+
+      /* 完成通知写入 socket 的错误队列，错误队列可读时 reactor 报告 wait_error 就绪 */
+      auto [ec] = co_await m_sock.async_wait(asio::socket_base::wait_error, asio::as_tuple(asio::use_awaitable));
+      if (ec)
+      {
+        if (!m_closed)
+        {
+          LOG_ERROR("wait for zerocopy completion of {} failed, {}", address(), ec.message());
+        }
+        break;
+      }
+      reap_zerocopy();
+    }
+
+    /* 连接已关闭，唤醒所有等待的发送方 */
+    for (auto &pending : m_zerocopy_pending)
+    {
+      for (auto &entry : pending.entries)
+      {
+        complete_send_entry(entry, false);
+      }
+    }
+    m_zerocopy_pending.clear();
+  }
+
+  auto connection::reap_zerocopy() -> void
+  {
+    while (!m_zerocopy_pending.empty())
+    {
+      char control[128];
+      auto msg = msghdr{.msg_control = control, .msg_controllen = sizeof(control)};
+      if (recvmsg(m_sock.native_handle(), &msg, MSG_ERRQUEUE) == -1)
+      {
+        if (errno != EAGAIN && errno != EINTR)
+        {
+          LOG_WARN("recv zerocopy notification from {} failed, {}", address(), strerror(errno));
+        }
+        return;
+      }
+
+      for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+      {
+        if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) && !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+        {
+          continue;
+        }
+
+        auto err = (sock_extended_err *)CMSG_DATA(cmsg);
+        if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        {
+          continue;
+        }
+
+        /* 通知为 [ee_info, ee_data] 的闭区间，序号按发送顺序完成，回绕后仍按差值比较 */
+        auto copied = (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+        while (!m_zerocopy_pending.empty() && (int32_t)(m_zerocopy_pending.front().seq - err->ee_data) <= 0)
+        {
+          auto &pending = m_zerocopy_pending.front();
+          (copied ? net_zero_copy_metrics.send_zerocopy_copied_bytes : net_zero_copy_metrics.send_zerocopy_bytes) += pending.bytes;
+          for (auto &entry : pending.entries)
+          {
+            complete_send_entry(entry, true);
+          }
+          m_zerocopy_pending.pop_front();
+        }
+      }
+    }
+  }
+
+  auto connection::send_frame(proto_frame_ptr frame, std::source_location loc) -> asio::awaitable<bool>
+  {
+    auto entry = send_entry{.header = *frame, .payload = frame};
+    if (auto compressed = compress_frame(*frame))
+    {
+      entry.header.type = static_cast<frame_type>(std::to_underlying(frame->type) | FRAME_FLAG_COMPRESSED);
+      entry.header.data_len = compressed->data_len;
+      entry.payload = compressed;
+    }
+    trans_frame_to_net(&entry.header);
+
+    if (!co_await push_send_entry(std::move(entry)))
+    {
+      LOG_ERROR("[{}:{}] send {} to {} failed", loc.file_name(), loc.line(), *frame, address());
       co_return false;
     }
 
@@ -349,4 +913,196 @@ namespace common
     co_return true;
   }
 
+  auto connection::send_frame(const proto_frame &header, int file_fd, off_t offset, std::source_location loc) -> asio::awaitable<bool>
+  {
+    auto entry = send_entry{.header = header, .file_fd = file_fd, .file_offset = offset};
+    trans_frame_to_net(&entry.header);
+
+    if (!co_await push_send_entry(std::move(entry)))
+    {
+      LOG_ERROR("[{}:{}] send {} to {} failed", loc.file_name(), loc.line(), header, address());
+      co_return false;
+    }
+
+    LOG_DEBUG("[{}:{}] send {} to {} suc", loc.file_name(), loc.line(), header, address());
+    co_return true;
+  }
+
+  auto connection::push_send_entry(send_entry entry) -> asio::awaitable<bool>
+  {
+    if (m_closed)
+    {
+      co_return false;
+    }
+
+    co_return co_await asio::async_initiate<decltype(asio::use_awaitable), void(bool)>(
+        [&](auto handler)
+        {
+          entry.waiter = std::move(handler);
+          m_send_queue.push_back(std::move(entry));
+          m_send_timer->cancel();
+        },
+        asio::use_awaitable);
+  }
+
+  auto connection::complete_send_entry(send_entry &entry, bool ok) -> void
+  {
+    /* 投递到 strand 上执行，发送方不会在写协程或回收协程中途恢复 */
+    if (entry.waiter)
+    {
+      asio::post(m_strand, [waiter = std::move(entry.waiter), ok]() mutable
+                 { std::move(waiter)(ok); });
+    }
+  }
+
+  auto connection::alloc_response_slot() -> asio::awaitable<std::optional<uint16_t>>
+  {
+    while (!m_closed)
+    {
+      /* id 单调递增，被占用的槽说明对应的请求还在等待响应，跳过即可 */
+      for (auto i = 0uz; i < response_slot_count; ++i)
+      {
+        auto id = m_request_frame_id++;
+        auto &slot = m_response_slots[id % response_slot_count];
+        if (!slot.busy)
+        {
+          slot = {.id = id, .busy = true};
+          co_return id;
+        }
+      }
+
+      LOG_WARN("all {} response slots of {} are busy", response_slot_count, address());
+      co_await asio::async_initiate<decltype(asio::use_awaitable), void()>(
+          [this](auto handler)
+          { m_slot_waiters.push_back(std::move(handler)); },
+          asio::use_awaitable);
+    }
+    co_return std::nullopt;
+  }
+
+  auto connection::release_response_slot(uint16_t id) -> void
+  {
+    m_response_slots[id % response_slot_count] = {};
+    if (!m_slot_waiters.empty())
+    {
+      asio::post(m_strand, std::move(m_slot_waiters.front()));
+      m_slot_waiters.pop_front();
+    }
+  }
+
+  auto connection::compress_frame(const proto_frame &frame) -> proto_frame_ptr
+  {
+    if (m_codec == nullptr || frame.data_len < compress_min_len)
+    {
+      return nullptr;
+    }
+
+    if (m_compress_skip > 0)
+    {
+      --m_compress_skip;
+      return nullptr;
+    }
+
+    /* 压缩后至少要减少 1/8 才值得发送，缓冲区按该上限分配，超出时压缩直接失败 */
+    auto dst_cap = frame.data_len / 8 * 7 - (uint32_t)sizeof(frame_compress_header);
+    auto compressed = alloc_frame(sizeof(frame_compress_header) + dst_cap);
+    if (compressed == nullptr)
+    {
+      return nullptr;
+    }
+
+    auto len = m_codec->compress(frame.data, frame.data_len, compressed->data + sizeof(frame_compress_header), dst_cap);
+    if (len == 0)
+    {
+      m_compress_skip = compress_skip_frames;
+      net_compress_metrics.send_skipped += frame.data_len;
+      return nullptr;
+    }
+
+    ((frame_compress_header *)compressed->data)->raw_len = htonl(frame.data_len);
+    compressed->data_len = (uint32_t)sizeof(frame_compress_header) + len;
+    net_compress_metrics.send_raw += frame.data_len;
+    net_compress_metrics.send_compressed += compressed->data_len;
+    return compressed;
+  }
+
+  auto connection::decompress_frame(const proto_frame_ptr &frame) -> proto_frame_ptr
+  {
+    if (m_codec == nullptr || frame->data_len < sizeof(frame_compress_header))
+    {
+      LOG_ERROR("recv invalid compressed frame {} from {}", *frame, address());
+      return nullptr;
+    }
+
+    auto raw_len = ntohl(((frame_compress_header *)frame->data)->raw_len);
+    if (auto max_frame_len = local_capabilities().max_frame_len; max_frame_len != 0 && raw_len > max_frame_len)
+    {
+      LOG_ERROR("recv compressed frame from {} too large, raw_len {}", address(), raw_len);
+      return nullptr;
+    }
+
+    auto raw = alloc_frame(raw_len);
+    if (raw == nullptr)
+    {
+      LOG_ERROR("alloc memory failed, requested size is {}MB", raw_len / 1024 / 1024);
+      return nullptr;
+    }
+
+    if (!m_codec->decompress(frame->data + sizeof(frame_compress_header), frame->data_len - sizeof(frame_compress_header), raw->data, raw_len))
+    {
+      LOG_ERROR("decompress frame {} from {} failed", *frame, address());
+      return nullptr;
+    }
+
+    net_compress_metrics.recv_raw += raw_len;
+    net_compress_metrics.recv_compressed += frame->data_len;
+    *raw = *frame;
+    raw->data_len = raw_len;
+    return raw;
+  }
+
+  auto connection::set_cork(bool cork) -> bool
+  {
+    auto value = cork ? 1 : 0;
+    if (setsockopt(m_sock.native_handle(), IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) != 0)
+    {
+      LOG_WARN("set TCP_CORK of {} failed, {}", address(), strerror(errno));
+      return false;
+    }
+    return true;
+  }
+
+  auto connection::send_file(int file_fd, off_t offset, uint64_t len) -> asio::awaitable<bool>
+  {
+    while (len > 0)
+    {
+      auto n = sendfile(m_sock.native_handle(), file_fd, &offset, len);
+      if (n == -1)
+      {
+        if (errno == EAGAIN || errno == EINTR)
+        {
+          auto [ec] = co_await m_sock.async_wait(asio::socket_base::wait_write, asio::as_tuple(asio::use_awaitable));
+          if (ec)
+          {
+            LOG_ERROR("wait {} writable failed, {}", address(), ec.message());
+            co_return false;
+          }
+          continue;
+        }
+
+        LOG_ERROR("sendfile to {} failed, {}", address(), strerror(errno));
+        co_return false;
+      }
+
+      if (n == 0)
+      {
+        LOG_ERROR("sendfile to {} failed, unexpected end of file, {} bytes left", address(), len);
+        co_return false;
+      }
+
+      len -= n;
+    }
+    co_return true;
+  }
+
 } // namespace common
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include <array>
+#include <common/crc32c.h>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace common_detail
+{
+
+  /* slicing-by-8 查表，table[k][i] 为字节 i 之后再经过 k 个 0 字节的 CRC */
+  constexpr auto crc32c_table = []
+  {
+    auto table = std::array<std::array<uint32_t, 256>, 8>{};
+    for (auto i = 0u; i < 256; ++i)
+    {
+      auto crc = i;
+      for (auto j = 0; j < 8; ++j)
+      {
+        crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78u : 0);
+      }
+      table[0][i] = crc;
+    }
+    for (auto i = 0u; i < 256; ++i)
+    {
+      for (auto k = 1uz; k < 8; ++k)
+      {
+        table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+      }
+    }
+    return table;
+  }();
+
+  auto crc32c_sw(uint32_t crc, const char *data, size_t len) -> uint32_t
+  {
+    auto p = (const uint8_t *)data;
+    crc = ~crc;
+    while (len >= 8)
+    {
+      auto word = uint64_t{};
+      std::memcpy(&word, p, sizeof(word));
+      word ^= crc;
+      crc = crc32c_table[7][word & 0xff] ^ crc32c_table[6][(word >> 8) & 0xff] ^
+            crc32c_table[5][(word >> 16) & 0xff] ^ crc32c_table[4][(word >> 24) & 0xff] ^
+            crc32c_table[3][(word >> 32) & 0xff] ^ crc32c_table[2][(word >> 40) & 0xff] ^
+            crc32c_table[1][(word >> 48) & 0xff] ^ crc32c_table[0][word >> 56];
+      p += 8;
+      len -= 8;
+    }
+    while (len-- > 0)
+    {
+      crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xff];
+    }
+    return ~crc;
+  }
+
+#if defined(__x86_64__)
+
+  __attribute__((target("sse4.2"))) auto crc32c_hw(uint32_t crc, const char *data, size_t len) -> uint32_t
+  {
+    auto p = (const uint8_t *)data;
+    auto crc64 = uint64_t{~crc};
+    while (len >= 32)
+    {
+      auto words = std::array<uint64_t, 4>{};
+      std::memcpy(words.data(), p, sizeof(words));
+      crc64 = _mm_crc32_u64(crc64, words[0]);
+      crc64 = _mm_crc32_u64(crc64, words[1]);
+      crc64 = _mm_crc32_u64(crc64, words[2]);
+      crc64 = _mm_crc32_u64(crc64, words[3]);
+      p += 32;
+      len -= 32;
+    }
+    while (len >= 8)
+    {
+      auto word = uint64_t{};
+      std::memcpy(&word, p, sizeof(word));
+      crc64 = _mm_crc32_u64(crc64, word);
+      p += 8;
+      len -= 8;
+    }
+    auto crc32 = (uint32_t)crc64;
+    while (len-- > 0)
+    {
+      crc32 = _mm_crc32_u8(crc32, *p++);
+    }
+    return ~crc32;
+  }
+
+  auto crc32c_hw_supported() -> bool
+  {
+    static auto supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+  }
+
+#else
+
+  auto crc32c_hw(uint32_t crc, const char *data, size_t len) -> uint32_t { return crc32c_sw(crc, data, len); }
+
+  auto crc32c_hw_supported() -> bool { return false; }
+
+#endif
+
+} // namespace common_detail
+
+namespace common
+{
+
+  using namespace common_detail;
+
+  auto crc32c(uint32_t crc, std::span<const char> data) -> uint32_t
+  {
+    static auto impl = crc32c_hw_supported() ? crc32c_hw : crc32c_sw;
+    return impl(crc, data.data(), data.size());
+  }
+
+} // namespace common
@@ -0,0 +1,154 @@
+#include <common/frame_pool.h>
+#include <mutex>
+#include <vector>
+
+namespace common_detail
+{
+
+  /* 线程本地缓存已析构，平凡析构的 thread_local 在线程退出的整个过程中都可以安全读取 */
+  thread_local constinit auto frame_pool_local_destroyed = false;
+
+  /**
+   * @brief 线程本地缓存，线程退出时释放
+   *
+   */
+  struct frame_pool_thread_cache
+  {
+    std::array<std::vector<void *>, frame_pool_classes.size()> buffers;
+
+    ~frame_pool_thread_cache()
+    {
+      frame_pool_local_destroyed = true;
+      for (auto i = 0uz; i < buffers.size(); ++i)
+      {
+        for (auto buffer : buffers[i])
+        {
+          frame_pool_metrics.pooled -= sizeof(common::proto_frame) + frame_pool_classes[i];
+          free(buffer);
+        }
+      }
+    }
+  };
+
+  thread_local auto frame_pool_local_cache = frame_pool_thread_cache{};
+
+  /* 全局缓存不会析构，保证静态析构阶段释放 frame 仍然安全 */
+  auto frame_pool_global_cache = new std::array<std::vector<void *>, frame_pool_classes.size()>{};
+
+  auto frame_pool_global_mut = std::mutex{};
+
+  auto frame_pool_deleter::operator()(common::proto_frame *frame) const -> void
+  {
+    frame_pool_put(class_idx, frame);
+  }
+
+  auto frame_pool_get(size_t class_idx) -> void *
+  {
+    if (!frame_pool_local_destroyed)
+    {
+      auto &local = frame_pool_local_cache.buffers[class_idx];
+      if (!local.empty())
+      {
+        auto buffer = local.back();
+        local.pop_back();
+        return buffer;
+      }
+    }
+
+    auto lock = std::unique_lock{frame_pool_global_mut};
+    auto &global = (*frame_pool_global_cache)[class_idx];
+    if (!global.empty())
+    {
+      auto buffer = global.back();
+      global.pop_back();
+      return buffer;
+    }
+    return nullptr;
+  }
+
+  auto frame_pool_put(size_t class_idx, void *buffer) -> void
+  {
+    /* 线程退出或静态析构阶段释放的 frame 直接归还全局缓存 */
+    if (!frame_pool_local_destroyed)
+    {
+      auto &local = frame_pool_local_cache.buffers[class_idx];
+      if (local.size() < frame_pool_thread_limit[class_idx])
+      {
+        local.push_back(buffer);
+        return;
+      }
+    }
+
+    {
+      auto lock = std::unique_lock{frame_pool_global_mut};
+      auto &global = (*frame_pool_global_cache)[class_idx];
+      if (global.size() < frame_pool_global_limit[class_idx])
+      {
+        global.push_back(buffer);
+        return;
+      }
+    }
+
+    frame_pool_metrics.pooled -= sizeof(common::proto_frame) + frame_pool_classes[class_idx];
+    free(buffer);
+  }
+
+} // namespace common_detail
+
+namespace common
+{
+
+  using namespace common_detail;
+
+  auto alloc_frame(uint32_t data_len) -> proto_frame_ptr
+  {
+    if (data_len <= frame_pool_small_limit || data_len > frame_pool_classes.back())
+    {
+      ++frame_pool_metrics.unpooled;
+      auto frame = (proto_frame *)malloc(sizeof(proto_frame) + data_len);
+      if (frame == nullptr)
+      {
+        return nullptr;
+      }
+      return proto_frame_ptr{frame, free};
+    }
+
+    auto class_idx = 0uz;
+    while (frame_pool_classes[class_idx] < data_len)
+    {
+      ++class_idx;
+    }
+
+    ++frame_pool_metrics.alloc;
+    auto buffer = frame_pool_get(class_idx);
+    if (buffer != nullptr)
+    {
+      ++frame_pool_metrics.hit;
+    }
+    else
+    {
+      buffer = malloc(sizeof(proto_frame) + frame_pool_classes[class_idx]);
+      if (buffer == nullptr)
+      {
+        return nullptr;
+      }
+
+      frame_pool_metrics.pooled += sizeof(proto_frame) + frame_pool_classes[class_idx];
+    }
+    return proto_frame_ptr{(proto_frame *)buffer, frame_pool_deleter{class_idx}};
+  }
+
+  auto get_frame_pool_metrics() -> nlohmann::json
+  {
+    auto alloc = frame_pool_metrics.alloc.load();
+    auto hit = frame_pool_metrics.hit.load();
+    return {
+        {"alloc", alloc},
+        {"hit", hit},
+        {"hit_rate", alloc == 0 ? 0. : (uint64_t)(10000.0 * hit / alloc) / 100.},
+        {"unpooled", frame_pool_metrics.unpooled.load()},
+        {"pooled_bytes", frame_pool_metrics.pooled.load()},
+    };
+  }
+
+} // namespace common
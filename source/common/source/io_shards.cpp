@@ -0,0 +1,52 @@
+#include <algorithm>
+#include <common/io_shards.h>
+#include <common/log.h>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+
+namespace common
+{
+
+  auto pin_thread_to_cpu(uint32_t cpu) -> bool
+  {
+    auto cpus = std::max(std::thread::hardware_concurrency(), 1u);
+    auto set = cpu_set_t{};
+    CPU_ZERO(&set);
+    CPU_SET(cpu % cpus, &set);
+    if (auto err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); err != 0)
+    {
+      LOG_WARN(std::format("pin thread to cpu {} failed, {}", cpu % cpus, strerror(err)));
+      return false;
+    }
+    return true;
+  }
+
+  io_shards::io_shards(uint32_t count)
+  {
+    for (auto i = 0u; i < std::max(count, 1u); ++i)
+    {
+      m_contexts.push_back(std::make_unique<asio::io_context>(1));
+      m_guards.push_back(asio::make_work_guard(*m_contexts.back()));
+    }
+  }
+
+  auto io_shards::run() -> int
+  {
+    for (auto i = 1u; i < m_contexts.size(); ++i)
+    {
+      std::thread{[this, i]
+                  {
+                    pin_thread_to_cpu(i);
+                    m_contexts[i]->run();
+                  }}
+          .detach();
+    }
+
+    pin_thread_to_cpu(0);
+    m_contexts[0]->run();
+    return 0;
+  }
+
+} // namespace common
@@ -4,6 +4,7 @@
 #include <common/metrics_net.h>
 #include <fstream>
 #include <sstream>
+#include <vector>
 
 namespace common_detail
 {
@@ -68,6 +69,12 @@ namespace common
 
   auto get_net_metrics() -> nlohmann::json
   {
+    auto accept_latency = std::vector<uint64_t>{};
+    for (const auto &count : net_accept_metrics.latency_ms)
+    {
+      accept_latency.push_back(count.load());
+    }
+
     return {
         {"total_send", met_metrics_bk.total_send},
         {"total_recv", met_metrics_bk.total_recv},
@@ -77,6 +84,29 @@ namespace common
         {"errout", met_metrics_bk.errout},
         {"dropin", met_metrics_bk.dropin},
         {"dropout", met_metrics_bk.dropout},
+        {"compress", {
+                         {"send_raw", net_compress_metrics.send_raw.load()},
+                         {"send_compressed", net_compress_metrics.send_compressed.load()},
+                         {"send_skipped", net_compress_metrics.send_skipped.load()},
+                         {"recv_raw", net_compress_metrics.recv_raw.load()},
+                         {"recv_compressed", net_compress_metrics.recv_compressed.load()},
+                     }},
+        {"zero_copy", {
+                          {"splice_recv_frames", net_zero_copy_metrics.splice_recv_frames.load()},
+                          {"splice_recv_bytes", net_zero_copy_metrics.splice_recv_bytes.load()},
+                          {"send_copy_bytes", net_zero_copy_metrics.send_copy_bytes.load()},
+                          {"send_zerocopy_bytes", net_zero_copy_metrics.send_zerocopy_bytes.load()},
+                          {"send_zerocopy_copied_bytes", net_zero_copy_metrics.send_zerocopy_copied_bytes.load()},
+                      }},
+        {"accept", {
+                       {"accepted", net_accept_metrics.accepted.load()},
+                       {"handshaking", net_accept_metrics.handshaking.load()},
+                       {"ready", net_accept_metrics.ready.load()},
+                       {"established", net_accept_metrics.established.load()},
+                       {"failed", net_accept_metrics.failed.load()},
+                       {"timeout", net_accept_metrics.timeout.load()},
+                       {"latency_ms", accept_latency},
+                   }},
     };
   }
 
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <common/frame_pool.h>
 #include <common/protocol.h>
 #include <netinet/in.h>
 
@@ -14,9 +16,48 @@ namespace common
 
   auto trans_frame_to_host(proto_frame *frame) -> void { trans_frame_to_net(frame); }
 
+  auto trans_caps_to_net(xx_heart_establish_caps *caps) -> void
+  {
+    caps->version = htonl(caps->version);
+    caps->flags = htonl(caps->flags);
+    caps->max_frame_len = htonl(caps->max_frame_len);
+    caps->chunk_size = htonl(caps->chunk_size);
+  }
+
+  auto trans_caps_to_host(xx_heart_establish_caps *caps) -> void { trans_caps_to_net(caps); }
+
+  /* 默认支持 LZ4 压缩、CRC32C 校验和流式上传，数据块 5MB。单个 frame 最大 1GB 是协议的固定上限，与协商结果无关 */
+  auto local_caps = xx_heart_establish_caps{
+      .version = HEART_ESTABLISH_V2,
+      .flags = CAP_COMPRESS_LZ4 | CAP_CHECKSUM_CRC32C | CAP_STREAM_UPLOAD,
+      .max_frame_len = 1024 * 1024 * 1024,
+      .chunk_size = 5 * 1024 * 1024,
+  };
+
+  auto local_capabilities() -> xx_heart_establish_caps { return local_caps; }
+
+  auto set_local_capabilities(xx_heart_establish_caps caps) -> void { local_caps = caps; }
+
+  auto negotiate_capabilities(const xx_heart_establish_caps &local, const xx_heart_establish_caps &peer) -> xx_heart_establish_caps
+  {
+    auto min_nonzero = [](uint32_t a, uint32_t b)
+    { return a == 0 ? b : (b == 0 ? a : std::min(a, b)); };
+
+    return {
+        .version = std::min(local.version, peer.version),
+        .flags = local.flags & peer.flags,
+        .max_frame_len = min_nonzero(local.max_frame_len, peer.max_frame_len),
+        .chunk_size = min_nonzero(local.chunk_size, peer.chunk_size),
+    };
+  }
+
   auto create_frame(proto_cmd cmd, frame_type type, uint32_t data_len, uint8_t stat) -> std::shared_ptr<proto_frame>
   {
-    auto frame = std::shared_ptr<proto_frame>{(proto_frame *)malloc(sizeof(proto_frame) + data_len), free};
+    auto frame = alloc_frame(data_len);
+    if (frame == nullptr)
+    {
+      return nullptr;
+    }
     *frame = {
         .cmd = cmd,
         .type = type,
@@ -13,6 +13,7 @@ namespace master
             .base_path = json["common"]["base_path"].get<std::string>(),
             .log_level = json["common"]["log_level"].get<uint8_t>(),
             .thread_count = json["common"]["thread_count"].get<uint8_t>(),
+            .shard_per_core = json["common"].value("shard_per_core", false),
         },
         .server{
             .ip = json["server"]["ip"].get<std::string>(),
@@ -14,6 +14,7 @@ namespace master
       std::string base_path;
       uint8_t log_level;
       uint8_t thread_count;
+      bool shard_per_core;
     } common;
 
     struct
@@ -46,6 +46,13 @@ auto main(int argc, char *argv[]) -> int
   common::init_log(master::master_config.common.base_path, false, static_cast<common::log_level>(master::master_config.common.log_level));
   common::write_pid_file("master", master::master_config.common.base_path, true);
 
+  if (master::master_config.common.shard_per_core)
+  {
+    auto shards = common::io_shards{master::master_config.common.thread_count};
+    asio::co_spawn(shards.context(0), master::master_server(&shards), common::exception_handle);
+    return shards.run();
+  }
+
   auto io = asio::io_context{};
   auto gurad = asio::make_work_guard(io);
 
@@ -1,6 +1,8 @@
 #include "server.h"
 #include "server_for_client.h"
 #include <common/acceptor.h>
+#include <common/exception.h>
+#include <common/frame_pool.h>
 #include <common/metrics.h>
 #include <common/metrics_request.h>
 
@@ -13,12 +15,33 @@ namespace master_detail
         {"port", master_config.server.port},
         {"magic", master_config.server.magic},
         {"thread_count", master_config.common.thread_count},
+        {"shard_per_core", master_config.common.shard_per_core},
         {"storage_group_size", master_config.server.group_size},
         {"storage_count", storage_conns_vec.size()},
         {"base_path", master_config.common.base_path},
     });
   }
 
+  auto accept_connections(bool reuse_port) -> asio::awaitable<void>
+  {
+    auto acceptor = common::acceptor{
+        co_await asio::this_coro::executor,
+        master_config.server.ip,
+        master_config.server.port,
+        master_config.server.heart_timeout,
+        master_config.server.heart_interval,
+        reuse_port,
+    };
+
+    while (true)
+    {
+      auto conn = co_await acceptor.accept();
+      regist_client(conn);
+      conn->start(request_from_connection);
+      common::push_one_connection();
+    }
+  }
+
 } // namespace master_detail
 
 namespace master
@@ -30,7 +53,7 @@ namespace master
     if (request == nullptr)
     {
       common::pop_one_connection();
-      switch (conn->get_data<conn_type_t>(conn_data::conn_type).value())
+      switch (conn->get_session<session_t>()->conn_type)
       {
         case conn_type_t::client:
         {
@@ -48,7 +71,7 @@ namespace master
 
     auto bt = common::push_one_request();
     auto info = common::request_end_info{};
-    switch (conn->get_data<conn_type_t>(conn_data::conn_type).value())
+    switch (conn->get_session<session_t>()->conn_type)
     {
       case conn_type_t::client:
       {
@@ -64,27 +87,18 @@ namespace master
     common::pop_one_request(bt, info);
   }
 
-  auto master_server() -> asio::awaitable<void>
+  auto master_server(common::io_shards *shards) -> asio::awaitable<void>
   {
     co_await common::start_metrics(std::format("{}/data/metrics.json", master_config.common.base_path));
     common::add_metrics_extension({"storage_metrics", storage_metrics});
     common::add_metrics_extension({"master_info", master_info_metrics});
+    common::add_metrics_extension({"frame_pool", common::get_frame_pool_metrics});
 
-    auto acceptor = common::acceptor{
-        co_await asio::this_coro::executor,
-        master_config.server.ip,
-        master_config.server.port,
-        master_config.server.heart_timeout,
-        master_config.server.heart_interval,
-    };
-
-    while (true)
+    for (auto i = 1u; shards && i < shards->size(); ++i)
     {
-      auto conn = co_await acceptor.accept();
-      regist_client(conn);
-      conn->start(request_from_connection);
-      common::push_one_connection();
+      asio::co_spawn(shards->context(i), accept_connections(true), common::exception_handle);
     }
+    co_await accept_connections(shards != nullptr);
   }
 
 } // namespace master
\ No newline at end of file
@@ -1,18 +1,31 @@
 #pragma once
 
 #include <common/connection.h>
+#include <common/io_shards.h>
 #include <common/metrics.h>
 #include <common/protocol.h>
 
 namespace master_detail
 {
   auto master_info_metrics() -> nlohmann::json;
+
+  /**
+   * @brief 在当前协程的执行器上监听端口并处理新连接
+   *
+   * @param reuse_port 每个分片各自监听时为 true
+   */
+  auto accept_connections(bool reuse_port) -> asio::awaitable<void>;
 }
 
 namespace master
 {
   auto request_from_connection(common::proto_frame_ptr request, common::connection_ptr conn) -> asio::awaitable<void>;
 
-  auto master_server() -> asio::awaitable<void>;
+  /**
+   * @brief master 服务
+   *
+   * @param shards 不为空时每个分片各自接受连接，服务本身运行在分片 0 上
+   */
+  auto master_server(common::io_shards *shards = nullptr) -> asio::awaitable<void>;
 
 } // namespace master
\ No newline at end of file
@@ -5,16 +5,8 @@
 namespace master_detail
 {
 
-  auto sm_regist_handle(common::proto_frame_ptr request, common::connection_ptr conn) -> asio::awaitable<bool>
+  auto sm_regist_handle(common::proto_frame_ptr request, common::connection_ptr conn, proto::sm_regist_request request_data) -> asio::awaitable<bool>
   {
-    auto request_data = proto::sm_regist_request{};
-    if (!request_data.ParseFromArray(request->data, request->data_len))
-    {
-      LOG_ERROR("failed to parse sm_regist_request");
-      co_await conn->send_response({.stat = 1}, *request);
-      co_return false;
-    }
-
     if (request_data.master_magic() != master_config.server.magic)
     {
       LOG_ERROR("invalid master magic {}", request_data.master_magic());
@@ -39,10 +31,11 @@ namespace master_detail
     for (auto storage : group_members_of_storage(request_data.s_info().id()))
     {
       auto s_info = response_data.add_s_infos();
-      s_info->set_id(storage->get_data<storage_id_t>(conn_data::storage_id).value());
-      s_info->set_magic(storage->get_data<storage_magic_t>(conn_data::storage_magic).value());
-      s_info->set_port(storage->get_data<storage_port_t>(conn_data::storage_port).value());
-      s_info->set_ip(storage->get_data<storage_ip_t>(conn_data::storage_ip).value());
+      auto storage_session = storage->get_session<storage_session_t>();
+      s_info->set_id(storage_session->id);
+      s_info->set_magic(storage_session->magic);
+      s_info->set_port(storage_session->port);
+      s_info->set_ip(storage_session->ip);
     }
     auto response = common::create_frame(request->cmd, common::frame_type::response, response_data.ByteSizeLong());
     response_data.SerializeToArray(response->data, response->data_len);
@@ -52,18 +45,19 @@ namespace master_detail
     }
 
     /* 保存 storage 信息 */
-    conn->set_data<storage_id_t>(conn_data::storage_id, request_data.s_info().id());
-    conn->set_data<storage_magic_t>(conn_data::storage_magic, request_data.s_info().magic());
-    conn->set_data<storage_port_t>(conn_data::storage_port, request_data.s_info().port());
-    conn->set_data<storage_ip_t>(conn_data::storage_ip, request_data.s_info().ip());
+    auto session = std::make_shared<storage_session_t>();
+    session->id = request_data.s_info().id();
+    session->magic = request_data.s_info().magic();
+    session->port = request_data.s_info().port();
+    session->ip = request_data.s_info().ip();
+    conn->set_session(session);
     regist_storage(conn);
 
     co_return true;
   }
 
-  auto cm_fetch_one_storage_handle(common::proto_frame_ptr request, common::connection_ptr conn) -> asio::awaitable<bool>
+  auto cm_fetch_one_storage_handle(common::proto_frame_ptr request, common::connection_ptr conn, uint64_t need_space) -> asio::awaitable<bool>
   {
-    auto need_space = common::ntohll(*(uint64_t *)request->data);
     LOG_DEBUG(std::format("client fetch on storge for space {}", need_space));
 
     /* 获取合适的 storage */
@@ -71,7 +65,7 @@ namespace master_detail
     for (auto i = 0uz; i < storage_conns.size(); ++i)
     {
       storage = next_storage_round_robin();
-      if (storage->get_data<uint64_t>(conn_data::storage_max_free_space) > need_space * 2)
+      if (storage->get_session<storage_session_t>()->max_free_space > need_space * 2)
       {
         break;
       }
@@ -86,10 +80,11 @@ namespace master_detail
     }
 
     auto response_data = proto::cm_fetch_one_storage_response{};
-    response_data.mutable_s_info()->set_id(storage->get_data<storage_id_t>(conn_data::storage_id).value());
-    response_data.mutable_s_info()->set_magic(storage->get_data<storage_magic_t>(conn_data::storage_magic).value());
-    response_data.mutable_s_info()->set_port(storage->get_data<storage_port_t>(conn_data::storage_port).value());
-    response_data.mutable_s_info()->set_ip(storage->get_data<storage_ip_t>(conn_data::storage_ip).value());
+    auto storage_session = storage->get_session<storage_session_t>();
+    response_data.mutable_s_info()->set_id(storage_session->id);
+    response_data.mutable_s_info()->set_magic(storage_session->magic);
+    response_data.mutable_s_info()->set_port(storage_session->port);
+    response_data.mutable_s_info()->set_ip(storage_session->ip);
 
     auto response = common::create_frame(request->cmd, common::frame_type::response, response_data.ByteSizeLong());
     response_data.SerializeToArray(response->data, response->data_len);
@@ -97,25 +92,18 @@ namespace master_detail
     co_return true;
   }
 
-  auto cm_fetch_group_storages_handle(common::proto_frame_ptr request, common::connection_ptr conn) -> asio::awaitable<bool>
+  auto cm_fetch_group_storages_handle(common::proto_frame_ptr request, common::connection_ptr conn, uint32_t group_id) -> asio::awaitable<bool>
   {
-    if (request->data_len != sizeof(uint32_t))
-    {
-      LOG_ERROR("cm_fetch_group_storages request data_len invalid");
-      co_await conn->send_response(common::proto_frame{.stat = 1}, *request);
-      co_return false;
-    }
-
-    auto group_id = ntohl(*(uint32_t *)request->data);
     auto storages = storages_of_group(group_id);
     auto response_data = proto::cm_fetch_group_storages_response{};
     for (auto storage : storages)
     {
       auto s_info = response_data.add_s_infos();
-      s_info->set_id(storage->get_data<storage_id_t>(conn_data::storage_id).value());
-      s_info->set_magic(storage->get_data<storage_magic_t>(conn_data::storage_magic).value());
-      s_info->set_port(storage->get_data<storage_port_t>(conn_data::storage_port).value());
-      s_info->set_ip(storage->get_data<storage_ip_t>(conn_data::storage_ip).value());
+      auto storage_session = storage->get_session<storage_session_t>();
+      s_info->set_id(storage_session->id);
+      s_info->set_magic(storage_session->magic);
+      s_info->set_port(storage_session->port);
+      s_info->set_ip(storage_session->ip);
     }
 
     auto response = common::create_frame(request->cmd, common::frame_type::response, response_data.ByteSizeLong());
@@ -133,7 +121,7 @@ namespace master
 
   auto regist_client(std::shared_ptr<common::connection> conn) -> void
   {
-    conn->set_data<conn_type_t>(conn_data::conn_type, conn_type_t::client);
+    conn->set_session(std::make_shared<client_session_t>());
     auto lock = std::unique_lock{client_conns_lock};
     client_conns.emplace(conn);
   }
@@ -146,9 +134,9 @@ namespace master
 
   auto request_from_client(std::shared_ptr<common::proto_frame> request, std::shared_ptr<common::connection> conn) -> asio::awaitable<bool>
   {
-    if (auto it = client_request_handles.find(request->cmd); it != client_request_handles.end())
+    if (auto handle = common::find_handle(client_request_handles, request->cmd))
     {
-      co_return co_await it->second(request, conn);
+      co_return co_await handle(request, conn);
     }
     LOG_ERROR("invalid request {} from client {}", *request, conn->address());
     co_return false;
@@ -1,8 +1,15 @@
 #pragma once
 
 #include "server_for_storage.h" // IWYU pragma: keep
+#include <common/dispatch.h>
+#include <proto.pb.h>
 #include <set>
 
+template <>
+struct common::request_payload<common::proto_cmd::sm_regist> : common::proto_payload<proto::sm_regist_request>
+{
+};
+
 namespace master_detail
 {
 
@@ -12,17 +19,17 @@ namespace master_detail
 
   inline auto client_conns_lock = std::mutex{};
 
-  auto sm_regist_handle(common::proto_frame_ptr request, common::connection_ptr conn) -> asio::awaitable<bool>;
+  auto sm_regist_handle(common::proto_frame_ptr request, common::connection_ptr conn, proto::sm_regist_request request_data) -> asio::awaitable<bool>;
 
-  auto cm_fetch_one_storage_handle(common::proto_frame_ptr request, common::connection_ptr conn) -> asio::awaitable<bool>;
+  auto cm_fetch_one_storage_handle(common::proto_frame_ptr request, common::connection_ptr conn, uint64_t need_space) -> asio::awaitable<bool>;
 
-  auto cm_fetch_group_storages_handle(common::proto_frame_ptr request, common::connection_ptr conn) -> asio::awaitable<bool>;
+  auto cm_fetch_group_storages_handle(common::proto_frame_ptr request, common::connection_ptr conn, uint32_t group_id) -> asio::awaitable<bool>;
 
-  inline auto client_request_handles = std::map<common::proto_cmd, request_handle_t>{
-      {common::proto_cmd::sm_regist, sm_regist_handle},
-      {common::proto_cmd::cm_fetch_one_storage, cm_fetch_one_storage_handle},
-      {common::proto_cmd::cm_fetch_group_storages, cm_fetch_group_storages_handle},
-  };
+  inline constexpr auto client_request_handles = common::make_dispatch_table({
+      {common::proto_cmd::sm_regist, common::typed_handle<common::proto_cmd::sm_regist, sm_regist_handle>},
+      {common::proto_cmd::cm_fetch_one_storage, common::typed_handle<common::proto_cmd::cm_fetch_one_storage, cm_fetch_one_storage_handle>},
+      {common::proto_cmd::cm_fetch_group_storages, common::typed_handle<common::proto_cmd::cm_fetch_group_storages, cm_fetch_group_storages_handle>},
+  });
 } // namespace master_detail
 
 namespace master
@@ -22,7 +22,7 @@ namespace master_detail
       }
 
       auto free_space = common::htonll(*(uint64_t *)response->data);
-      conn->set_data<storage_max_free_space_t>(conn_data::storage_max_free_space, free_space);
+      conn->get_session<storage_session_t>()->max_free_space = free_space;
       LOG_DEBUG(std::format("get storage free space {}", free_space));
 
       timer.expires_after(std::chrono::seconds{1000});
@@ -80,7 +80,7 @@ namespace master
       auto lock = std::unique_lock{storage_metricses_lock};
       for (const auto &[conn, metrics] : storage_metricses)
       {
-        auto storage_id = conn->get_data<storage_id_t>(conn_data::storage_id).value();
+        auto storage_id = conn->get_session<storage_session_t>()->id;
         auto group_id = group_storage_belongs_to(storage_id);
         ret[std::to_string(group_id)].push_back(metrics);
       }
@@ -97,9 +97,8 @@ namespace master
 
   auto regist_storage(std::shared_ptr<common::connection> conn) -> void
   {
-    conn->set_data<conn_type_t>(conn_data::conn_type, conn_type_t::storage);
     auto lock = std::unique_lock{storage_conns_lock};
-    storage_conns[conn->get_data<storage_id_t>(conn_data::storage_id).value()] = conn;
+    storage_conns[conn->get_session<storage_session_t>()->id] = conn;
     storage_conns_vec.emplace_back(conn);
 
     conn->add_work(request_storage_max_free_space);
@@ -109,7 +108,7 @@ namespace master
   auto unregist_storage(std::shared_ptr<common::connection> conn) -> void
   {
     auto lock = std::unique_lock{storage_conns_lock};
-    storage_conns.erase(conn->get_data<storage_id_t>(conn_data::storage_id).value());
+    storage_conns.erase(conn->get_session<storage_session_t>()->id);
     storage_conns_vec = {};
     for (const auto &[_, conn] : storage_conns)
     {
@@ -51,7 +51,7 @@ namespace master
   auto on_storage_disconnect(common::connection_ptr conn) -> asio::awaitable<void>;
 
   /**
-   * @brief 注册 storage
+   * @brief 注册 storage，conn 的会话必须已经设置为 storage_session_t
    *
    */
   auto regist_storage(std::shared_ptr<common::connection> conn) -> void;
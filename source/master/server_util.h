@@ -2,20 +2,12 @@
 
 #include <common/connection.h>
 #include <common/protocol.h>
+#include <atomic>
+#include <string>
 
 namespace master
 {
 
-  enum conn_data : uint64_t
-  {
-    conn_type,
-    storage_id,
-    storage_ip,
-    storage_port,
-    storage_magic,
-    storage_max_free_space,
-  };
-
   enum class conn_type_t
   {
     client,
@@ -23,11 +15,41 @@ namespace master
   };
 
   using storage_id_t = uint32_t;
-  using storage_ip_t = std::string;
-  using storage_port_t = uint16_t;
-  using storage_magic_t = uint32_t;
-  using storage_max_free_space_t = uint64_t;
 
-  using request_handle_t = std::function<asio::awaitable<bool>(common::proto_frame_ptr, common::connection_ptr)>;
+  /**
+   * @brief master 上所有连接的会话基类
+   *
+   */
+  struct session_t : common::session
+  {
+    explicit session_t(conn_type_t type) : conn_type{type} {}
+
+    const conn_type_t conn_type;
+  };
+
+  /**
+   * @brief client 连接的会话
+   *
+   */
+  struct client_session_t : session_t
+  {
+    client_session_t() : session_t{conn_type_t::client} {}
+  };
+
+  /**
+   * @brief storage 连接的会话，注册后其它连接也会读取，因此除 max_free_space 外注册后不再修改
+   *
+   * @param max_free_space  storage 的最大可用空间，定期更新
+   */
+  struct storage_session_t : session_t
+  {
+    storage_session_t() : session_t{conn_type_t::storage} {}
+
+    storage_id_t id = 0;
+    std::string ip;
+    uint16_t port = 0;
+    uint32_t magic = 0;
+    std::atomic_uint64_t max_free_space = 0;
+  };
 
 } // namespace master
\ No newline at end of file
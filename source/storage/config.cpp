@@ -14,6 +14,7 @@ namespace storage
             .base_path = json["common"]["base_path"].get<std::string>(),
             .log_level = json["common"]["log_level"].get<uint32_t>(),
             .thread_count = json["common"]["thread_count"].get<uint32_t>(),
+            .shard_per_core = json["common"].value("shard_per_core", false),
         },
 
         .server = {
@@ -42,10 +43,23 @@ namespace storage
             .to_hot_rule = json["migrate"]["to_hot_rule"].get<uint32_t>(),
             .to_hot_times = json["migrate"]["to_hot_times"].get<uint32_t>(),
             .to_hot_action = json["migrate"]["to_hot_action"].get<uint32_t>(),
+            .snapshot_interval = json["migrate"].value("snapshot_interval", 60u),
         },
 
         .performance = {
             .zero_copy_limit = json["performance"]["zero_copy_limit"].get<uint32_t>(),
+            .compress = json["performance"].value("compress", true),
+            .splice_recv = json["performance"].value("splice_recv", true),
+            .zerocopy_send_min_kb = json["performance"].value("zerocopy_send_min_kb", 0u),
+            .direct_io_min_mb = json["performance"].value("direct_io_min_mb", 0u),
+            .fdatasync_every_mb = json["performance"].value("fdatasync_every_mb", 0u),
+            .durability = json["performance"].value("durability", 0u),
+            .durability_group_window_us = json["performance"].value("durability_group_window_us", 1000u),
+            .small_file_max_kb = json["performance"].value("small_file_max_kb", 0u),
+            .volume_size_mb = json["performance"].value("volume_size_mb", 1024u),
+            .volume_compact_percent = json["performance"].value("volume_compact_percent", 50u),
+            .io_threads_per_store = json["performance"].value("io_threads_per_store", 2u),
+            .download_cache_files = json["performance"].value("download_cache_files", 1024u),
         },
     };
   }
@@ -14,6 +14,7 @@ namespace storage
       std::string base_path;
       uint32_t log_level;
       uint32_t thread_count;
+      bool shard_per_core;
     } common;
 
     struct
@@ -47,11 +48,24 @@ namespace storage
       uint32_t to_hot_rule;
       uint32_t to_hot_times;
       uint32_t to_hot_action;
+      uint32_t snapshot_interval;
     } migrate;
 
     struct
     {
       uint32_t zero_copy_limit;
+      bool compress;
+      bool splice_recv;
+      uint32_t zerocopy_send_min_kb;
+      uint32_t direct_io_min_mb;
+      uint32_t fdatasync_every_mb;
+      uint32_t durability;
+      uint32_t durability_group_window_us;
+      uint32_t small_file_max_kb;
+      uint32_t volume_size_mb;
+      uint32_t volume_compact_percent;
+      uint32_t io_threads_per_store;
+      uint32_t download_cache_files;
     } performance;
 
   } storage_config;
@@ -0,0 +1,194 @@
+#include "download_cache.h"
+#include "config.h"
+#include "store_util.h"
+#include <chrono>
+
+namespace storage
+{
+
+  using namespace storage_detail;
+
+  download_file_t::~download_file_t()
+  {
+    {
+      auto lock = std::unique_lock{download_cache_mut};
+      if (auto it = download_files.find(rel_path); it != download_files.end() && it->second.expired())
+      {
+        download_files.erase(it);
+      }
+    }
+    store_group->close_read_file(file_id);
+  }
+
+} // namespace storage
+
+namespace storage_detail
+{
+
+  auto find_download_file(std::string_view rel_path) -> asio::awaitable<std::shared_ptr<download_file_t>>
+  {
+    auto file = std::shared_ptr<download_file_t>{};
+    auto find_file = [&](auto open) -> asio::awaitable<void>
+    {
+      for (auto store_group : store_groups())
+      {
+        if (auto res = co_await open(*store_group); res.has_value())
+        {
+          auto [file_id, file_size, abs_path] = res.value();
+          file = std::make_shared<download_file_t>();
+          file->store_group = store_group;
+          file->store = store_group->store_of(file_id);
+          file->file_id = file_id;
+          file->file_size = file_size;
+          file->rel_path = rel_path;
+          file->abs_path = abs_path;
+          file->entry = file->store->find_index(rel_path);
+          file->crc = store_group->read_crc32c(file_id);
+          co_return;
+        }
+      }
+    };
+    co_await find_file([&](store_ctx_group &group)
+                       { return group.async_open_read_file(rel_path); });
+    if (!file)
+    {
+      co_await find_file([&](store_ctx_group &group)
+                         { return group.async_probe_read_file(rel_path); });
+    }
+    co_return file;
+  }
+
+  auto download_file_valid(const download_file_t &file) -> bool
+  {
+    /* probe 打开的文件不在索引中，直到索引中出现该文件前都有效 */
+    auto entry = file.store->find_index(file.rel_path);
+    if (!file.entry)
+    {
+      return !entry;
+    }
+    return entry && file.entry && entry->size == file.entry->size && entry->mtime == file.entry->mtime &&
+           entry->volume == file.entry->volume && entry->offset == file.entry->offset;
+  }
+
+} // namespace storage_detail
+
+namespace storage
+{
+
+  auto open_download_file(std::string_view rel_path) -> asio::awaitable<std::shared_ptr<download_file_t>>
+  {
+    auto key = std::string{rel_path};
+    auto file = std::shared_ptr<download_file_t>{};
+    auto stale = std::shared_ptr<download_file_t>{};
+    auto lead = false;
+    {
+      /* download_file_t 析构时会获取锁，因此 file 和 stale 在解锁之后才析构 */
+      auto lock = std::unique_lock{download_cache_mut};
+      if (auto it = download_files.find(key); it != download_files.end())
+      {
+        file = it->second.lock();
+        if (file && !download_file_valid(*file))
+        {
+          ++download_cache_metrics.stale;
+          std::erase(download_recent_files, file);
+          download_files.erase(it);
+          stale = std::move(file);
+        }
+      }
+      if (!file && !download_flights.contains(key))
+      {
+        download_flights[key];
+        lead = true;
+      }
+    }
+
+    if (file)
+    {
+      ++download_cache_metrics.hit;
+      co_return file;
+    }
+
+    /* 其它请求正在查找，等待其结果 */
+    if (!lead)
+    {
+      ++download_cache_metrics.coalesced;
+      auto executor = co_await asio::this_coro::executor;
+      co_return co_await asio::async_initiate<decltype(asio::use_awaitable), void(std::shared_ptr<download_file_t>)>(
+          [&](auto handler)
+          {
+            auto result = std::shared_ptr<download_file_t>{};
+            {
+              auto lock = std::unique_lock{download_cache_mut};
+              if (auto it = download_flights.find(key); it != download_flights.end())
+              {
+                it->second.push_back({.executor = executor, .handler = std::move(handler)});
+                return;
+              }
+
+              /* 查找刚刚完成 */
+              if (auto it = download_files.find(key); it != download_files.end())
+              {
+                result = it->second.lock();
+              }
+            }
+            asio::post(executor, [handler = std::move(handler), result]() mutable
+                       { std::move(handler)(result); });
+          },
+          asio::use_awaitable);
+    }
+
+    ++download_cache_metrics.miss;
+    file = co_await find_download_file(rel_path);
+
+    auto waiters = std::vector<download_waiter>{};
+    auto evicted = std::vector<std::shared_ptr<download_file_t>>{};
+    {
+      auto lock = std::unique_lock{download_cache_mut};
+      if (file)
+      {
+        download_files[key] = file;
+      }
+
+      /* 不在索引中的文件无法判断是否被删除，不保持打开，只在下载进行中共享 */
+      if (file && file->entry)
+      {
+        download_recent_files.push_back(file);
+      }
+      while (download_recent_files.size() > storage_config.performance.download_cache_files)
+      {
+        evicted.push_back(std::move(download_recent_files.front()));
+        download_recent_files.pop_front();
+      }
+      waiters = std::move(download_flights[key]);
+      download_flights.erase(key);
+    }
+
+    for (auto &waiter : waiters)
+    {
+      asio::post(waiter.executor, [handler = std::move(waiter.handler), file]() mutable
+                 { std::move(handler)(file); });
+    }
+    co_return file;
+  }
+
+  auto touch_download_file(download_file_t &file) -> bool
+  {
+    auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    auto last = file.last_access.load();
+    return now != last && file.last_access.compare_exchange_strong(last, now);
+  }
+
+  auto get_download_cache_metrics() -> nlohmann::json
+  {
+    auto lock = std::unique_lock{download_cache_mut};
+    return {
+        {"hit", download_cache_metrics.hit.load()},
+        {"miss", download_cache_metrics.miss.load()},
+        {"coalesced", download_cache_metrics.coalesced.load()},
+        {"stale", download_cache_metrics.stale.load()},
+        {"files", download_files.size()},
+        {"recent_files", download_recent_files.size()},
+    };
+  }
+
+} // namespace storage
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "store.h"
+#include <asio.hpp>
+#include <atomic>
+#include <common/json.h>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace storage
+{
+
+  /**
+   * @brief 下载共享的打开文件，同一文件的下载请求共享 fd、预读状态和元数据
+   *
+   * @param store_group   文件所在的 store_group
+   * @param store         文件所在的 store
+   * @param file_id       持有 fd 的文件，只用于 share_read_file，不直接读取
+   * @param file_size     文件大小
+   * @param rel_path      相对路径
+   * @param abs_path      文件路径
+   * @param entry         打开时的索引项，索引项变化（删除、覆盖、卷压缩）时缓存失效，probe 打开的文件为空
+   * @param crc           索引中记录的 CRC32C
+   * @param last_access   上次记录访问时间的时间，单位秒
+   */
+  struct download_file_t
+  {
+    std::shared_ptr<store_ctx_group> store_group;
+    std::shared_ptr<store_ctx> store;
+    uint64_t file_id;
+    uint64_t file_size;
+    std::string rel_path;
+    std::string abs_path;
+    std::optional<store_index_entry> entry;
+    std::optional<uint32_t> crc;
+    std::atomic_int64_t last_access = 0;
+
+    ~download_file_t();
+  };
+
+} // namespace storage
+
+namespace storage_detail
+{
+
+  using namespace storage;
+
+  /**
+   * @brief 等待同一文件查找结果的下载请求
+   *
+   * @param executor  发起请求的协程的执行器，完成时在其上恢复协程
+   * @param handler   完成时调用，参数为打开的文件，不存在时为空
+   */
+  struct download_waiter
+  {
+    asio::any_io_executor executor;
+    asio::any_completion_handler<void(std::shared_ptr<download_file_t>)> handler;
+  };
+
+  /**
+   * @brief 下载缓存相关的指标
+   *
+   * @param hit         命中缓存的次数
+   * @param miss        查找 store 的次数
+   * @param coalesced   等待其它请求的查找结果的次数
+   * @param stale       缓存的文件已被删除或移动的次数
+   */
+  inline struct download_cache_metrics_t
+  {
+    std::atomic_uint64_t hit;
+    std::atomic_uint64_t miss;
+    std::atomic_uint64_t coalesced;
+    std::atomic_uint64_t stale;
+  } download_cache_metrics;
+
+  /* 打开的文件，下载结束且不在 download_recent_files 中时释放 */
+  inline auto download_files = std::unordered_map<std::string, std::weak_ptr<download_file_t>>{};
+
+  /* 最近打开的索引中的文件，最多 download_cache_files 个，下载结束后仍保持打开 */
+  inline auto download_recent_files = std::deque<std::shared_ptr<download_file_t>>{};
+
+  /* 正在查找的文件，查找完成后唤醒等待者 */
+  inline auto download_flights = std::unordered_map<std::string, std::vector<download_waiter>>{};
+
+  inline auto download_cache_mut = std::mutex{};
+
+  /**
+   * @brief 依次在各个 store_group 中查找并打开文件，先查找索引，索引中没有时再逐个 store 打开
+   *
+   */
+  auto find_download_file(std::string_view rel_path) -> asio::awaitable<std::shared_ptr<download_file_t>>;
+
+  /**
+   * @brief 缓存的文件是否仍然有效
+   *
+   */
+  auto download_file_valid(const download_file_t &file) -> bool;
+
+} // namespace storage_detail
+
+namespace storage
+{
+
+  /**
+   * @brief 打开下载的文件。同一文件的并发请求只查找一次，之后的请求复用缓存的 fd 和元数据
+   *
+   * @return 文件不存在时返回 nullptr
+   */
+  auto open_download_file(std::string_view rel_path) -> asio::awaitable<std::shared_ptr<download_file_t>>;
+
+  /**
+   * @brief 是否需要记录访问时间，每秒只记录一次，避免热点文件反复竞争全局的锁
+   *
+   */
+  auto touch_download_file(download_file_t &file) -> bool;
+
+  /**
+   * @brief 获取下载缓存的指标
+   *
+   */
+  auto get_download_cache_metrics() -> nlohmann::json;
+
+} // namespace storage
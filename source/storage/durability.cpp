@@ -0,0 +1,197 @@
+#include "durability.h"
+#include "config.h"
+#include "store_util.h"
+#include <bit>
+#include <common/log.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <map>
+#include <thread>
+#include <unistd.h>
+
+namespace storage_detail
+{
+
+  using namespace storage;
+
+  auto sync_durable_batch(const std::vector<std::string> &abs_paths) -> std::vector<bool>
+  {
+    auto results = std::vector<bool>(abs_paths.size(), false);
+    auto fds = std::vector<int>(abs_paths.size(), -1);
+
+    /* 先为所有文件发起回写，磁盘可以并行处理，随后的 fdatasync 大多只需等待 */
+    for (auto i = 0uz; i < abs_paths.size(); ++i)
+    {
+      fds[i] = open(abs_paths[i].data(), O_RDONLY | O_CLOEXEC);
+      if (fds[i] == -1)
+      {
+        LOG_ERROR(std::format("open '{}' for fdatasync failed, {}", abs_paths[i], strerror(errno)));
+        continue;
+      }
+      sync_file_range(fds[i], 0, 0, SYNC_FILE_RANGE_WRITE);
+    }
+
+    /* 同一批文件大多位于少数几个扁平目录中，每个目录只需 fsync 一次 */
+    auto dirs = std::map<std::string, bool>{};
+    for (auto i = 0uz; i < abs_paths.size(); ++i)
+    {
+      if (fds[i] == -1)
+      {
+        continue;
+      }
+
+      results[i] = fdatasync(fds[i]) == 0;
+      if (!results[i])
+      {
+        LOG_ERROR(std::format("fdatasync '{}' failed, {}", abs_paths[i], strerror(errno)));
+      }
+      close(fds[i]);
+      dirs.emplace(std::filesystem::path{abs_paths[i]}.parent_path(), true);
+    }
+
+    for (auto &[dir, ok] : dirs)
+    {
+      auto fd = open(dir.data(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      ok = fd != -1 && fsync(fd) == 0;
+      if (!ok)
+      {
+        LOG_ERROR(std::format("fsync directory '{}' failed, {}", dir, strerror(errno)));
+      }
+      if (fd != -1)
+      {
+        close(fd);
+      }
+    }
+
+    for (auto i = 0uz; i < abs_paths.size(); ++i)
+    {
+      results[i] = results[i] && dirs[std::filesystem::path{abs_paths[i]}.parent_path()];
+      durability_metrics.failed += !results[i];
+    }
+    ++durability_metrics.batches;
+    durability_metrics.files += abs_paths.size();
+    return results;
+  }
+
+  auto record_durable_latency(std::chrono::steady_clock::time_point begin) -> void
+  {
+    auto ms = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    auto idx = std::min<size_t>(std::bit_width(ms), durable_latency_buckets - 1);
+    ++durability_metrics.latency_ms[idx];
+  }
+
+  auto do_group_flusher() -> void
+  {
+    auto window = std::chrono::microseconds{storage_config.performance.durability_group_window_us};
+    auto batch = std::vector<durable_request>{};
+    while (true)
+    {
+      {
+        auto lock = std::unique_lock{durable_requests_mut};
+        durable_requests_cv.wait(lock, []
+                                 { return !durable_requests.empty(); });
+      }
+
+      /* 等待一个窗口，让随后关闭的文件加入同一批 */
+      std::this_thread::sleep_for(window);
+      {
+        auto lock = std::unique_lock{durable_requests_mut};
+        batch.swap(durable_requests);
+      }
+
+      auto abs_paths = std::vector<std::string>{};
+      for (const auto &request : batch)
+      {
+        abs_paths.push_back(request.abs_path);
+      }
+      auto results = sync_durable_batch(abs_paths);
+
+      /* 整批完成后一起恢复等待的协程 */
+      for (auto i = 0uz; i < batch.size(); ++i)
+      {
+        record_durable_latency(batch[i].begin);
+        asio::post(batch[i].executor, [handler = std::move(batch[i].handler), ok = (bool)results[i]]() mutable
+                   { std::move(handler)(ok); });
+      }
+      batch.clear();
+    }
+  }
+
+} // namespace storage_detail
+
+namespace storage
+{
+
+  using namespace storage_detail;
+
+  auto start_durability_service() -> void
+  {
+    auto mode = static_cast<durability_mode>(storage_config.performance.durability);
+    if (mode >= durability_mode::sentinel)
+    {
+      LOG_WARN(std::format("invalid durability {}, fallback to none", storage_config.performance.durability));
+      storage_config.performance.durability = std::to_underlying(durability_mode::none);
+    }
+
+    if (mode == durability_mode::group)
+    {
+      std::thread{do_group_flusher}.detach();
+    }
+  }
+
+  auto make_durable(std::string abs_path) -> asio::awaitable<bool>
+  {
+    auto mode = static_cast<durability_mode>(storage_config.performance.durability);
+    if (mode == durability_mode::none)
+    {
+      co_return true;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    /* fdatasync 和目录的 fsync 可能阻塞较长时间，交给文件所在 store 的 I/O 线程池，不占用网络线程 */
+    if (mode == durability_mode::file)
+    {
+      auto sync = [&]() -> bool
+      { return sync_durable_batch({abs_path}).front(); };
+      auto store = hot_store_group()->find_store(abs_path).first;
+      auto ok = store ? co_await store->run_io(sync) : sync();
+      record_durable_latency(begin);
+      co_return ok;
+    }
+
+    auto executor = co_await asio::this_coro::executor;
+    co_return co_await asio::async_initiate<decltype(asio::use_awaitable), void(bool)>(
+        [&](auto handler)
+        {
+          {
+            auto lock = std::unique_lock{durable_requests_mut};
+            durable_requests.push_back({
+                .abs_path = std::move(abs_path),
+                .begin = begin,
+                .executor = executor,
+                .handler = std::move(handler),
+            });
+          }
+          durable_requests_cv.notify_one();
+        },
+        asio::use_awaitable);
+  }
+
+  auto get_durability_metrics() -> nlohmann::json
+  {
+    auto latency = std::vector<uint64_t>{};
+    for (const auto &count : durability_metrics.latency_ms)
+    {
+      latency.push_back(count.load());
+    }
+
+    return {
+        {"mode", storage_config.performance.durability},
+        {"batches", durability_metrics.batches.load()},
+        {"files", durability_metrics.files.load()},
+        {"failed", durability_metrics.failed.load()},
+        {"latency_ms", latency},
+    };
+  }
+
+} // namespace storage
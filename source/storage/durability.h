@@ -0,0 +1,119 @@
+#pragma once
+
+#include <array>
+#include <asio.hpp>
+#include <atomic>
+#include <common/json.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace storage
+{
+
+  /**
+   * @brief 上传和同步完成时的持久化方式，对应配置 performance.durability
+   *
+   * none   不主动回写，由内核决定落盘时机
+   * file   关闭文件后立即 fdatasync 文件和所在目录，再响应
+   * group  由后台线程批量 fdatasync 一段时间内关闭的文件，完成后一起响应
+   */
+  enum class durability_mode : uint32_t
+  {
+    none,
+    file,
+    group,
+    sentinel,
+  };
+
+} // namespace storage
+
+namespace storage_detail
+{
+
+  /**
+   * @brief 等待批量持久化的文件
+   *
+   * @param abs_path  文件路径
+   * @param begin     加入队列的时间，用于统计延迟
+   * @param executor  发起请求的协程的执行器，完成时在其上恢复协程
+   * @param handler   完成时调用，参数为是否成功
+   */
+  struct durable_request
+  {
+    std::string abs_path;
+    std::chrono::steady_clock::time_point begin;
+    asio::any_io_executor executor;
+    asio::any_completion_handler<void(bool)> handler;
+  };
+
+  inline auto durable_requests = std::vector<durable_request>{};
+
+  inline auto durable_requests_mut = std::mutex{};
+
+  inline auto durable_requests_cv = std::condition_variable{};
+
+  /* 延迟直方图的桶数量，第 i 个桶为 [2^(i-1), 2^i) 毫秒，第 0 个桶为 1 毫秒以内，最后一个桶包含更长的延迟 */
+  constexpr auto durable_latency_buckets = 12uz;
+
+  /**
+   * @brief 持久化相关的指标
+   *
+   * @param batches     fdatasync 的批次数量，file 模式时每个文件为一批
+   * @param files       持久化的文件数量
+   * @param failed      持久化失败的文件数量
+   * @param latency_ms  从请求持久化到完成的延迟分布
+   */
+  inline struct durability_metrics_t
+  {
+    std::atomic_uint64_t batches;
+    std::atomic_uint64_t files;
+    std::atomic_uint64_t failed;
+    std::array<std::atomic_uint64_t, durable_latency_buckets> latency_ms{};
+  } durability_metrics;
+
+  /**
+   * @brief 持久化一批文件。先为所有文件发起回写，再依次等待完成，最后 fsync 去重后的目录
+   *
+   * @return 每个文件是否成功
+   */
+  auto sync_durable_batch(const std::vector<std::string> &abs_paths) -> std::vector<bool>;
+
+  /**
+   * @brief 记录一次持久化的延迟
+   *
+   */
+  auto record_durable_latency(std::chrono::steady_clock::time_point begin) -> void;
+
+  /**
+   * @brief 批量持久化的后台线程，fdatasync 会阻塞，因此不在 asio 线程中执行
+   *
+   */
+  auto do_group_flusher() -> void;
+
+} // namespace storage_detail
+
+namespace storage
+{
+
+  /**
+   * @brief 启动持久化服务，group 模式时启动后台线程
+   *
+   */
+  auto start_durability_service() -> void;
+
+  /**
+   * @brief 按配置的方式持久化已关闭的文件，应在响应上传或同步完成前调用
+   *
+   * @return 是否成功，none 模式时总是成功
+   */
+  auto make_durable(std::string abs_path) -> asio::awaitable<bool>;
+
+  /**
+   * @brief 获取持久化指标
+   *
+   */
+  auto get_durability_metrics() -> nlohmann::json;
+
+} // namespace storage
@@ -70,12 +70,19 @@ auto main(int argc, char *argv[]) -> int
   common::write_pid_file("storage", storage::storage_config.common.base_path, force);
   storage::init_signal();
 
+  auto thread_count = storage::storage_config.common.thread_count;
+  if (storage::storage_config.common.shard_per_core)
+  {
+    auto shards = common::io_shards{thread_count};
+    asio::co_spawn(shards.context(0), storage::storage_server(&shards), common::exception_handle);
+    return shards.run();
+  }
+
   auto io = asio::io_context{};
   auto gurad = asio::make_work_guard(io);
 
   asio::co_spawn(io, storage::storage_server(), common::exception_handle);
 
-  auto thread_count = storage::storage_config.common.thread_count;
   for (auto i = 0u; i < thread_count - 1; ++i)
   {
     std::thread{[&]
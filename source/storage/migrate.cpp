@@ -1,9 +1,18 @@
 #include "migrate.h"
 #include "config.h"
 #include "store_util.h"
+#include <algorithm>
 #include <common/exception.h>
 #include <common/log.h>
 #include <common/util.h>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 
 #define SMS_TO_COLD_DISABLE 0
 #define SMS_TO_COLD_ATIME 1
@@ -15,66 +24,316 @@ namespace storage_detail
 {
   using namespace storage;
 
-  auto init_migrate_to_cold() -> void
+  auto is_hidden_file(std::string_view abs_path) -> bool
   {
-    if (storage_config.migrate.to_cold_rule == SMS_TO_COLD_DISABLE)
+    auto pos = abs_path.rfind('/');
+    return abs_path.substr(pos == std::string_view::npos ? 0 : pos + 1).starts_with('.');
+  }
+
+  auto migrate_snapshot_path() -> std::string
+  {
+    return std::format("{}/data/migrate.snapshot", storage_config.common.base_path);
+  }
+
+  auto load_migrate_snapshot() -> bool
+  {
+    auto begin = std::chrono::steady_clock::now();
+    auto path = migrate_snapshot_path();
+    auto fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
     {
-      LOG_INFO("diable to cold migrate");
-      return;
+      LOG_INFO(std::format("no migrate snapshot '{}'", path));
+      return false;
     }
 
-    LOG_INFO("to cold migrate init start");
-    struct stat st;
-    for (const auto &path : storage_config.server.hot_paths)
+    struct stat st{};
+    auto data = fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(migrate_snapshot_header) ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED)
     {
-      for (const auto &file : common::iterate_normal_file(path))
+      LOG_WARN(std::format("map migrate snapshot '{}' failed", path));
+      return false;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    auto ptr = (const char *)data;
+    auto end = ptr + st.st_size;
+    auto header = migrate_snapshot_header{};
+    std::memcpy(&header, ptr, sizeof(header));
+    ptr += sizeof(header);
+
+    /* 记录未对齐，逐个拷贝出来解析 */
+    auto read_records = [&](uint64_t count, auto insert)
+    {
+      for (auto i = 0uz; i < count; ++i)
       {
-        if (auto ret = stat(file.c_str(), &st); ret != 0)
+        auto record = migrate_snapshot_record{};
+        if (ptr + sizeof(record) > end)
         {
-          LOG_ERROR(std::format("stat failed '{}' {}", file, ret));
+          return false;
         }
-
-        switch (storage_config.migrate.to_cold_rule)
+        std::memcpy(&record, ptr, sizeof(record));
+        if (ptr + sizeof(record) + record.path_len > end)
         {
-          case SMS_TO_COLD_ATIME:
-            hot_file_atime_or_ctime[file] = st.st_atime;
-            break;
-          case SMS_TO_COLD_CTIME:
-            hot_file_atime_or_ctime[file] = st.st_ctime;
-            break;
-          default:
-            LOG_CRITICAL("unknown to cold rule {}", storage_config.migrate.to_cold_rule);
-            break;
+          return false;
         }
+        insert(std::string{ptr + sizeof(record), record.path_len}, record.value);
+        ptr += sizeof(record) + record.path_len;
       }
+      return true;
+    };
+
+    auto ok = header.magic == migrate_snapshot_magic && header.version == migrate_snapshot_version;
+    if (ok)
+    {
+      /* 规则改变后快照中的时间不再适用，交给后台扫描重新获取 */
+      auto lock = std::unique_lock{hot_file_atime_or_ctime_mut};
+      auto keep_hot = header.to_cold_rule == storage_config.migrate.to_cold_rule;
+      ok = read_records(header.hot_count, [&](std::string &&abs_path, uint64_t value)
+                        {
+                          if (keep_hot)
+                          {
+                            hot_file_atime_or_ctime.insert_or_assign(std::move(abs_path), value);
+                          }
+                        });
+    }
+    if (ok)
+    {
+      auto lock = std::unique_lock{cold_file_access_times_mut};
+      ok = read_records(header.cold_count, [&](std::string &&abs_path, uint64_t value)
+                        { cold_file_access_times.insert_or_assign(std::move(abs_path), value); });
     }
-    LOG_INFO("to cold migrate init suc");
+    munmap(data, st.st_size);
+
+    if (!ok)
+    {
+      LOG_WARN(std::format("invalid migrate snapshot '{}'", path));
+      return false;
+    }
+    LOG_INFO(std::format("load migrate snapshot suc, {} hot files, {} cold files, cost {}ms", header.hot_count, header.cold_count,
+                         std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count()));
+    if (header.to_cold_rule != storage_config.migrate.to_cold_rule)
+    {
+      LOG_INFO(std::format("to_cold_rule changed from {} to {}, ignore hot files of migrate snapshot", header.to_cold_rule, storage_config.migrate.to_cold_rule));
+      return false;
+    }
+    return true;
   }
 
-  auto init_migrate_to_hot() -> void
+  auto save_migrate_snapshot() -> bool
   {
-    if (storage_config.migrate.to_hot_rule == SMS_TO_HOT_DISABLE)
+    auto encode = [](std::string &out, const std::string &abs_path, uint64_t value)
     {
-      LOG_INFO("disable to hot migrate");
-      return;
+      auto record = migrate_snapshot_record{.value = value, .path_len = (uint32_t)abs_path.size()};
+      out.append((const char *)&record, sizeof(record));
+      out.append(abs_path);
+    };
+
+    auto header = migrate_snapshot_header{
+        .magic = migrate_snapshot_magic,
+        .version = migrate_snapshot_version,
+        .to_cold_rule = storage_config.migrate.to_cold_rule,
+    };
+    auto data = std::string(sizeof(header), '\0');
+    {
+      auto lock = std::unique_lock{hot_file_atime_or_ctime_mut};
+      header.hot_count = hot_file_atime_or_ctime.size();
+      for (const auto &[abs_path, time] : hot_file_atime_or_ctime)
+      {
+        encode(data, abs_path, time);
+      }
     }
+    {
+      auto lock = std::unique_lock{cold_file_access_times_mut};
+      header.cold_count = cold_file_access_times.size();
+      for (const auto &[abs_path, times] : cold_file_access_times)
+      {
+        encode(data, abs_path, times);
+      }
+    }
+    std::memcpy(data.data(), &header, sizeof(header));
 
-    LOG_INFO("to hot migrate init start");
-    for (const auto &path : storage_config.server.cold_paths)
+    /* 先写入临时文件再重命名，崩溃时保留上一次完整的快照 */
+    auto lock = std::unique_lock{migrate_snapshot_mut};
+    auto path = migrate_snapshot_path();
+    auto tmp_path = std::format("{}.tmp", path);
+    auto ofs = std::ofstream{tmp_path, std::ios::binary | std::ios::trunc};
+    ofs.write(data.data(), data.size());
+    ofs.close();
+    if (!ofs || rename(tmp_path.data(), path.data()) != 0)
     {
-      for (const auto &file : common::iterate_normal_file(path))
+      LOG_ERROR(std::format("save migrate snapshot '{}' failed, {}", path, strerror(errno)));
+      return false;
+    }
+    return true;
+  }
+
+  auto async_save_migrate_snapshot() -> asio::awaitable<bool>
+  {
+    auto stores = hot_store_group()->stores();
+    if (stores.empty())
+    {
+      co_return save_migrate_snapshot();
+    }
+    co_return co_await stores.front()->run_io([]
+                                              { return save_migrate_snapshot(); });
+  }
+
+  auto seed_migrate_files_from_index() -> void
+  {
+    auto begin = std::chrono::steady_clock::now();
+    auto hot_files = 0uz;
+    auto cold_files = 0uz;
+
+    /* 打包在卷中的小文件不参与迁移。索引中没有访问时间，ATIME 规则下以修改时间代替，之后的访问会更新它 */
+    if (storage_config.migrate.to_cold_rule != SMS_TO_COLD_DISABLE)
+    {
+      for (auto store : hot_store_group()->stores())
+      {
+        auto root_path = store->root_path();
+        auto lock = std::unique_lock{hot_file_atime_or_ctime_mut};
+        store->for_each_index([&](std::string_view rel_path, const store_index_entry &entry)
+                              {
+                                if (entry.volume == 0)
+                                {
+                                  auto time = storage_config.migrate.to_cold_rule == SMS_TO_COLD_ATIME ? entry.mtime : entry.ctime;
+                                  hot_files += hot_file_atime_or_ctime.try_emplace(std::format("{}/{}", root_path, rel_path), time).second;
+                                } });
+      }
+    }
+    if (storage_config.migrate.to_hot_rule != SMS_TO_HOT_DISABLE && cold_store_group())
+    {
+      for (auto store : cold_store_group()->stores())
       {
-        cold_file_access_times[file] = 0;
+        auto root_path = store->root_path();
+        auto lock = std::unique_lock{cold_file_access_times_mut};
+        store->for_each_index([&](std::string_view rel_path, const store_index_entry &entry)
+                              {
+                                if (entry.volume == 0)
+                                {
+                                  cold_files += cold_file_access_times.try_emplace(std::format("{}/{}", root_path, rel_path), 0).second;
+                                } });
       }
     }
-    LOG_INFO("to hot migrate init suc");
+    LOG_INFO(std::format("seed migrate files from index suc, {} new hot files, {} new cold files, cost {}ms", hot_files, cold_files,
+                         std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count()));
+  }
+
+  auto rescan_migrate_files() -> void
+  {
+    auto begin = std::chrono::steady_clock::now();
+
+    /* 每个任务为一个 store 的一个一级扁平目录，所有 store 的任务由线程池共同领取 */
+    auto tasks = std::vector<std::pair<std::string, bool>>{};
+    auto add_tasks = [&](const std::vector<std::string> &paths, bool hot)
+    {
+      for (const auto &path : paths)
+      {
+        for (auto i = 0; i < 256; ++i)
+        {
+          tasks.emplace_back(std::format("{}/{:02X}", path, i), hot);
+        }
+      }
+    };
+    if (storage_config.migrate.to_cold_rule != SMS_TO_COLD_DISABLE)
+    {
+      add_tasks(storage_config.server.hot_paths, true);
+    }
+    if (storage_config.migrate.to_hot_rule != SMS_TO_HOT_DISABLE)
+    {
+      add_tasks(storage_config.server.cold_paths, false);
+    }
+
+    auto next_task = std::atomic_size_t{0};
+    auto hot_files = std::atomic_uint64_t{0};
+    auto cold_files = std::atomic_uint64_t{0};
+    auto worker = [&]
+    {
+      for (auto idx = next_task++; idx < tasks.size(); idx = next_task++)
+      {
+        const auto &[dir, hot] = tasks[idx];
+        auto files = std::vector<std::pair<std::string, uint64_t>>{};
+        auto ec = std::error_code{};
+        for (auto it = std::filesystem::recursive_directory_iterator{dir, ec}; !ec && it != std::filesystem::recursive_directory_iterator{}; it.increment(ec))
+        {
+          auto abs_path = it->path().string();
+          if (!it->is_regular_file(ec) || is_hidden_file(abs_path))
+          {
+            continue;
+          }
+          if (!hot)
+          {
+            files.emplace_back(std::move(abs_path), 0);
+            continue;
+          }
+
+          struct stat st{};
+          if (stat(abs_path.data(), &st) != 0)
+          {
+            continue;
+          }
+          files.emplace_back(std::move(abs_path), storage_config.migrate.to_cold_rule == SMS_TO_COLD_ATIME ? st.st_atime : st.st_ctime);
+        }
+
+        /* 快照中的记录和启动后的访问比扫描结果更新，只补充缺失的文件 */
+        if (hot)
+        {
+          auto lock = std::unique_lock{hot_file_atime_or_ctime_mut};
+          for (auto &[abs_path, time] : files)
+          {
+            hot_files += hot_file_atime_or_ctime.try_emplace(std::move(abs_path), time).second;
+          }
+        }
+        else
+        {
+          auto lock = std::unique_lock{cold_file_access_times_mut};
+          for (auto &[abs_path, times] : files)
+          {
+            cold_files += cold_file_access_times.try_emplace(std::move(abs_path), times).second;
+          }
+        }
+      }
+    };
+
+    {
+      auto threads = std::vector<std::jthread>{};
+      auto count = std::clamp(std::thread::hardware_concurrency(), 1u, migrate_rescan_threads);
+      for (auto i = 0u; i < count; ++i)
+      {
+        threads.emplace_back(worker);
+      }
+    }
+    LOG_INFO(std::format("rescan migrate files suc, {} new hot files, {} new cold files, cost {}ms", hot_files.load(), cold_files.load(),
+                         std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count()));
+  }
+
+  auto migrate_snapshot_service() -> asio::awaitable<void>
+  {
+    auto timer = asio::steady_timer{co_await asio::this_coro::executor};
+    while (true)
+    {
+      timer.expires_after(std::chrono::seconds{storage_config.migrate.snapshot_interval});
+      co_await timer.async_wait(asio::use_awaitable);
+      co_await async_save_migrate_snapshot();
+    }
   }
 
   auto migrate_to_cold_once(const std::string &abs_path) -> asio::awaitable<void>
   {
     LOG_INFO(std::format("migrate to cold {}", abs_path));
-    cold_store_group()->copy_from_another_store(abs_path);
-    std::filesystem::remove(abs_path);
+
+    /* 快照中的文件可能已被删除，打包在卷中的小文件没有独立的文件，也不参与迁移 */
+    if (!std::filesystem::exists(abs_path))
+    {
+      auto lock = std::unique_lock{hot_file_atime_or_ctime_mut};
+      hot_file_atime_or_ctime.erase(abs_path);
+      co_return;
+    }
+    if (!co_await cold_store_group()->async_copy_from_another_store(abs_path))
+    {
+      co_return;
+    }
+    hot_store_group()->remove_file(abs_path);
     after_hot_to_cold(abs_path);
     co_return;
   }
@@ -87,6 +346,7 @@ namespace storage_detail
     }
 
     auto to_cold_files = std::vector<std::string>{};
+    auto lock = std::unique_lock{hot_file_atime_or_ctime_mut};
     for (const auto &[abs_path, time] : hot_file_atime_or_ctime)
     {
       if ((int64_t)time + storage_config.migrate.to_cold_timeout <
@@ -95,6 +355,7 @@ namespace storage_detail
         to_cold_files.push_back(abs_path);
       }
     }
+    lock.unlock();
 
     for (const auto &file : to_cold_files)
     {
@@ -110,6 +371,7 @@ namespace storage_detail
     }
 
     auto to_hot_files = std::vector<std::string>{};
+    auto lock = std::unique_lock{cold_file_access_times_mut};
     for (const auto &[abs_path, times] : cold_file_access_times)
     {
       if (times >= storage_config.migrate.to_hot_action)
@@ -117,6 +379,7 @@ namespace storage_detail
         to_hot_files.push_back(abs_path);
       }
     }
+    lock.unlock();
 
     for (const auto &file : to_hot_files)
     {
@@ -127,8 +390,19 @@ namespace storage_detail
   auto migrate_to_hot_once(const std::string &abs_path) -> asio::awaitable<void>
   {
     LOG_INFO(std::format("migrate to hot {}", abs_path));
-    hot_store_group()->copy_from_another_store(abs_path);
-    std::filesystem::remove(abs_path);
+
+    /* 快照中的文件可能已被删除，打包在卷中的小文件没有独立的文件，也不参与迁移 */
+    if (!std::filesystem::exists(abs_path))
+    {
+      auto lock = std::unique_lock{cold_file_access_times_mut};
+      cold_file_access_times.erase(abs_path);
+      co_return;
+    }
+    if (!co_await hot_store_group()->async_copy_from_another_store(abs_path))
+    {
+      co_return;
+    }
+    cold_store_group()->remove_file(abs_path);
     after_cold_to_hot(abs_path);
     co_return;
   }
@@ -144,6 +418,7 @@ namespace storage_detail
       LOG_INFO("start migrate service");
       co_await migrate_to_cold_service();
       co_await migrate_to_hot_service();
+      co_await async_save_migrate_snapshot();
     }
   }
 
@@ -155,9 +430,27 @@ namespace storage
 
   auto start_migrate_service() -> asio::awaitable<void>
   {
-    init_migrate_to_cold();
-    init_migrate_to_hot();
+    /* 先从快照恢复，再在后台补充快照之后新增的文件，不阻塞启动。快照可用时索引中已有全部文件，只有快照不可用时才扫描磁盘 */
+    auto snapshot_valid = load_migrate_snapshot();
+    std::thread{[snapshot_valid]
+                {
+                  if (snapshot_valid)
+                  {
+                    seed_migrate_files_from_index();
+                  }
+                  else
+                  {
+                    rescan_migrate_files();
+                  }
+                  save_migrate_snapshot();
+                }}
+        .detach();
+
     asio::co_spawn(co_await asio::this_coro::executor, migrate_service(), common::exception_handle);
+    if (storage_config.migrate.snapshot_interval != 0)
+    {
+      asio::co_spawn(co_await asio::this_coro::executor, migrate_snapshot_service(), common::exception_handle);
+    }
     co_return;
   }
 
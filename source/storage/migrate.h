@@ -12,6 +12,42 @@ namespace storage_detail
 
   inline auto migrate_service_timer = std::unique_ptr<asio::steady_timer>{};
 
+  inline auto migrate_snapshot_mut = std::mutex{}; // 串行化快照文件的写入
+
+  constexpr auto migrate_snapshot_magic = uint32_t{0x4D534644}; // "DFSM"
+
+  constexpr auto migrate_snapshot_version = uint32_t{1};
+
+  /* 后台扫描迁移文件的最大线程数 */
+  constexpr auto migrate_rescan_threads = 16u;
+
+  /**
+   * @brief 迁移状态快照的文件头，其后依次为 hot_count 条热数据记录和 cold_count 条冷数据记录
+   *
+   * @param to_cold_rule  保存时的 to_cold_rule，与当前配置不同时忽略热数据记录
+   */
+  struct migrate_snapshot_header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t to_cold_rule;
+    uint32_t reserved;
+    uint64_t hot_count;
+    uint64_t cold_count;
+  };
+
+  /**
+   * @brief 迁移状态快照的记录，其后紧跟 path_len 字节的 abs_path
+   *
+   * @param value 热数据为访问或修改时间，冷数据为访问次数
+   */
+  struct migrate_snapshot_record
+  {
+    uint64_t value;
+    uint32_t path_len;
+    uint32_t reserved;
+  };
+
   /**
    * @brief 冷热数据迁移服务
    *
@@ -19,28 +55,65 @@ namespace storage_detail
   auto migrate_service() -> asio::awaitable<void>;
 
   /**
-   * @brief 初始化冷数据迁移
+   * @brief 是否为以 . 开头的文件，如 store 的索引日志，不参与迁移
    *
    */
-  auto init_migrate_to_cold() -> void;
+  auto is_hidden_file(std::string_view abs_path) -> bool;
 
   /**
-   * @brief 冷数据迁移服务
+   * @brief 迁移状态快照的路径
    *
    */
-  auto migrate_to_cold_service() -> asio::awaitable<void>;
+  auto migrate_snapshot_path() -> std::string;
 
   /**
-   * @brief 迁移单个冷数据
+   * @brief 通过 mmap 读取快照，恢复热数据的访问或修改时间和冷数据的访问次数
    *
+   * @return 快照不存在、无效或 to_cold_rule 已改变时返回 false，此时需要扫描磁盘
    */
-  auto migrate_to_cold_once(const std::string &abs_path) -> asio::awaitable<void>;
+  auto load_migrate_snapshot() -> bool;
+
+  /**
+   * @brief 保存迁移状态快照
+   *
+   */
+  auto save_migrate_snapshot() -> bool;
+
+  /**
+   * @brief 在 hot store 的 I/O 线程池中保存迁移状态快照，不阻塞网络线程
+   *
+   */
+  auto async_save_migrate_snapshot() -> asio::awaitable<bool>;
+
+  /**
+   * @brief 从 store 的索引补充快照中缺失的文件，不扫描磁盘
+   *
+   */
+  auto seed_migrate_files_from_index() -> void;
+
+  /**
+   * @brief 按 store 和一级扁平目录并行扫描冷热数据，补充快照中缺失的文件
+   *
+   */
+  auto rescan_migrate_files() -> void;
+
+  /**
+   * @brief 定时保存迁移状态快照
+   *
+   */
+  auto migrate_snapshot_service() -> asio::awaitable<void>;
 
   /**
-   * @brief 初始化热数据迁移
+   * @brief 冷数据迁移服务
    *
    */
-  auto init_migrate_to_hot() -> void;
+  auto migrate_to_cold_service() -> asio::awaitable<void>;
+
+  /**
+   * @brief 迁移单个冷数据
+   *
+   */
+  auto migrate_to_cold_once(const std::string &abs_path) -> asio::awaitable<void>;
 
   /**
    * @brief 热数据迁移服务
@@ -1,5 +1,7 @@
 #include "server.h"
 #include "config.h"
+#include "download_cache.h"
+#include "durability.h"
 #include "migrate.h"
 #include "server_for_client.h"
 #include "server_for_master.h"
@@ -7,6 +9,8 @@
 #include "store_util.h"
 #include "sync.h"
 #include <common/acceptor.h>
+#include <common/exception.h>
+#include <common/frame_pool.h>
 #include <common/metrics.h>
 #include <common/metrics_request.h>
 
@@ -26,6 +30,17 @@ namespace storage_detail
         info["root_path"] = store->root_path();
         info["total_space"] = store->total_space();
         info["free_space"] = store->free_space();
+        info["index_files"] = store->index_size();
+        info["init_ms"] = store->init_ms();
+        auto volume = store->get_volume_stats();
+        info["volumes"] = volume.volumes;
+        info["volume_bytes"] = volume.bytes;
+        info["volume_dead_bytes"] = volume.dead_bytes;
+        auto io = store->get_io_stats();
+        info["io_queue_depth"] = io.depth;
+        info["io_tasks"] = io.tasks;
+        info["io_wait_us_avg"] = io.tasks == 0 ? 0 : io.wait_us / io.tasks;
+        info["io_wait_us_max"] = io.max_wait_us;
         infos.push_back(info);
       }
 
@@ -44,23 +59,26 @@ namespace storage_detail
         {"ip", storage_config.server.ip},
         {"port", storage_config.server.port},
         {"base_path", storage_config.common.base_path},
+        {"startup_ms", startup_ms},
+        {"store_group_init_ms", store_group_init_ms},
         {"store_infos", store_infos},
     });
   }
 
   auto request_from_connection(std::shared_ptr<common::proto_frame> request, std::shared_ptr<common::connection> conn) -> asio::awaitable<void>
   {
-    auto conn_type = conn->get_data<conn_type_t>(conn_data::conn_type);
-    if (!conn_type)
+    auto session = conn->get_session<session_t>();
+    if (!session)
     {
-      LOG_CRITICAL("connection {} has no conn_type", conn->address());
+      LOG_CRITICAL("connection {} has no session", conn->address());
       co_return;
     }
+    auto conn_type = session->conn_type;
 
     if (request == nullptr)
     {
       common::pop_one_connection();
-      switch (*conn_type)
+      switch (conn_type)
       {
         case conn_type_t::client:
           co_await on_client_disconnect(conn);
@@ -77,7 +95,7 @@ namespace storage_detail
 
     auto bt = common::push_one_request();
     auto ok = true;
-    switch (*conn_type)
+    switch (conn_type)
     {
       case conn_type_t::client:
         ok = co_await request_from_client(request, conn);
@@ -89,12 +107,27 @@ namespace storage_detail
         ok = co_await request_from_master(request, conn);
         break;
       default:
-        LOG_CRITICAL("unknown connection type {} of connection {}", static_cast<int>(*conn_type), conn->address());
+        LOG_CRITICAL("unknown connection type {} of connection {}", static_cast<int>(conn_type), conn->address());
         break;
     }
     common::pop_one_request(bt, {.success = ok});
   }
 
+  auto accept_connections(bool reuse_port) -> asio::awaitable<void>
+  {
+    auto acceptor = common::acceptor{co_await asio::this_coro::executor,
+                                     storage_config.server.ip, (uint16_t)storage_config.server.port,
+                                     storage_config.server.heart_timeout, storage_config.server.heart_interval,
+                                     reuse_port};
+    while (true)
+    {
+      auto conn = co_await acceptor.accept();
+      regist_client(conn);
+      conn->start(request_from_connection);
+      common::push_one_connection();
+    }
+  }
+
 } // namespace storage_detail
 
 namespace storage
@@ -102,27 +135,40 @@ namespace storage
 
   using namespace storage_detail;
 
-  auto storage_server() -> asio::awaitable<void>
+  auto storage_server(common::io_shards *shards) -> asio::awaitable<void>
   {
+    auto begin = std::chrono::steady_clock::now();
     init_store_group();
+    start_volume_compact_service();
+    start_durability_service();
     co_await start_sync_service();
     co_await start_migrate_service();
 
     co_await common::start_metrics(std::format("{}/data/metrics.json", storage_config.common.base_path));
     common::add_metrics_extension({"storage_info", storage_info_metrics});
+    common::add_metrics_extension({"frame_pool", common::get_frame_pool_metrics});
+    common::add_metrics_extension({"download_cache", get_download_cache_metrics});
+    common::add_metrics_extension({"durability", get_durability_metrics});
+
+    /* 握手时提供给对端的能力 */
+    auto caps = common::local_capabilities();
+    if (!storage_config.performance.compress)
+    {
+      caps.flags &= ~common::CAP_COMPRESS_LZ4;
+    }
+    common::set_local_capabilities(caps);
+    common::set_zerocopy_send_min_len(storage_config.performance.zerocopy_send_min_kb * 1024);
 
     co_await regist_to_master();
 
-    auto acceptor = common::acceptor{co_await asio::this_coro::executor,
-                                     storage_config.server.ip, (uint16_t)storage_config.server.port,
-                                     storage_config.server.heart_timeout, storage_config.server.heart_interval};
-    while (true)
+    /* 初始化完成后其余分片才开始接受连接 */
+    for (auto i = 1u; shards && i < shards->size(); ++i)
     {
-      auto conn = co_await acceptor.accept();
-      regist_client(conn);
-      conn->start(request_from_connection);
-      common::push_one_connection();
+      asio::co_spawn(shards->context(i), accept_connections(true), common::exception_handle);
     }
+    startup_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    LOG_INFO(std::format("storage startup suc, cost {}ms", startup_ms));
+    co_await accept_connections(shards != nullptr);
   }
 
 } // namespace storage
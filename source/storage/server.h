@@ -1,9 +1,11 @@
 #pragma once
 #include <common/connection.h>
+#include <common/io_shards.h>
 #include <common/json.h>
 
 namespace storage_detail
 {
+  inline auto startup_ms = uint64_t{0}; // 从启动到开始接受连接的耗时
   /**
    * @brief
    *
@@ -16,6 +18,13 @@ namespace storage_detail
    */
   auto request_from_connection(std::shared_ptr<common::proto_frame> request, std::shared_ptr<common::connection> conn) -> asio::awaitable<void>;
 
+  /**
+   * @brief 在当前协程的执行器上监听端口并处理新连接
+   *
+   * @param reuse_port 每个分片各自监听时为 true
+   */
+  auto accept_connections(bool reuse_port) -> asio::awaitable<void>;
+
 } // namespace storage_detail
 
 namespace storage
@@ -24,7 +33,8 @@ namespace storage
   /**
    * @brief storage 服务
    *
+   * @param shards 不为空时每个分片各自接受连接，服务本身运行在分片 0 上
    */
-  auto storage_server() -> asio::awaitable<void>;
+  auto storage_server(common::io_shards *shards = nullptr) -> asio::awaitable<void>;
 
 } // namespace storage
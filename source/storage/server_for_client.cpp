@@ -1,93 +1,170 @@
 #include "server_for_client.h"
 #include "config.h"
+#include "durability.h"
 #include "migrate.h"
 #include "server_util.h"
 #include "store_util.h"
 #include "sync.h"
 #include <common/util.h>
-#include <sys/sendfile.h>
+#include <fcntl.h>
 
 namespace storage_detail
 {
 
+  auto alloc_transfer_id(client_session_t &session) -> std::optional<uint32_t>
+  {
+    if (session.uploads.size() + session.downloads.size() >= max_client_transfers)
+    {
+      return std::nullopt;
+    }
+
+    while (true)
+    {
+      auto id = session.next_transfer_id++;
+      if (id != 0 && !session.uploads.contains(id) && !session.downloads.contains(id))
+      {
+        return id;
+      }
+    }
+  }
+
   auto cs_upload_start_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
   {
-    if (conn->has_data(conn_data::client_upload_file_id))
+    /* 兼容只有 file_size 的旧请求 */
+    auto start_request = common::cs_upload_start_request{.mode = common::upload_mode::normal};
+    auto legacy = request->data_len == sizeof(uint64_t);
+    if (legacy)
     {
-      LOG_ERROR("client already request upload yield");
-      co_await conn->send_response({.stat = 1}, *request);
+      start_request.file_size = common::ntohll(*(uint64_t *)request->data);
+    }
+    else if (request->data_len == sizeof(common::cs_upload_start_request))
+    {
+      auto data = (common::cs_upload_start_request *)request->data;
+      start_request = {
+          .file_size = common::ntohll(data->file_size),
+          .mode = static_cast<common::upload_mode>(ntohl(std::to_underlying(data->mode))),
+          .ack_every = ntohl(data->ack_every),
+      };
+    }
+    else
+    {
+      LOG_ERROR("cs_upload_start request data_len invalid");
+      co_await conn->send_response({.stat = 2}, *request);
       co_return false;
     }
 
-    if (request->data_len != sizeof(uint64_t))
+    if (start_request.mode >= common::upload_mode::sentinel ||
+        (start_request.mode == common::upload_mode::stream && start_request.ack_every == 0))
     {
-      LOG_ERROR("cs_upload_start request data_len invalid");
+      LOG_ERROR("cs_upload_start request invalid mode {} ack_every {}", std::to_underlying(start_request.mode), start_request.ack_every);
       co_await conn->send_response({.stat = 2}, *request);
       co_return false;
     }
 
-    auto file_size = common::ntohll(*(uint64_t *)request->data);
-    auto file_id = hot_store_group()->create_file(file_size);
+    /* 旧版本的 cs_upload 不携带 transfer_id，因此不能与其他上传并行 */
+    auto session = conn->get_session<client_session_t>();
+    auto transfer_id = std::optional{0u};
+    if (legacy ? !session->uploads.empty() : session->uploads.contains(0))
+    {
+      LOG_ERROR("client already request upload yield");
+      co_await conn->send_response({.stat = 1}, *request);
+      co_return false;
+    }
+    if (!legacy)
+    {
+      transfer_id = alloc_transfer_id(*session);
+      if (!transfer_id)
+      {
+        LOG_ERROR("client {} has too many transfers", conn->address());
+        co_await conn->send_response({.stat = 1}, *request);
+        co_return false;
+      }
+    }
+
+    auto file_id = co_await hot_store_group()->async_create_file(start_request.file_size);
     if (!file_id)
     {
-      LOG_ERROR(std::format("create file failed for file_size {}", file_size));
+      LOG_ERROR(std::format("create file failed for file_size {}", start_request.file_size));
       co_await conn->send_response({.stat = 3}, *request);
       co_return false;
     }
-    conn->set_data<client_upload_file_id_t>(conn_data::client_upload_file_id, file_id.value());
-    co_await conn->send_response(*request);
+
+    auto &upload = session->uploads[transfer_id.value()];
+    upload.file_id = file_id.value();
+    if (start_request.mode == common::upload_mode::stream)
+    {
+      upload.stream = client_upload_stream_t{.ack_every = start_request.ack_every, .next_seq = 0, .error_stat = 0};
+    }
+
+    if (legacy)
+    {
+      co_await conn->send_response(*request);
+      co_return true;
+    }
+
+    auto response_to_send = common::create_frame(request->cmd, common::frame_type::response, sizeof(uint32_t));
+    *(uint32_t *)response_to_send->data = htonl(transfer_id.value());
+    co_await conn->send_response(response_to_send, *request);
     co_return true;
   }
 
-  auto cs_upload_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
+  auto cs_upload_finish(REQUEST_HANDLE_PARAMS, uint64_t file_id, std::string_view user_file_name) -> asio::awaitable<bool>
   {
-    auto file_id = conn->get_data<client_upload_file_id_t>(conn_data::client_upload_file_id);
-    if (!file_id)
+    auto res = co_await hot_store_group()->async_close_write_file(file_id, user_file_name);
+    if (!res)
     {
-      LOG_ERROR("client not start upload yield");
-      co_await conn->send_response({.stat = 1}, *request);
+      LOG_ERROR("close file failed");
+      co_await conn->send_response({.stat = 2}, *request);
+      co_return false;
+    }
+    const auto &[root_path, rel_path] = res.value();
+    auto abs_path = std::format("{}/{}", root_path, rel_path);
+    if (!co_await make_durable(hot_store_group()->physical_path(abs_path)))
+    {
+      hot_store_group()->remove_file(abs_path);
+      co_await conn->send_response({.stat = 2}, *request);
       co_return false;
     }
+    push_not_synced_file(rel_path);
+
+    /* 在 rel_path 前加上组号，用于客户端访问文件 */
+    auto rel_path_with_group = std::format("{}/{}", storage_config.server.internal.group_id, rel_path);
+    auto response_to_send = common::create_frame(request->cmd, common::frame_type::response, rel_path_with_group.size());
+    std::copy(rel_path_with_group.begin(), rel_path_with_group.end(), response_to_send->data);
+    co_await conn->send_response(response_to_send, *request);
+
+    new_hot_file(abs_path);
+    co_return true;
+  }
+
+  auto cs_upload_normal_handle(REQUEST_HANDLE_PARAMS, uint32_t transfer_id, std::span<char> data) -> asio::awaitable<bool>
+  {
+    auto session = conn->get_session<client_session_t>();
+    auto file_id = session->uploads.at(transfer_id).file_id;
 
     /* 上传完成 */
     if (request->stat == common::FRAME_STAT_FINISH)
     {
-      auto res = hot_store_group()->close_write_file(file_id.value(), std::string_view{request->data, request->data_len});
-      if (!res)
-      {
-        LOG_ERROR("close file failed");
-        co_await conn->send_response({.stat = 2}, *request);
-        co_return false;
-      }
-      const auto &[root_path, rel_path] = res.value();
-      push_not_synced_file(rel_path);
-
-      /* 在 rel_path 前加上组号，用于客户端访问文件 */
-      auto rel_path_with_group = std::format("{}/{}", storage_config.server.internal.group_id, rel_path);
-      auto response_to_send = common::create_frame(request->cmd, common::frame_type::response, rel_path_with_group.size());
-      std::copy(rel_path_with_group.begin(), rel_path_with_group.end(), response_to_send->data);
-      co_await conn->send_response(response_to_send, *request);
-
-      new_hot_file(std::format("{}/{}", root_path, rel_path));
-      conn->del_data(conn_data::client_upload_file_id);
-      co_return true;
+      session->uploads.erase(transfer_id);
+      co_return co_await cs_upload_finish(request, conn, file_id, std::string_view{data.data(), data.size()});
     }
 
     /* 上传异常 */
     if (request->stat != common::FRAME_STAT_OK)
     {
       LOG_ERROR("client upload unknown error {}", request->stat);
-      hot_store_group()->close_write_file(file_id.value());
-      conn->del_data(conn_data::client_upload_file_id);
+      co_await hot_store_group()->async_abort_write_file(file_id);
+      session->uploads.erase(transfer_id);
       co_await conn->send_response(*request);
       co_return false;
     }
 
     /* 正常传输的数据 */
-    if (!hot_store_group()->write_file(file_id.value(), std::span{request->data, request->data_len}))
+    if (!co_await hot_store_group()->async_write_file(file_id, data))
     {
+      co_await hot_store_group()->async_abort_write_file(file_id);
+      session->uploads.erase(transfer_id);
       co_await conn->send_response({.stat = 3}, *request);
-      conn->del_data(conn_data::client_upload_file_id);
       co_return false;
     }
 
@@ -95,73 +172,297 @@ namespace storage_detail
     co_return true;
   }
 
-  auto cs_download_start_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
+  auto cs_upload_stream_handle(REQUEST_HANDLE_PARAMS, uint32_t transfer_id, uint32_t seq, std::span<char> data) -> asio::awaitable<bool>
   {
-    if (conn->has_data(conn_data::client_download_file_id) ||
-        conn->has_data(conn_data::client_download_file_size))
+    auto session = conn->get_session<client_session_t>();
+    auto file_id = session->uploads.at(transfer_id).file_id;
+
+    /* 上传完成，此时 seq 为数据块总数 */
+    if (request->stat == common::FRAME_STAT_FINISH)
     {
-      LOG_ERROR("client already request download yield");
-      co_await conn->send_response(common::proto_frame{.stat = 1}, *request);
-      co_return false;
+      /* io_uring 后端时之前的数据块可能仍在写入，等待完成后再检查状态 */
+      co_await hot_store_group()->async_drain_write_file(file_id);
+      auto it = session->uploads.find(transfer_id);
+      if (it == session->uploads.end())
+      {
+        co_return false;
+      }
+      auto &stream = it->second.stream.value();
+
+      auto error_stat = stream.error_stat;
+      if (error_stat == 0 && seq != stream.next_seq)
+      {
+        LOG_ERROR("client upload finish with {} chunks, but {} chunks received", seq, stream.next_seq);
+        error_stat = 4;
+      }
+      session->uploads.erase(transfer_id);
+
+      if (error_stat != 0)
+      {
+        co_await hot_store_group()->async_abort_write_file(file_id);
+        co_await conn->send_response({.stat = error_stat}, *request);
+        co_return false;
+      }
+      co_return co_await cs_upload_finish(request, conn, file_id, {data.data(), data.size()});
     }
 
-    /* 搜索文件 */
-    auto valid_store_group = std::shared_ptr<store_ctx_group>{};
-    auto file_id = 0uz;
-    auto file_size = 0uz;
-    auto abs_path = std::string{};
-    for (auto store_group : store_groups())
+    /* 出错后忽略后续数据块，直到下一次确认时返回错误 */
+    auto &stream = session->uploads.at(transfer_id).stream.value();
+    if (stream.error_stat == 0)
     {
-      if (auto res = store_group->open_read_file({request->data, request->data_len}); res.has_value())
+      if (seq != stream.next_seq)
       {
-        valid_store_group = store_group;
-        std::tie(file_id, file_size, abs_path) = res.value();
-
-        if (is_hot_store_group(store_group))
-        {
-          access_hot_file(abs_path);
-        }
-        else
+        LOG_ERROR("client upload chunk out of order, expect {} but {}", stream.next_seq, seq);
+        stream.error_stat = 4;
+      }
+      else
+      {
+        /* 写入可能让出协程，先推进序号，后续数据块的写入偏移在提交时确定 */
+        ++stream.next_seq;
+        auto ok = co_await hot_store_group()->async_write_file(file_id, data);
+        if (auto it = session->uploads.find(transfer_id); !ok && it != session->uploads.end())
         {
-          access_cold_file(abs_path);
+          it->second.stream->error_stat = 3;
         }
-        break;
       }
     }
 
-    if (!valid_store_group)
+    /* upload 可能在让出协程时被其他请求删除，之后也会让出协程，因此拷贝一份 */
+    auto it = session->uploads.find(transfer_id);
+    if (it == session->uploads.end())
+    {
+      co_return false;
+    }
+    co_return co_await cs_upload_stream_ack(*request, conn, it->second.stream.value(), seq);
+  }
+
+  auto cs_upload_stream_ack(const common::proto_frame &request, common::connection_ptr conn, client_upload_stream_t state, uint32_t seq) -> asio::awaitable<bool>
+  {
+    if ((seq + 1) % state.ack_every != 0)
+    {
+      co_return state.error_stat == 0;
+    }
+
+    /* 累计确认 */
+    auto response_to_send = common::create_frame(request.cmd, common::frame_type::response, sizeof(uint32_t), state.error_stat);
+    *(uint32_t *)response_to_send->data = htonl(state.next_seq);
+    co_await conn->send_response(response_to_send, request);
+    co_return state.error_stat == 0;
+  }
+
+  auto cs_upload_splice(const common::proto_frame &header, std::span<const char> prefix, common::connection_ptr conn) -> std::optional<common::splice_target>
+  {
+    /* 连接可能已经通过 ss_regist 变为 storage，此时会话不再是 client_session_t */
+    auto base = conn->get_session<session_t>();
+    if (!base || base->conn_type != conn_type_t::client)
+    {
+      return std::nullopt;
+    }
+
+    /* 旧版本的上传没有 cs_upload_chunk_header，结束和异常的数据块也交由普通路径处理 */
+    auto session = std::static_pointer_cast<client_session_t>(base);
+    if (header.stat != common::FRAME_STAT_OK || session->uploads.contains(0))
+    {
+      return std::nullopt;
+    }
+
+    auto chunk_header = (const common::cs_upload_chunk_header *)prefix.data();
+    auto transfer_id = ntohl(chunk_header->transfer_id);
+    auto seq = ntohl(chunk_header->seq);
+    auto it = session->uploads.find(transfer_id);
+    if (it == session->uploads.end())
+    {
+      return std::nullopt;
+    }
+
+    /* 乱序或出错后的数据块由普通路径返回错误 */
+    auto &stream = it->second.stream;
+    if (stream && (stream->error_stat != 0 || seq != stream->next_seq))
+    {
+      return std::nullopt;
+    }
+
+    auto target = hot_store_group()->reserve_write(it->second.file_id, header.data_len - prefix.size());
+    if (!target)
+    {
+      return std::nullopt;
+    }
+    if (stream)
+    {
+      ++stream->next_seq;
+    }
+
+    return common::splice_target{
+        .fd = target->first,
+        .offset = (off_t)target->second,
+        .on_done = [header, conn, transfer_id, seq](bool ok)
+        { return cs_upload_spliced(header, conn, transfer_id, seq, ok); },
+        .write = [file_id = it->second.file_id](std::function<bool()> write)
+        { return hot_store_group()->async_run_write(file_id, std::move(write)); },
+    };
+  }
+
+  auto cs_upload_spliced(common::proto_frame request, common::connection_ptr conn, uint32_t transfer_id, uint32_t seq, bool ok) -> asio::awaitable<void>
+  {
+    /* 写入失败时连接会被关闭，由 on_client_disconnect 关闭文件 */
+    auto base = conn->get_session<session_t>();
+    if (!ok || !base || base->conn_type != conn_type_t::client)
+    {
+      co_return;
+    }
+    auto session = std::static_pointer_cast<client_session_t>(base);
+    auto it = session->uploads.find(transfer_id);
+    if (it == session->uploads.end())
+    {
+      co_return;
+    }
+
+    if (it->second.stream)
+    {
+      co_await cs_upload_stream_ack(request, conn, it->second.stream.value(), seq);
+      co_return;
+    }
+    co_await conn->send_response(request);
+  }
+
+  auto cs_upload_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
+  {
+    auto session = conn->get_session<client_session_t>();
+    if (session->uploads.empty())
+    {
+      LOG_ERROR("client not start upload yield");
+      co_await conn->send_response({.stat = 1}, *request);
+      co_return false;
+    }
+
+    /* 旧版本的上传不携带 cs_upload_chunk_header */
+    auto transfer_id = 0u;
+    auto seq = 0u;
+    auto data = std::span{request->data, request->data_len};
+    if (!session->uploads.contains(0))
+    {
+      if (data.size() < sizeof(common::cs_upload_chunk_header))
+      {
+        LOG_ERROR("cs_upload request data_len invalid");
+        co_await conn->send_response({.stat = 4}, *request);
+        co_return false;
+      }
+
+      auto header = (common::cs_upload_chunk_header *)request->data;
+      transfer_id = ntohl(header->transfer_id);
+      seq = ntohl(header->seq);
+      data = data.subspan(sizeof(common::cs_upload_chunk_header));
+    }
+
+    auto it = session->uploads.find(transfer_id);
+    if (it == session->uploads.end())
+    {
+      LOG_ERROR("client not start upload {} yield", transfer_id);
+      co_await conn->send_response({.stat = 1}, *request);
+      co_return false;
+    }
+
+    if (it->second.stream)
+    {
+      co_return co_await cs_upload_stream_handle(request, conn, transfer_id, seq, data);
+    }
+    co_return co_await cs_upload_normal_handle(request, conn, transfer_id, data);
+  }
+
+  auto cs_download_start_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
+  {
+    /* 旧版本的 cs_download 不携带 transfer_id，因此优先分配 0 */
+    auto session = conn->get_session<client_session_t>();
+    auto transfer_id = session->downloads.contains(0) ? alloc_transfer_id(*session) : std::optional{0u};
+    if (!transfer_id)
+    {
+      LOG_ERROR("client {} has too many transfers", conn->address());
+      co_await conn->send_response(common::proto_frame{.stat = 1}, *request);
+      co_return false;
+    }
+
+    /* 同一文件的并发下载共享一次查找和打开的 fd，每个下载以独立的 file_id 维护自己的偏移 */
+    auto rel_path = std::string_view{request->data, request->data_len};
+    auto shared = co_await open_download_file(rel_path);
+    auto file_id = shared ? shared->store_group->share_read_file(shared->file_id) : std::nullopt;
+    if (!file_id)
     {
-      LOG_ERROR(std::format("not find file {}", std::string_view{request->data, request->data_len}));
+      LOG_ERROR(std::format("not find file {}", rel_path));
       co_await conn->send_response(common::proto_frame{.stat = 2}, *request);
       co_return false;
     }
 
-    if (file_size <= storage_config.performance.zero_copy_limit * 1_MB)
+    /* 热点文件的访问时间每秒只记录一次，冷文件每次访问都计入升温次数 */
+    auto valid_store_group = shared->store_group;
+    auto file_size = shared->file_size;
+    auto abs_path = shared->abs_path;
+    if (is_hot_store_group(valid_store_group))
     {
-      conn->set_data<client_download_file_path_t>(conn_data::client_download_file_path, abs_path);
-      conn->set_data<client_download_file_size_t>(conn_data::client_download_file_size, file_size);
+      if (touch_download_file(*shared))
+      {
+        access_hot_file(abs_path);
+      }
     }
     else
     {
-      conn->set_data<client_download_file_id_t>(conn_data::client_download_file_id, file_id);
-      conn->set_data<client_download_store_group_t>(conn_data::client_download_store_group, valid_store_group);
+      access_cold_file(abs_path);
+    }
+
+    /* zero_copy_limit 为 0 时关闭零拷贝下载，协商了压缩时读到内存中压缩发送 */
+    session->downloads[transfer_id.value()] = {
+        .store_group = valid_store_group,
+        .file_id = file_id.value(),
+        .abs_path = abs_path,
+        .file_size = file_size,
+        .zero_copy = storage_config.performance.zero_copy_limit != 0 && !conn->compresses(file_size),
+        .shared = shared,
+    };
+
+    /* 协商了校验时携带文件的 crc32c，由客户端校验下载的数据 */
+    auto crc = std::optional<uint32_t>{};
+    if (conn->capabilities().has(common::CAP_CHECKSUM_CRC32C))
+    {
+      crc = shared->crc;
+      if (!crc)
+      {
+        crc = co_await valid_store_group->async_file_crc32c(abs_path);
+      }
     }
 
-    auto response_to_send = common::create_frame(request->cmd, common::frame_type::response, sizeof(uint64_t));
+    auto response_to_send = common::create_frame(request->cmd, common::frame_type::response, sizeof(uint64_t) + sizeof(uint32_t) + (crc ? sizeof(uint32_t) : 0));
     *(uint64_t *)response_to_send->data = common::htonll(file_size);
+    *(uint32_t *)(response_to_send->data + sizeof(uint64_t)) = htonl(transfer_id.value());
+    if (crc)
+    {
+      *(uint32_t *)(response_to_send->data + sizeof(uint64_t) + sizeof(uint32_t)) = htonl(crc.value());
+    }
     co_return co_await conn->send_response(response_to_send, *request);
   }
 
   auto cs_download_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
   {
+    auto transfer_id = request->data_len >= sizeof(uint32_t) ? ntohl(*(uint32_t *)request->data) : 0u;
+    auto session = conn->get_session<client_session_t>();
+    auto it = session->downloads.find(transfer_id);
+    if (it == session->downloads.end())
+    {
+      LOG_ERROR("client not start download {} yield", transfer_id);
+      co_await conn->send_response({.stat = 2}, *request);
+      co_return false;
+    }
+
     /* 普通下载 */
-    if (auto file_id = conn->get_data<client_download_file_id_t>(conn_data::client_download_file_id))
+    if (auto store_group = it->second.store_group; !it->second.zero_copy)
     {
-      auto store_group = conn->get_data<client_download_store_group_t>(conn_data::client_download_store_group).value();
-      auto response_to_send = common::create_frame(request->cmd, common::frame_type::response, 5_MB);
-      auto read_len = store_group->read_file(file_id.value(), response_to_send->data, 5_MB);
+      /* 数据块大小优先使用握手时协商的值 */
+      auto file_id = it->second.file_id;
+      auto chunk_size = conn->capabilities().chunk_size != 0 ? conn->capabilities().chunk_size : (uint32_t)5_MB;
+      auto response_to_send = common::create_frame(request->cmd, common::frame_type::response, chunk_size);
+      auto read_len = co_await store_group->async_read_file(file_id, response_to_send->data, chunk_size);
       if (!read_len.has_value())
       {
+        store_group->close_read_file(file_id);
+        session->downloads.erase(transfer_id);
         co_await conn->send_response({.stat = 1}, *request);
         co_return false;
       }
@@ -170,53 +471,42 @@ namespace storage_detail
       {
         response_to_send->data_len = (uint32_t)read_len.value();
         response_to_send->stat = common::FRAME_STAT_FINISH;
+        store_group->close_read_file(file_id);
+        session->downloads.erase(transfer_id);
       }
       co_return co_await conn->send_response(response_to_send, *request);
     }
 
-    /* 零拷贝优化 */
-    if (auto abs_path = conn->get_data<client_download_file_path_t>(conn_data::client_download_file_path))
+    /* 零拷贝下载，每个请求通过 sendfile 发送一段，文件大小不受 frame 长度的限制 */
+    auto download = it->second;
+    auto segment = zero_copy_segment_size(*conn);
+    auto target = download.store_group->reserve_read(download.file_id, segment);
+    if (!target)
     {
-      auto file_fd = open(abs_path->data(), O_RDONLY);
-      if (file_fd < 0)
-      {
-        LOG_ERROR("open file {} failed, {}", abs_path.value(), strerror(errno));
-        co_return false;
-      }
-
-      auto file_size = conn->get_data<client_download_file_size_t>(conn_data::client_download_file_size).value();
-      if (!co_await conn->send_response_without_data({.stat = common::FRAME_STAT_FINISH, .data_len = (uint32_t)file_size}, *request))
-      {
-        co_return false;
-      }
+      download.store_group->close_read_file(download.file_id);
+      session->downloads.erase(it);
+      co_await conn->send_response({.stat = 1}, *request);
+      co_return false;
+    }
 
-      auto rest_to_send = file_size;
-      auto offset = off_t{0};
-      while (rest_to_send > 0)
-      {
-        auto n = sendfile(conn->native_socket(), file_fd, &offset, rest_to_send);
-        if (-1 == n)
-        {
-          if (errno == EAGAIN || errno == EINTR)
-          {
-            co_await asio::post(asio::use_awaitable);
-            continue;
-          }
-
-          LOG_CRITICAL("sendfile {} failed, {}", abs_path.value(), strerror(errno));
-          co_await conn->close();
-          break;
-        }
+    auto [file_fd, offset, len, finish] = target.value();
 
-        rest_to_send -= n;
-        LOG_DEBUG("sendfile {} bytes, rest to send {} bytes", n, rest_to_send);
-      }
-      co_return true;
+    /* 发送当前段的同时预读下一段。发送按请求的顺序进行，结束段之前的段都已发送完成，因此可以在结束后关闭文件 */
+    if (!finish)
+    {
+      posix_fadvise(file_fd, offset + len, segment, POSIX_FADV_WILLNEED);
     }
-
-    LOG_ERROR("client not start download yield");
-    co_await conn->send_response({.stat = 2}, *request);
-    co_return false;
+    auto ok = co_await conn->send_response_with_file({.stat = finish ? common::FRAME_STAT_FINISH : common::FRAME_STAT_OK, .data_len = (uint32_t)len}, *request, file_fd, offset);
+    if (finish || !ok)
+    {
+      download.store_group->close_read_file(download.file_id);
+      session->downloads.erase(transfer_id);
+    }
+    if (!ok)
+    {
+      LOG_ERROR("sendfile {} failed", download.abs_path);
+    }
+    co_return ok;
   }
 
 } // namespace storage_detail
@@ -228,7 +518,11 @@ namespace storage
 
   auto regist_client(std::shared_ptr<common::connection> conn) -> void
   {
-    conn->set_data<conn_type_t>(conn_data::conn_type, conn_type_t::client);
+    conn->set_session(std::make_shared<client_session_t>());
+    if (storage_config.performance.splice_recv)
+    {
+      conn->set_splice_selector({{common::proto_cmd::cs_upload, sizeof(common::cs_upload_chunk_header)}}, cs_upload_splice);
+    }
     auto lock = std::unique_lock{client_conns_mut};
     client_conns.emplace(conn);
   }
@@ -242,16 +536,29 @@ namespace storage
   auto on_client_disconnect(common::connection_ptr conn) -> asio::awaitable<void>
   {
     unregist_client(conn);
+
+    /* 关闭未完成的传输 */
+    auto session = conn->get_session<client_session_t>();
+    for (const auto &[_, upload] : session->uploads)
+    {
+      co_await hot_store_group()->async_abort_write_file(upload.file_id);
+    }
+    for (const auto &[_, download] : session->downloads)
+    {
+      download.store_group->close_read_file(download.file_id);
+    }
+    session->uploads.clear();
+    session->downloads.clear();
+
     LOG_INFO("client {} disconnect", conn->address());
     co_return;
   }
 
   auto request_from_client(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
   {
-    auto it = client_request_handles.find(request->cmd);
-    if (it != client_request_handles.end())
+    if (auto handle = common::find_handle(client_request_handles, request->cmd))
     {
-      co_return co_await it->second(request, conn);
+      co_return co_await handle(request, conn);
     }
     LOG_ERROR("unknown request {} from client {}", *request, conn->address());
     co_return false;
@@ -8,21 +8,69 @@ namespace storage_detail
 
   using namespace storage;
 
+  /* 每个 client 连接同时进行的传输数量上限 */
+  constexpr auto max_client_transfers = 256uz;
+
+  /**
+   * @brief 分配非 0 的 transfer_id
+   *
+   * @return 传输数量达到上限时返回 std::nullopt
+   */
+  auto alloc_transfer_id(client_session_t &session) -> std::optional<uint32_t>;
+
   auto cs_upload_start_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>;
 
   auto cs_upload_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>;
 
+  /**
+   * @brief 结束上传，重命名文件并响应 rel_path
+   *
+   */
+  auto cs_upload_finish(REQUEST_HANDLE_PARAMS, uint64_t file_id, std::string_view user_file_name) -> asio::awaitable<bool>;
+
+  /**
+   * @brief upload_mode::normal 的数据块，每个数据块都响应
+   *
+   */
+  auto cs_upload_normal_handle(REQUEST_HANDLE_PARAMS, uint32_t transfer_id, std::span<char> data) -> asio::awaitable<bool>;
+
+  /**
+   * @brief upload_mode::stream 的数据块，按序号检查顺序并累计确认
+   *
+   */
+  auto cs_upload_stream_handle(REQUEST_HANDLE_PARAMS, uint32_t transfer_id, uint32_t seq, std::span<char> data) -> asio::awaitable<bool>;
+
+  /**
+   * @brief upload_mode::stream 的数据块写入后，每 ack_every 个数据块累计确认一次
+   *
+   * @param state 之前会让出协程，upload 可能已被删除，因此传入拷贝
+   */
+  auto cs_upload_stream_ack(const common::proto_frame &request, common::connection_ptr conn, client_upload_stream_t state, uint32_t seq) -> asio::awaitable<bool>;
+
+  /**
+   * @brief 选择 cs_upload 数据块零拷贝接收的目标文件，只接收通过 cs_upload_start_request 开始且顺序正确的数据块
+   *
+   */
+  auto cs_upload_splice(const common::proto_frame &header, std::span<const char> prefix, common::connection_ptr conn) -> std::optional<common::splice_target>;
+
+  /**
+   * @brief 零拷贝接收的数据块写入文件后，按上传模式响应
+   *
+   */
+  auto cs_upload_spliced(common::proto_frame request, common::connection_ptr conn, uint32_t transfer_id, uint32_t seq, bool ok) -> asio::awaitable<void>;
+
   auto cs_download_start_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>;
 
   auto cs_download_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>;
 
-  inline auto client_request_handles = std::map<common::proto_cmd, request_handle_t>{
-      {common::proto_cmd::ss_regist, ss_regist_handle},
+  /* 同组 storage 的 ss_regist 是连接上的第一个请求，此时仍按 client 处理 */
+  inline constexpr auto client_request_handles = common::make_dispatch_table({
+      {common::proto_cmd::ss_regist, common::typed_handle<common::proto_cmd::ss_regist, ss_regist_handle>},
       {common::proto_cmd::cs_upload_start, cs_upload_start_handle},
       {common::proto_cmd::cs_upload, cs_upload_handle},
       {common::proto_cmd::cs_download_start, cs_download_start_handle},
       {common::proto_cmd::cs_download, cs_download_handle},
-  };
+  });
 
   inline auto client_conns = std::set<std::shared_ptr<common::connection>>{};
 
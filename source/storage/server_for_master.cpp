@@ -14,8 +14,7 @@ namespace storage_detail
 
   auto ms_get_max_free_space_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
   {
-    auto response = std::shared_ptr<common::proto_frame>{(common::proto_frame *)malloc(sizeof(common::proto_frame) + sizeof(uint64_t)), free};
-    *response = {.data_len = sizeof(uint64_t)};
+    auto response = common::create_frame(request->cmd, common::frame_type::response, sizeof(uint64_t));
     *(uint64_t *)response->data = common::ntohll(hot_store_group()->max_free_space());
     co_await conn->send_response(response, *request);
     co_return true;
@@ -24,8 +23,7 @@ namespace storage_detail
   auto ms_get_metrics_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
   {
     auto s = common::get_metrics().dump();
-    auto response = std::shared_ptr<common::proto_frame>{(common::proto_frame *)malloc(sizeof(common::proto_frame) + s.size()), free};
-    *response = {.data_len = (uint32_t)s.size()};
+    auto response = common::create_frame(request->cmd, common::frame_type::response, s.size());
     std::copy(s.begin(), s.end(), response->data);
     co_await conn->send_response(response, *request);
     co_return true;
@@ -51,8 +49,8 @@ namespace storage
       master_conn_ = co_await common::connection::connect_to(storage_config.server.master_ip, storage_config.server.master_port);
       if (master_conn_)
       {
+        master_conn_->set_session(std::make_shared<master_session_t>());
         master_conn_->start(request_from_connection);
-        master_conn_->set_data<conn_type_t>(conn_data::conn_type, conn_type_t::master);
         break;
       }
       LOG_ERROR(std::format("connect to master {}:{} failed", storage_config.server.master_ip, storage_config.server.master_port));
@@ -103,9 +101,9 @@ namespace storage
 
   auto request_from_master(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
   {
-    if (auto it = master_request_handles.find(request->cmd); it != master_request_handles.end())
+    if (auto handle = common::find_handle(master_request_handles, request->cmd))
     {
-      co_return co_await it->second(request, conn);
+      co_return co_await handle(request, conn);
     }
     LOG_ERROR("invalid request {} from master {}", *request, conn->address());
     co_return false;
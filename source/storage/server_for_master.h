@@ -1,5 +1,6 @@
 #pragma once
 #include "server_util.h"
+#include <common/dispatch.h>
 
 namespace storage_detail
 {
@@ -10,10 +11,10 @@ namespace storage_detail
 
   auto ms_get_metrics_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>;
 
-  inline auto master_request_handles = std::map<common::proto_cmd, request_handle_t>{
+  inline constexpr auto master_request_handles = common::make_dispatch_table({
       {common::proto_cmd::ms_get_max_free_space, ms_get_max_free_space_handle},
       {common::proto_cmd::ms_get_metrics, ms_get_metrics_handle},
-  };
+  });
 
   inline auto master_conn_ = common::connection_ptr{};
 
@@ -1,11 +1,13 @@
 #include "server_for_storage.h"
 #include "config.h"
+#include "durability.h"
 #include "migrate.h"
 #include "server.h"
 #include "server_for_client.h"
 #include "store_util.h"
 #include <common/connection.h>
 #include <common/util.h>
+#include <filesystem>
 #include <proto.pb.h>
 
 namespace storage_detail
@@ -13,16 +15,8 @@ namespace storage_detail
 
   using namespace storage;
 
-  auto ss_regist_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
+  auto ss_regist_handle(REQUEST_HANDLE_PARAMS, proto::ss_regist_request request_data_recved) -> asio::awaitable<bool>
   {
-    auto request_data_recved = proto::ss_regist_request{};
-    if (!request_data_recved.ParseFromArray(request->data, request->data_len))
-    {
-      LOG_ERROR(std::format("parse ss_regist_request failed"));
-      co_await conn->send_response(common::proto_frame{.stat = 1}, *request);
-      co_return false;
-    }
-
     if (request_data_recved.master_magic() != storage_config.server.master_magic ||
         request_data_recved.storage_magic() != storage_config.server.internal.storage_magic)
     {
@@ -41,22 +35,26 @@ namespace storage_detail
 
   auto ss_upload_sync_start_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
   {
-    if (conn->has_data(conn_data::storage_sync_upload_file_id))
+    auto session = conn->get_session<storage_session_t>();
+    if (session->sync_upload_file_id)
     {
       LOG_ERROR("storage already request sync upload yield");
       co_await conn->send_response(common::proto_frame{.stat = 1}, *request);
       co_return false;
     }
 
-    if (request->data_len <= sizeof(uint64_t))
+    /* 协商了校验时 filesize 后携带 uint32 crc32c */
+    auto with_crc = conn->capabilities().has(common::CAP_CHECKSUM_CRC32C);
+    auto header_len = sizeof(uint64_t) + (with_crc ? sizeof(uint32_t) : 0);
+    if (request->data_len <= header_len)
     {
       LOG_ERROR("ss_upload_sync_start request data_len invalid");
       co_await conn->send_response(common::proto_frame{.stat = 2}, *request);
       co_return false;
     }
 
-    auto rel_path = std::string_view{request->data + sizeof(uint64_t), request->data_len - sizeof(uint64_t)};
-    auto file_id = hot_store_group()->create_file(common::ntohll(*(uint64_t *)request->data), rel_path);
+    auto rel_path = std::string_view{request->data + header_len, request->data_len - header_len};
+    auto file_id = co_await hot_store_group()->async_create_file(common::ntohll(*(uint64_t *)request->data), rel_path);
     if (!file_id)
     {
       LOG_ERROR(std::format("create file '{}' failed", rel_path));
@@ -64,14 +62,20 @@ namespace storage_detail
       co_return false;
     }
 
-    conn->set_data<storage_sync_upload_file_id_t>(conn_data::storage_sync_upload_file_id, file_id.value());
+    session->sync_upload_file_id = file_id;
+    session->sync_upload_crc32c.reset();
+    if (with_crc)
+    {
+      session->sync_upload_crc32c = ntohl(*(uint32_t *)(request->data + sizeof(uint64_t)));
+    }
     co_await conn->send_response(common::proto_frame{.stat = 0}, *request);
     co_return true;
   }
 
   auto ss_upload_sync_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>
   {
-    auto file_id = conn->get_data<storage_sync_upload_file_id_t>(conn_data::storage_sync_upload_file_id);
+    auto session = conn->get_session<storage_session_t>();
+    auto file_id = session->sync_upload_file_id;
     if (!file_id.has_value())
     {
       LOG_ERROR("storage not request sync upload yield");
@@ -79,12 +83,21 @@ namespace storage_detail
       co_return false;
     }
 
-    /* 结束同步 */
+    /* 结束同步，零拷贝同步时结束帧携带最后一段数据 */
     if (request->data_len == 0 || request->stat == 255)
     {
-      conn->del_data(conn_data::storage_sync_upload_file_id);
+      session->sync_upload_file_id.reset();
+      auto expected_crc = std::exchange(session->sync_upload_crc32c, std::nullopt);
+
+      if (request->data_len != 0 && !co_await hot_store_group()->async_write_file(file_id.value(), std::span{request->data, request->data_len}))
+      {
+        co_await hot_store_group()->async_abort_write_file(file_id.value());
+        co_await conn->send_response(common::proto_frame{.stat = 3}, *request);
+        co_return false;
+      }
 
-      auto res = hot_store_group()->close_write_file(file_id.value());
+      auto actual_crc = hot_store_group()->write_crc32c(file_id.value());
+      auto res = co_await hot_store_group()->async_close_write_file(file_id.value());
       if (!res)
       {
         co_await conn->send_response(common::proto_frame{.stat = 2}, *request);
@@ -92,16 +105,38 @@ namespace storage_detail
       }
       const auto &[root_path, rel_path] = res.value();
 
+      /* 零拷贝接收的数据没有经过用户态，读取文件计算 */
+      if (expected_crc && !actual_crc)
+      {
+        actual_crc = co_await hot_store_group()->async_file_crc32c(std::format("{}/{}", root_path, rel_path));
+      }
+
+      if (expected_crc && actual_crc != expected_crc)
+      {
+        LOG_ERROR(std::format("sync file {} from {} crc32c mismatch, expected {:08x}, actual {:08x}", rel_path, conn->address(), expected_crc.value(), actual_crc.value_or(0)));
+        hot_store_group()->remove_file(std::format("{}/{}", root_path, rel_path));
+        co_await conn->send_response(common::proto_frame{.stat = 4}, *request);
+        co_return false;
+      }
+
+      if (!co_await make_durable(hot_store_group()->physical_path(std::format("{}/{}", root_path, rel_path))))
+      {
+        hot_store_group()->remove_file(std::format("{}/{}", root_path, rel_path));
+        co_await conn->send_response(common::proto_frame{.stat = 2}, *request);
+        co_return false;
+      }
+
       co_await conn->send_response(common::proto_frame{.stat = 0}, *request);
       new_hot_file(std::format("{}/{}", root_path, rel_path));
       LOG_INFO("sync file {} suc from {}", rel_path, conn->address());
       co_return true;
     }
 
-    if (!hot_store_group()->write_file(file_id.value(), std::span{request->data, request->data_len}))
+    if (!co_await hot_store_group()->async_write_file(file_id.value(), std::span{request->data, request->data_len}))
     {
       co_await conn->send_response(common::proto_frame{.stat = 3}, *request);
-      conn->del_data(conn_data::storage_sync_upload_file_id);
+      session->sync_upload_file_id.reset();
+      session->sync_upload_crc32c.reset();
       co_return false;
     }
 
@@ -109,6 +144,48 @@ namespace storage_detail
     co_return true;
   }
 
+  auto ss_upload_sync_splice(const common::proto_frame &header, std::span<const char> prefix, common::connection_ptr conn) -> std::optional<common::splice_target>
+  {
+    auto session = conn->get_session<storage_session_t>();
+    if (!session->sync_upload_file_id)
+    {
+      return std::nullopt;
+    }
+
+    auto target = hot_store_group()->reserve_write(session->sync_upload_file_id.value(), header.data_len);
+    if (!target)
+    {
+      return std::nullopt;
+    }
+
+    return common::splice_target{
+        .fd = target->first,
+        .offset = (off_t)target->second,
+        .on_done = [header, conn](bool ok)
+        { return ss_upload_sync_spliced(header, conn, ok); },
+        .write = [file_id = session->sync_upload_file_id.value()](std::function<bool()> write)
+        { return hot_store_group()->async_run_write(file_id, std::move(write)); },
+    };
+  }
+
+  auto ss_upload_sync_spliced(common::proto_frame request, common::connection_ptr conn, bool ok) -> asio::awaitable<void>
+  {
+    /* 写入失败时连接会被关闭，由 on_storage_disconnect 关闭文件 */
+    if (!ok)
+    {
+      co_return;
+    }
+
+    if (request.stat == common::FRAME_STAT_FINISH)
+    {
+      auto finish = std::make_shared<common::proto_frame>(request);
+      finish->data_len = 0;
+      co_await ss_upload_sync_handle(finish, conn);
+      co_return;
+    }
+    co_await conn->send_response(request);
+  }
+
   auto regist_to_storages(const proto::sm_regist_response &info) -> asio::awaitable<void>
   {
     for (const auto &s_info : info.s_infos())
@@ -119,6 +196,8 @@ namespace storage_detail
         LOG_ERROR(std::format("connect to storage {}:{} failed", s_info.ip(), s_info.port()));
         continue;
       }
+      /* 会话在 start 之前设置，注册完成前的断开也由 on_storage_disconnect 处理 */
+      s_conn->set_session(std::make_shared<storage_session_t>());
       s_conn->start(request_from_connection);
       LOG_INFO(std::format("connect to storage {}:{} suc", s_info.ip(), s_info.port()));
 
@@ -135,6 +214,7 @@ namespace storage_detail
         LOG_ERROR("regist to storage {}:{} failed {}, with master magic 0x{:X}, storage magic 0x{:X}",
                   s_info.ip(), s_info.port(), response ? response->stat : -1, storage_config.server.master_magic,
                   s_info.magic());
+        co_await s_conn->close();
         continue;
       }
 
@@ -153,7 +233,9 @@ namespace storage
   auto regist_storage(std::shared_ptr<common::connection> conn) -> void
   {
     unregist_client(conn);
-    conn->set_data<conn_type_t>(conn_data::conn_type, conn_type_t::storage);
+    conn->set_session(std::make_shared<storage_session_t>());
+    conn->set_splice_selector(storage_config.performance.splice_recv ? std::map<common::proto_cmd, uint32_t>{{common::proto_cmd::ss_upload_sync, 0}} : std::map<common::proto_cmd, uint32_t>{},
+                              ss_upload_sync_splice);
     auto lock = std::unique_lock{storage_conns_mut};
     storage_conns.emplace(conn);
   }
@@ -174,15 +256,21 @@ namespace storage
   {
     unregist_storage(conn);
     LOG_ERROR("storage {} disconnect", conn->address());
+
+    /* 关闭未完成的同步 */
+    auto session = conn->get_session<storage_session_t>();
+    if (session->sync_upload_file_id)
+    {
+      co_await hot_store_group()->async_abort_write_file(session->sync_upload_file_id.value());
+    }
     co_return;
   }
 
   auto request_from_storage(std::shared_ptr<common::proto_frame> request, std::shared_ptr<common::connection> conn) -> asio::awaitable<bool>
   {
-    auto it = storage_request_handles.find(request->cmd);
-    if (it != storage_request_handles.end())
+    if (auto handle = common::find_handle(storage_request_handles, request->cmd))
     {
-      co_return co_await it->second(request, conn);
+      co_return co_await handle(request, conn);
     }
     LOG_ERROR("unknown request {} from storage {}", *request, conn->address());
     co_return false;
@@ -1,28 +1,46 @@
 #pragma once
 
 #include "server_util.h"
+#include <common/dispatch.h>
 #include <proto.pb.h>
 #include <set>
 
+template <>
+struct common::request_payload<common::proto_cmd::ss_regist> : common::proto_payload<proto::ss_regist_request>
+{
+};
+
 namespace storage_detail
 {
 
   using namespace storage;
 
-  auto ss_regist_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>;
+  auto ss_regist_handle(REQUEST_HANDLE_PARAMS, proto::ss_regist_request request_data_recved) -> asio::awaitable<bool>;
 
   auto ss_upload_sync_start_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>;
 
   auto ss_upload_sync_handle(REQUEST_HANDLE_PARAMS) -> asio::awaitable<bool>;
 
+  /**
+   * @brief 选择 ss_upload_sync 数据零拷贝接收的目标文件，包括携带最后一段数据的结束帧
+   *
+   */
+  auto ss_upload_sync_splice(const common::proto_frame &header, std::span<const char> prefix, common::connection_ptr conn) -> std::optional<common::splice_target>;
+
+  /**
+   * @brief 零拷贝接收的数据写入文件后响应，结束帧按 payload 为空的结束帧处理
+   *
+   */
+  auto ss_upload_sync_spliced(common::proto_frame request, common::connection_ptr conn, bool ok) -> asio::awaitable<void>;
+
   inline auto storage_conns = std::set<std::shared_ptr<common::connection>>{};
 
   inline auto storage_conns_mut = std::mutex{};
 
-  inline auto storage_request_handles = std::map<common::proto_cmd, request_handle_t>{
+  inline constexpr auto storage_request_handles = common::make_dispatch_table({
       {common::proto_cmd::ss_upload_sync_start, ss_upload_sync_start_handle},
       {common::proto_cmd::ss_upload_sync, ss_upload_sync_handle},
-  };
+  });
 
   /**
    * @brief 注册到其它 storage
@@ -1,9 +1,13 @@
 #pragma once
 
+#include "config.h"
+#include "download_cache.h"
 #include "store.h"
 #include <common/connection.h>
 #include <cstdint>
+#include <optional>
 #include <string>
+#include <unordered_map>
 
 namespace storage
 {
@@ -20,34 +24,115 @@ namespace storage
   };
 
   /**
-   * @brief 连接需要的额外数据
+   * @brief upload_mode::stream 上传的状态
    *
+   * @param ack_every   每 ack_every 个数据块确认一次
+   * @param next_seq    期望的下一个数据块序号，也是已写入的数据块数量
+   * @param error_stat  出错后不再写入数据，并在下一次确认时返回该状态
    */
-  enum conn_data : uint64_t
+  struct client_upload_stream_t
   {
-    conn_type,
+    uint32_t ack_every;
+    uint32_t next_seq;
+    uint8_t error_stat;
+  };
+
+  /**
+   * @brief 进行中的上传
+   *
+   * @param file_id   写入的文件
+   * @param stream    upload_mode::stream 的状态，upload_mode::normal 时为空
+   */
+  struct client_upload_t
+  {
+    uint64_t file_id;
+    std::optional<client_upload_stream_t> stream;
+  };
+
+  /**
+   * @brief 进行中的下载
+   *
+   * @param store_group   文件所在的 store_group
+   * @param file_id       打开的文件
+   * @param abs_path      文件路径
+   * @param file_size     文件大小
+   * @param zero_copy     每次请求通过 sendfile 发送一段，否则读取到内存中发送
+   * @param shared        共享的打开文件，下载期间保持 fd 打开
+   */
+  struct client_download_t
+  {
+    std::shared_ptr<store_ctx_group> store_group;
+    uint64_t file_id;
+    std::string abs_path;
+    uint64_t file_size;
+    bool zero_copy;
+    std::shared_ptr<download_file_t> shared;
+  };
+
+  /**
+   * @brief storage 上所有连接的会话基类
+   *
+   */
+  struct session_t : common::session
+  {
+    explicit session_t(conn_type_t type) : conn_type{type} {}
+
+    const conn_type_t conn_type;
+  };
 
-    client_upload_file_id,
+  /**
+   * @brief client 连接的会话，按 transfer_id 索引进行中的上传和下载
+   *
+   * transfer_id 为 0 的上传和下载留给旧版本的请求，其 frame 中不携带 transfer_id
+   *
+   * @param next_transfer_id  下一个分配的 transfer_id，上传和下载共用
+   */
+  struct client_session_t : session_t
+  {
+    client_session_t() : session_t{conn_type_t::client} {}
 
-    /* 普通分块下载 */
-    client_download_file_id,
-    client_download_store_group,
+    uint32_t next_transfer_id = 1;
+    std::unordered_map<uint32_t, client_upload_t> uploads;
+    std::unordered_map<uint32_t, client_download_t> downloads;
+  };
+
+  /**
+   * @brief 同组 storage 连接的会话
+   *
+   * @param sync_upload_file_id   对端正在同步到本机的文件
+   * @param sync_upload_crc32c    对端提供的同步文件 CRC32C，未协商校验时为空
+   */
+  struct storage_session_t : session_t
+  {
+    storage_session_t() : session_t{conn_type_t::storage} {}
 
-    /* 零拷贝下载 */
-    client_download_file_path,
-    client_download_file_size,
+    std::optional<uint64_t> sync_upload_file_id;
+    std::optional<uint32_t> sync_upload_crc32c;
+  };
 
-    storage_sync_upload_file_id,
+  /**
+   * @brief master 连接的会话
+   *
+   */
+  struct master_session_t : session_t
+  {
+    master_session_t() : session_t{conn_type_t::master} {}
   };
 
-  using client_upload_file_id_t = uint64_t;
-  using client_download_file_id_t = uint64_t;
-  using client_download_store_group_t = std::shared_ptr<store_ctx_group>;
-  using client_download_file_path_t = std::string;
-  using client_download_file_size_t = uint64_t;
-  using storage_sync_upload_file_id_t = uint64_t;
+  /**
+   * @brief 零拷贝发送时每个 frame 的数据长度，不超过 zero_copy_limit 和对端能接收的最大 payload
+   *
+   */
+  inline auto zero_copy_segment_size(common::connection &conn) -> uint64_t
+  {
+    auto segment = uint64_t{storage_config.performance.zero_copy_limit} * 1024 * 1024;
+    if (auto max_frame_len = conn.capabilities().max_frame_len; max_frame_len != 0)
+    {
+      segment = std::min<uint64_t>(segment, max_frame_len);
+    }
+    return segment;
+  }
 
-  using request_handle_t = std::function<asio::awaitable<bool>(common::proto_frame_ptr, common::connection_ptr)>;
 #define REQUEST_HANDLE_PARAMS common::proto_frame_ptr request, common::connection_ptr conn
 
 } // namespace storage
\ No newline at end of file
@@ -1,29 +1,234 @@
 
+#include "config.h"
 #include "store.h"
+#include <common/crc32c.h>
 #include <common/log.h>
 #include <common/util.h>
+#include <charconv>
+#include <exception>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
 #include <mutex>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <thread>
+#include <unistd.h>
 
-namespace storage
+namespace storage_detail
 {
 
-  store_ctx::store_ctx(std::string_view root_path)
-      : m_root_path{root_path}
+  /* O_DIRECT 要求的缓冲区地址、偏移和长度的对齐 */
+  constexpr auto direct_io_align = 4096uz;
+
+  /* O_DIRECT 缓冲区大小，也是每次通过 direct_fd 写入的长度 */
+  constexpr auto direct_io_buffer_size = 4uz * 1024 * 1024;
+
+  /* 缓存的 O_DIRECT 缓冲区数量上限 */
+  constexpr auto direct_io_buffer_cached = 16uz;
+
+  auto direct_buffers = std::vector<char *>{};
+  auto direct_buffers_mut = std::mutex{};
+
+  /**
+   * @brief 分配对齐的 O_DIRECT 缓冲区，优先使用缓存
+   *
+   */
+  auto alloc_direct_buffer() -> char *
   {
-    LOG_INFO(std::format("start init store '{}'", root_path));
-    std::filesystem::create_directories(root_path);
+    {
+      auto lock = std::unique_lock{direct_buffers_mut};
+      if (!direct_buffers.empty())
+      {
+        auto buffer = direct_buffers.back();
+        direct_buffers.pop_back();
+        return buffer;
+      }
+    }
+    return (char *)std::aligned_alloc(direct_io_align, direct_io_buffer_size);
+  }
 
-    for (auto i = 0; i < 256; i++)
+  /**
+   * @brief 归还 O_DIRECT 缓冲区，缓存已满时直接释放
+   *
+   */
+  auto free_direct_buffer(char *buffer) -> void
+  {
+    if (buffer == nullptr)
     {
-      for (auto j = 0; j < 256; ++j)
+      return;
+    }
+
+    {
+      auto lock = std::unique_lock{direct_buffers_mut};
+      if (direct_buffers.size() < direct_io_buffer_cached)
+      {
+        direct_buffers.push_back(buffer);
+        return;
+      }
+    }
+    free(buffer);
+  }
+
+  /**
+   * @brief 将数据拷贝到 O_DIRECT 缓冲区，返回写满的缓冲区及其偏移，由调用方写入 direct_fd 后归还
+   *
+   *        拷贝在调用方让出协程前完成，并行的写入仍然按序进入缓冲区
+   */
+  auto stage_direct_data(storage::store_file &file, std::span<char> data) -> std::vector<std::pair<uint64_t, char *>>
+  {
+    auto blocks = std::vector<std::pair<uint64_t, char *>>{};
+    while (!data.empty())
+    {
+      auto n = std::min(direct_io_buffer_size - file.direct_len, data.size());
+      std::copy_n(data.data(), n, file.direct_buf + file.direct_len);
+      file.direct_len += n;
+      file.offset += n;
+      data = data.subspan(n);
+
+      if (file.direct_len == direct_io_buffer_size)
       {
-        std::filesystem::create_directories(std::format("{}/{:02X}/{:02X}", root_path, i, j));
+        blocks.emplace_back(file.offset - direct_io_buffer_size, std::exchange(file.direct_buf, alloc_direct_buffer()));
+        file.direct_len = 0;
       }
     }
+    return blocks;
+  }
+
+  /**
+   * @brief 写入 fd 的指定偏移，直到全部写入
+   *
+   */
+  auto pwrite_all(int fd, const char *data, uint64_t size, uint64_t offset) -> bool
+  {
+    for (auto written = 0uz; written < size;)
+    {
+      auto n = pwrite(fd, data + written, size - written, offset + written);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        return false;
+      }
+      written += n;
+    }
+    return true;
+  }
+
+  /**
+   * @brief 累计写入的字节数，超过 fdatasync_every_mb 时返回 true 并重新计数
+   *
+   */
+  auto need_sync(storage::store_file &file, uint64_t size) -> bool
+  {
+    auto sync_every = uint64_t{storage::storage_config.performance.fdatasync_every_mb} * 1024 * 1024;
+    file.unsynced += size;
+    if (sync_every == 0 || file.unsynced < sync_every)
+    {
+      return false;
+    }
+    file.unsynced = 0;
+    return true;
+  }
+
+  /**
+   * @brief 回写文件的脏页
+   *
+   */
+  auto sync_file(storage::store_file &file) -> void
+  {
+    if (fdatasync(file.fd) != 0)
+    {
+      LOG_WARN(std::format("fdatasync '{}' failed, {}", file.rel_path, strerror(errno)));
+    }
+  }
+
+  /**
+   * @brief 累计写入的字节数，超过 fdatasync_every_mb 时回写到磁盘，避免脏页堆积到关闭文件时集中回写
+   *
+   */
+  auto sync_written(storage::store_file &file, uint64_t size) -> void
+  {
+    if (need_sync(file, size))
+    {
+      sync_file(file);
+    }
+  }
+
+  /**
+   * @brief 文件是否打包写入卷
+   *
+   */
+  auto should_pack(uint64_t file_size) -> bool
+  {
+    auto max_size = uint64_t{storage::storage_config.performance.small_file_max_kb} * 1024;
+    return max_size != 0 && file_size <= max_size;
+  }
+
+#ifdef ASIO_HAS_IO_URING
+  /**
+   * @brief 首次异步读写时，使用当前协程的执行器创建文件的 io_uring 句柄
+   *
+   */
+  auto ensure_uring_file(std::unique_ptr<asio::random_access_file> &uring_file, int fd) -> asio::awaitable<void>
+  {
+    if (!uring_file)
+    {
+      uring_file = std::make_unique<asio::random_access_file>(co_await asio::this_coro::executor, fd);
+    }
+  }
+#endif
+
+} // namespace storage_detail
+
+namespace storage
+{
+
+  store_file::~store_file()
+  {
+#ifdef ASIO_HAS_IO_URING
+    /* fd 由下方统一关闭 */
+    auto ec = asio::error_code{};
+    if (uring_file)
+    {
+      uring_file->release(ec);
+    }
+    if (direct_uring_file)
+    {
+      direct_uring_file->release(ec);
+    }
+#endif
+    if (fd >= 0 && !fd_owner)
+    {
+      close(fd);
+    }
+    if (direct_fd >= 0)
+    {
+      close(direct_fd);
+    }
+    storage_detail::free_direct_buffer(direct_buf);
+  }
+
+  store_ctx::store_ctx(std::string_view root_path)
+      : m_root_path{root_path},
+        m_index{root_path},
+        m_volumes{root_path, m_index}
+  {
+    LOG_INFO(std::format("start init store '{}'", root_path));
+    auto begin = std::chrono::steady_clock::now();
+
+    /* 扁平目录在第一次写入时创建 */
+    std::filesystem::create_directories(root_path);
     std::tie(m_disk_free, m_disk_total) = common::disk_space(root_path);
-    LOG_INFO(std::format("init store '{}' suc", root_path));
+    m_volumes.load(m_index.load());
+    if (auto threads = storage_config.performance.io_threads_per_store; threads != 0)
+    {
+      m_io_pool = std::make_unique<asio::thread_pool>(threads);
+    }
+    m_init_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    LOG_INFO(std::format("init store '{}' suc, cost {}ms", root_path, m_init_ms));
   }
 
   auto store_ctx::create_file(uint64_t file_id, uint64_t file_size) -> bool
@@ -35,15 +240,15 @@ namespace storage
     }
 
     auto rel_path = valid_rel_path(next_flat_path());
-    auto ofs = create_ofstream(rel_path, file_size);
-    if (!ofs)
+    auto file = storage_detail::should_pack(file_size) ? create_packed_file(rel_path, file_size) : create_store_file(rel_path, file_size);
+    if (!file)
     {
       return false;
     }
 
     {
-      auto lock = std::unique_lock{m_ofstream_mut};
-      m_ofstreams[file_id] = std::make_pair(ofs, std::move(rel_path));
+      auto lock = std::unique_lock{m_write_files_mut};
+      m_write_files[file_id] = file;
     }
 
     reduce_disk_free(file_size);
@@ -59,20 +264,20 @@ namespace storage
     }
 
     auto abs_path = std::format("{}/{}", m_root_path, rel_path);
-    if (std::filesystem::exists(abs_path))
+    if (std::filesystem::exists(abs_path) || m_index.find(rel_path))
     {
       return false;
     }
 
-    auto ofs = create_ofstream(rel_path, file_size);
-    if (!ofs)
+    auto file = storage_detail::should_pack(file_size) ? create_packed_file(rel_path, file_size) : create_store_file(rel_path, file_size);
+    if (!file)
     {
       return false;
     }
 
     {
-      auto lock = std::unique_lock{m_ofstream_mut};
-      m_ofstreams[file_id] = std::make_pair(ofs, rel_path);
+      auto lock = std::unique_lock{m_write_files_mut};
+      m_write_files[file_id] = file;
     }
 
     reduce_disk_free(file_size);
@@ -81,34 +286,276 @@ namespace storage
 
   auto store_ctx::append_data(uint64_t file_id, std::span<char> data) -> bool
   {
-    auto [ofs, _] = peek_ofstream(file_id);
-    if (!ofs)
+    auto file = peek_write_file(file_id);
+    if (!file)
     {
       LOG_ERROR(std::format("invalid file_id {}", file_id));
       return false;
     }
 
-    ofs->write(data.data(), data.size());
-    if (!ofs->good())
+    file->crc = common::crc32c(file->crc, data);
+    if (file->packed)
     {
-      LOG_ERROR(std::format("write file failed for file_id {}", file_id));
+      file->packed_data.insert(file->packed_data.end(), data.begin(), data.end());
+      file->offset += data.size();
+      return true;
+    }
+
+    if (file->direct_fd != -1)
+    {
+      auto ok = true;
+      for (auto [offset, block] : storage_detail::stage_direct_data(*file, data))
+      {
+        ok = ok && storage_detail::pwrite_all(file->direct_fd, block, storage_detail::direct_io_buffer_size, offset);
+        storage_detail::free_direct_buffer(block);
+      }
+      if (!ok)
+      {
+        LOG_ERROR(std::format("direct write file failed for file_id {}, {}", file_id, strerror(errno)));
+      }
+      return ok;
+    }
+
+    if (!storage_detail::pwrite_all(file->fd, data.data(), data.size(), file->offset))
+    {
+      LOG_ERROR(std::format("write file failed for file_id {}, {}", file_id, strerror(errno)));
       return false;
     }
+
+    file->offset += data.size();
+    storage_detail::sync_written(*file, data.size());
     return true;
   }
 
+  auto store_ctx::async_append_data(uint64_t file_id, std::span<char> data) -> asio::awaitable<bool>
+  {
+#ifdef ASIO_HAS_IO_URING
+    auto file = peek_write_file(file_id);
+    if (!file)
+    {
+      LOG_ERROR(std::format("invalid file_id {}", file_id));
+      co_return false;
+    }
+    if (file->packed)
+    {
+      co_return append_data(file_id, data);
+    }
+
+    /* 提交前确定偏移并计算 CRC，写入让出协程时后续数据块仍然按序写入 */
+    file->crc = common::crc32c(file->crc, data);
+    if (file->direct_fd != -1)
+    {
+      auto blocks = storage_detail::stage_direct_data(*file, data);
+      auto ok = true;
+      for (auto [offset, block] : blocks)
+      {
+        co_await storage_detail::ensure_uring_file(file->direct_uring_file, file->direct_fd);
+        ++file->pending_writes;
+        auto [ec, n] = co_await asio::async_write_at(*file->direct_uring_file, offset, asio::buffer(block, storage_detail::direct_io_buffer_size), asio::as_tuple(asio::use_awaitable));
+        if (--file->pending_writes == 0 && file->drain_timer)
+        {
+          file->drain_timer->cancel();
+        }
+        storage_detail::free_direct_buffer(block);
+
+        if (ec)
+        {
+          LOG_ERROR(std::format("direct write file failed for file_id {}, {}", file_id, ec.message()));
+          ok = false;
+        }
+      }
+      co_return ok;
+    }
+
+    auto offset = file->offset;
+    file->offset += data.size();
+
+    co_await storage_detail::ensure_uring_file(file->uring_file, file->fd);
+    ++file->pending_writes;
+    auto [ec, n] = co_await asio::async_write_at(*file->uring_file, offset, asio::buffer(data), asio::as_tuple(asio::use_awaitable));
+    if (--file->pending_writes == 0 && file->drain_timer)
+    {
+      file->drain_timer->cancel();
+    }
+
+    if (ec)
+    {
+      LOG_ERROR(std::format("write file failed for file_id {}, {}", file_id, ec.message()));
+      co_return false;
+    }
+    storage_detail::sync_written(*file, data.size());
+    co_return true;
+#else
+    auto file = peek_write_file(file_id);
+    if (!file || file->packed || !m_io_pool)
+    {
+      co_return append_data(file_id, data);
+    }
+
+    /* 在连接的 strand 上确定偏移、计算 CRC 和是否回写，线程池中只执行磁盘读写 */
+    file->crc = common::crc32c(file->crc, data);
+    auto blocks = std::vector<std::pair<uint64_t, char *>>{};
+    auto offset = file->offset;
+    auto sync = false;
+    if (file->direct_fd != -1)
+    {
+      blocks = storage_detail::stage_direct_data(*file, data);
+    }
+    else
+    {
+      file->offset += data.size();
+      sync = storage_detail::need_sync(*file, data.size());
+    }
+
+    /* fd 在 strand 上读取后传入线程池，direct_fd 可能被 reserve_write 在 strand 上关闭 */
+    auto fd = file->fd;
+    auto direct_fd = file->direct_fd;
+    ++file->pending_writes;
+    auto ok = co_await run_io([&, fd, direct_fd]
+                              {
+                                if (direct_fd != -1)
+                                {
+                                  auto res = true;
+                                  for (auto [block_offset, block] : blocks)
+                                  {
+                                    res = res && storage_detail::pwrite_all(direct_fd, block, storage_detail::direct_io_buffer_size, block_offset);
+                                    storage_detail::free_direct_buffer(block);
+                                  }
+                                  if (!res)
+                                  {
+                                    LOG_ERROR(std::format("direct write file failed for file_id {}, {}", file_id, strerror(errno)));
+                                  }
+                                  return res;
+                                }
+                                if (!storage_detail::pwrite_all(fd, data.data(), data.size(), offset))
+                                {
+                                  LOG_ERROR(std::format("write file failed for file_id {}, {}", file_id, strerror(errno)));
+                                  return false;
+                                }
+                                if (sync)
+                                {
+                                  storage_detail::sync_file(*file);
+                                }
+                                return true;
+                              });
+    if (--file->pending_writes == 0 && file->drain_timer)
+    {
+      file->drain_timer->cancel();
+    }
+    co_return ok;
+#endif
+  }
+
+  auto store_ctx::reserve_write(uint64_t file_id, uint64_t size) -> std::optional<std::pair<int, uint64_t>>
+  {
+    auto file = peek_write_file(file_id);
+    if (!file)
+    {
+      return std::nullopt;
+    }
+
+    /* 打包的文件没有 fd，数据由普通路径写入内存 */
+    if (file->packed)
+    {
+      return std::nullopt;
+    }
+
+    /* splice 写入 fd，之后的数据不再经过 O_DIRECT 缓冲区。线程池中还有写入 direct_fd 的任务时不能关闭它，仍由普通路径写入 */
+    if (file->direct_fd != -1 && (file->pending_writes != 0 || !finish_direct_write(*file)))
+    {
+      return std::nullopt;
+    }
+
+    auto offset = file->offset;
+    file->offset += size;
+    file->crc_valid = false;
+    return std::pair{file->fd, offset};
+  }
+
+  auto store_ctx::async_drain_write_file(uint64_t file_id) -> asio::awaitable<void>
+  {
+    auto file = peek_write_file(file_id);
+    if (!file)
+    {
+      co_return;
+    }
+
+    while (file->pending_writes != 0)
+    {
+      if (!file->drain_timer)
+      {
+        file->drain_timer = std::make_unique<asio::steady_timer>(co_await asio::this_coro::executor);
+      }
+      file->drain_timer->expires_at(asio::steady_timer::time_point::max());
+      co_await file->drain_timer->async_wait(asio::as_tuple(asio::use_awaitable));
+    }
+  }
+
+  auto store_ctx::async_run_write(uint64_t file_id, std::function<bool()> write) -> asio::awaitable<bool>
+  {
+    auto file = peek_write_file(file_id);
+    if (!file)
+    {
+      co_return false;
+    }
+
+    ++file->pending_writes;
+    auto ok = co_await run_io(std::move(write));
+    if (--file->pending_writes == 0 && file->drain_timer)
+    {
+      file->drain_timer->cancel();
+    }
+    co_return ok;
+  }
+
+  auto store_ctx::write_crc32c(uint64_t file_id) -> std::optional<uint32_t>
+  {
+    auto lock = std::unique_lock{m_write_files_mut};
+    auto it = m_write_files.find(file_id);
+    if (it == m_write_files.end() || !it->second->crc_valid)
+    {
+      return std::nullopt;
+    }
+    return it->second->crc;
+  }
+
   auto store_ctx::close_write_file(uint64_t file_id, std::string_view user_file_name) -> std::optional<std::pair<std::string, std::string>>
   {
-    auto [ofs, rel_path] = pop_ofstream(file_id);
-    if (!ofs)
+    auto file = pop_write_file(file_id);
+    if (!file)
     {
       LOG_ERROR(std::format("invalid file_id {}", file_id));
       return std::nullopt;
     }
+    if (file->direct_fd != -1 && !finish_direct_write(*file))
+    {
+      return std::nullopt;
+    }
+
+    /* 打包的文件直接以最终的 rel_path 写入卷 */
+    if (file->packed)
+    {
+      auto new_rel_path = std::format("{}/{}_{}", flat_of_rel_path(file->rel_path), user_file_name, common::random_string(8));
+      if (!m_volumes.append(new_rel_path, file->packed_data, file->crc))
+      {
+        return std::nullopt;
+      }
+      return std::pair{m_root_path, new_rel_path};
+    }
+
+    auto rel_path = file->rel_path;
+    auto crc = file->crc_valid ? std::optional{file->crc} : std::nullopt;
+    file.reset();
+
+    /* 扩展属性跟随 inode，重命名后仍然有效。crc 无效时在第一次使用时计算 */
+    auto old_abs_path = std::format("{}/{}", m_root_path, rel_path);
+    if (crc)
+    {
+      set_file_crc32c(old_abs_path, crc.value());
+    }
 
     /* 重命名 TODO)) 增加 new_abs_path 有效检测*/
     auto flat_path = flat_of_rel_path(rel_path);
-    auto old_abs_path = std::format("{}/{}", m_root_path, rel_path);
     auto new_rel_path = std::format("{}/{}_{}", flat_path, user_file_name, common::random_string(8));
     auto new_abs_path = std::format("{}/{}", m_root_path, new_rel_path);
     try
@@ -120,100 +567,385 @@ namespace storage
       LOG_ERROR(std::format("rename from '{}' to '{}' failed, what: ", old_abs_path, new_abs_path, err.what()));
       return std::nullopt;
     }
+    m_index.put_from_disk(new_rel_path);
     return std::pair{m_root_path, new_rel_path};
   }
 
   auto store_ctx::close_write_file(uint64_t file_id) -> std::optional<std::pair<std::string, std::string>>
   {
-    auto [ofs, rel_path] = pop_ofstream(file_id);
-    if (!ofs)
+    auto file = pop_write_file(file_id);
+    if (!file)
     {
       return std::nullopt;
     }
+    if (file->direct_fd != -1 && !finish_direct_write(*file))
+    {
+      return std::nullopt;
+    }
+    if (file->packed)
+    {
+      if (!m_volumes.append(file->rel_path, file->packed_data, file->crc))
+      {
+        return std::nullopt;
+      }
+      return std::pair{m_root_path, file->rel_path};
+    }
+
+    auto rel_path = file->rel_path;
+    auto crc = file->crc_valid ? std::optional{file->crc} : std::nullopt;
+    file.reset();
 
-    ofs->close();
+    if (crc)
+    {
+      set_file_crc32c(std::format("{}/{}", m_root_path, rel_path), crc.value());
+    }
+    m_index.put_from_disk(rel_path);
     return std::pair{m_root_path, rel_path};
   }
 
+  auto store_ctx::abort_write_file(uint64_t file_id) -> void
+  {
+    auto file = pop_write_file(file_id);
+    if (!file)
+    {
+      return;
+    }
+
+    /* 打包的文件只在内存中，不写入卷，丢弃数据即可。rel_path 不对应磁盘上的文件，不能删除 */
+    if (file->packed)
+    {
+      return;
+    }
+
+    /* 不完整的文件不能被下载，关闭后直接删除 */
+    auto abs_path = std::format("{}/{}", m_root_path, file->rel_path);
+    file.reset();
+    auto ec = std::error_code{};
+    if (!std::filesystem::remove(abs_path, ec) && ec)
+    {
+      LOG_ERROR(std::format("remove aborted file '{}' failed, {}", abs_path, ec.message()));
+    }
+  }
+
   auto store_ctx::open_read_file(uint64_t file_id, std::string_view rel_path) -> std::optional<uint64_t>
   {
-    auto abs_path = std::format("{}/{}", m_root_path, rel_path);
-    auto ifs = std::make_shared<std::ifstream>(abs_path, std::ios::binary | std::ios::ate);
-    if (!ifs->is_open())
+    auto entry = m_index.find(rel_path);
+    if (!entry)
     {
       return std::nullopt;
     }
+    if (entry->volume != 0)
+    {
+      return open_packed_file(file_id, rel_path, entry.value());
+    }
 
-    auto file_size = ifs->tellg();
-    ifs->seekg(0);
-
+    /* 文件已被外部删除，索引过期 */
+    auto file_size = open_file(file_id, rel_path);
+    if (!file_size)
     {
-      auto lock = std::unique_lock{m_ifstreams_mtx};
-      m_ifstreams[file_id] = std::make_pair(ifs, rel_path);
+      m_index.erase(rel_path);
+      return std::nullopt;
     }
+
+    auto file = peek_read_file(file_id);
+    file->crc = entry->crc32c;
+    file->crc_valid = entry->crc_valid;
     return file_size;
   }
 
-  auto store_ctx::read_file(uint64_t file_id, uint64_t size) -> std::optional<std::vector<char>>
+  auto store_ctx::async_open_read_file(uint64_t file_id, std::string_view rel_path) -> asio::awaitable<std::optional<uint64_t>>
+  {
+    /* 索引未命中时不必切换线程 */
+    if (!m_index.find(rel_path))
+    {
+      co_return std::nullopt;
+    }
+    co_return co_await run_io([&]
+                              { return open_read_file(file_id, rel_path); });
+  }
+
+  auto store_ctx::open_packed_file(uint64_t file_id, std::string_view rel_path, store_index_entry entry) -> std::optional<uint64_t>
+  {
+    auto fd = m_volumes.open(entry.volume);
+    if (fd == -1)
+    {
+      /* 查找索引之后卷被压缩，文件已经移动到新的卷 */
+      auto moved = m_index.find(rel_path);
+      if (!moved || moved->volume == 0 || (fd = m_volumes.open(moved->volume)) == -1)
+      {
+        LOG_ERROR(std::format("open volume {} of '{}' failed", entry.volume, rel_path));
+        return std::nullopt;
+      }
+      entry = moved.value();
+    }
+
+    auto file = std::make_shared<store_file>();
+    file->fd = fd;
+    file->rel_path = rel_path;
+    file->offset = entry.offset;
+    file->begin = entry.offset;
+    file->end = entry.offset + entry.size;
+    file->crc = entry.crc32c;
+    file->crc_valid = entry.crc_valid;
+    {
+      auto lock = std::unique_lock{m_read_files_mut};
+      m_read_files[file_id] = file;
+    }
+    return entry.size;
+  }
+
+  auto store_ctx::probe_read_file(uint64_t file_id, std::string_view rel_path) -> std::optional<uint64_t>
   {
-    auto [ifs, _] = peek_ifstream(file_id);
-    if (!ifs || !ifs->good())
+    /* 正常关闭后索引包含所有文件，不在索引中即不存在 */
+    if (!m_index.recovered())
     {
       return std::nullopt;
     }
+    {
+      auto lock = std::unique_lock{m_probe_misses_mut};
+      if (m_probe_misses.contains(std::string{rel_path}))
+      {
+        return std::nullopt;
+      }
+    }
 
-    if (ifs->eof())
+    auto file_size = open_file(file_id, rel_path);
+    if (file_size)
     {
-      return std::vector<char>{};
+      m_index.put_from_disk(rel_path);
+      return file_size;
     }
 
+    auto lock = std::unique_lock{m_probe_misses_mut};
+    if (m_probe_misses.size() >= storage_detail::probe_miss_cache_size)
+    {
+      m_probe_misses.clear();
+    }
+    m_probe_misses.emplace(rel_path);
+    return std::nullopt;
+  }
+
+  auto store_ctx::open_file(uint64_t file_id, std::string_view rel_path) -> std::optional<uint64_t>
+  {
+    auto abs_path = std::format("{}/{}", m_root_path, rel_path);
+    auto file = std::make_shared<store_file>();
+    file->fd = open(abs_path.data(), O_RDONLY | O_CLOEXEC);
+    if (file->fd < 0)
+    {
+      return std::nullopt;
+    }
+    file->rel_path = rel_path;
+    file->crc_valid = false;
+
+    /* 下载和同步都是顺序读取，加大预读窗口 */
+    posix_fadvise(file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    struct stat st;
+    if (fstat(file->fd, &st) != 0)
+    {
+      return std::nullopt;
+    }
+    file->end = st.st_size;
+
+    {
+      auto lock = std::unique_lock{m_read_files_mut};
+      m_read_files[file_id] = file;
+    }
+    return st.st_size;
+  }
+
+  auto store_ctx::read_file(uint64_t file_id, uint64_t size) -> std::optional<std::vector<char>>
+  {
     auto data = std::vector<char>(size, 0);
-    data.resize(ifs->readsome((char *)data.data(), size));
-    if (!ifs->good())
+    auto read_len = read_file(file_id, data.data(), size);
+    if (!read_len)
     {
       return std::nullopt;
     }
+    data.resize(read_len.value());
     return data;
   }
 
   auto store_ctx::read_file(uint64_t file_id, char *dst, uint64_t size) -> std::optional<uint64_t>
   {
-    auto [ifs, _] = peek_ifstream(file_id);
-    if (!ifs || !ifs->good())
+    auto file = peek_read_file(file_id);
+    if (!file)
     {
       LOG_CRITICAL("read file failed");
       return std::nullopt;
     }
 
+    /* 打包的文件不能读到卷中的下一个文件 */
+    size = std::min(size, file->end - std::min(file->offset, file->end));
     auto idx = 0uz;
     while (idx < size)
     {
-      auto n = ifs->readsome(dst + idx, size - idx);
-      if (n == 0)
+      auto n = pread(file->fd, dst + idx, size - idx, file->offset + idx);
+      if (n < 0)
       {
-        if (ifs->eof() || ifs->rdstate() == 0)
+        if (errno == EINTR)
         {
-          break;
+          continue;
         }
-        LOG_CRITICAL("read some failed, {}", (int)ifs->rdstate());
+        LOG_CRITICAL(std::format("read file failed for file_id {}, {}", file_id, strerror(errno)));
         return std::nullopt;
       }
+      if (n == 0)
+      {
+        break;
+      }
       idx += n;
     }
+
+    file->offset += idx;
     return idx;
   }
 
+  auto store_ctx::async_read_file(uint64_t file_id, char *dst, uint64_t size) -> asio::awaitable<std::optional<uint64_t>>
+  {
+#ifdef ASIO_HAS_IO_URING
+    auto file = peek_read_file(file_id);
+    if (!file)
+    {
+      LOG_CRITICAL("read file failed");
+      co_return std::nullopt;
+    }
+    size = std::min(size, file->end - std::min(file->offset, file->end));
+
+    /* 读到文件末尾时返回 eof，此时 n 为实际读取的字节数 */
+    co_await storage_detail::ensure_uring_file(file->uring_file, file->fd);
+    auto [ec, n] = co_await asio::async_read_at(*file->uring_file, file->offset, asio::buffer(dst, size), asio::as_tuple(asio::use_awaitable));
+    if (ec && ec != asio::error::eof)
+    {
+      LOG_CRITICAL(std::format("read file failed for file_id {}, {}", file_id, ec.message()));
+      co_return std::nullopt;
+    }
+
+    file->offset += n;
+    co_return n;
+#else
+    co_return co_await run_io([&]
+                              { return read_file(file_id, dst, size); });
+#endif
+  }
+
+  auto store_ctx::reserve_read(uint64_t file_id, uint64_t size) -> std::optional<std::tuple<int, uint64_t, uint64_t, bool>>
+  {
+    auto file = peek_read_file(file_id);
+    if (!file)
+    {
+      return std::nullopt;
+    }
+
+    /* 打包在卷中的文件 offset 为卷内的绝对偏移，剩余长度以 end 计算 */
+    auto offset = file->offset;
+    auto len = std::min(size, file->end - std::min(offset, file->end));
+    file->offset += len;
+    return std::tuple{file->fd, offset, len, file->offset >= file->end};
+  }
+
+  auto store_ctx::read_crc32c(uint64_t file_id) -> std::optional<uint32_t>
+  {
+    auto file = peek_read_file(file_id);
+    if (!file || !file->crc_valid)
+    {
+      return std::nullopt;
+    }
+    return file->crc;
+  }
+
+  auto store_ctx::share_read_file(uint64_t file_id, uint64_t origin_id) -> std::optional<uint64_t>
+  {
+    auto origin = peek_read_file(origin_id);
+    if (!origin)
+    {
+      return std::nullopt;
+    }
+
+    /* fd 由最初打开的文件持有，所有共享者关闭后才关闭 */
+    auto file = std::make_shared<store_file>();
+    file->fd_owner = origin->fd_owner ? origin->fd_owner : origin;
+    file->fd = origin->fd;
+    file->rel_path = origin->rel_path;
+    file->offset = origin->begin;
+    file->begin = origin->begin;
+    file->end = origin->end;
+    file->crc = origin->crc;
+    file->crc_valid = origin->crc_valid;
+    {
+      auto lock = std::unique_lock{m_read_files_mut};
+      m_read_files[file_id] = file;
+    }
+    return file->end - file->begin;
+  }
+
   auto store_ctx::close_read_file(uint64_t file_id) -> bool
   {
-    auto [ifs, _] = pop_ifstream(file_id);
-    if (!ifs)
+    return pop_read_file(file_id) != nullptr;
+  }
+
+  auto store_ctx::remove_file(std::string_view rel_path) -> bool
+  {
+    if (auto entry = m_index.erase(rel_path); entry && entry->volume != 0)
     {
+      m_volumes.erase(rel_path, entry.value());
+      return true;
+    }
+
+    auto ec = std::error_code{};
+    if (!std::filesystem::remove(std::format("{}/{}", m_root_path, rel_path), ec))
+    {
+      LOG_ERROR(std::format("remove '{}/{}' failed, {}", m_root_path, rel_path, ec ? ec.message() : "not exists"));
       return false;
     }
-    ifs->close();
     return true;
   }
 
+  auto store_ctx::physical_path(std::string_view rel_path) -> std::string
+  {
+    if (auto entry = m_index.find(rel_path); entry && entry->volume != 0)
+    {
+      return m_volumes.volume_path(entry->volume);
+    }
+    return std::format("{}/{}", m_root_path, rel_path);
+  }
+
+  auto store_ctx::indexed_crc32c(std::string_view rel_path) -> std::optional<uint32_t>
+  {
+    auto entry = m_index.find(rel_path);
+    if (!entry || !entry->crc_valid)
+    {
+      return std::nullopt;
+    }
+    return entry->crc32c;
+  }
+
+  auto store_ctx::compact_volumes() -> void
+  {
+    m_volumes.compact(storage_config.performance.volume_compact_percent);
+  }
+
+  auto store_ctx::get_io_stats() -> store_io_stats
+  {
+    return {
+        .depth = m_io_depth,
+        .tasks = m_io_tasks,
+        .wait_us = m_io_wait_us,
+        .max_wait_us = m_io_max_wait_us,
+    };
+  }
+
+  auto store_ctx::record_io_wait(std::chrono::steady_clock::time_point queued) -> void
+  {
+    auto wait_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - queued).count();
+    --m_io_depth;
+    ++m_io_tasks;
+    m_io_wait_us += wait_us;
+    for (auto max = m_io_max_wait_us.load(); wait_us > max && !m_io_max_wait_us.compare_exchange_weak(max, wait_us);)
+    {
+    }
+  }
+
   auto store_ctx::free_space() -> uint64_t
   {
     static auto times = 0;
@@ -232,72 +964,144 @@ namespace storage
       return "";
     }
 
-    return std::format("{}/{}", m_root_path, next_flat_path());
+    auto flat_path = next_flat_path();
+    if (!ensure_flat_dir(std::format("{}/", flat_path)))
+    {
+      return "";
+    }
+    return std::format("{}/{}", m_root_path, flat_path);
   }
 
-  auto store_ctx::peek_ofstream(uint64_t file_id) -> std::pair<std::shared_ptr<std::ofstream>, std::string>
+  auto store_ctx::peek_write_file(uint64_t file_id) -> std::shared_ptr<store_file>
   {
-    auto lock = std::unique_lock{m_ofstream_mut};
-    auto it = m_ofstreams.find(file_id);
-    if (it == m_ofstreams.end())
+    auto lock = std::unique_lock{m_write_files_mut};
+    auto it = m_write_files.find(file_id);
+    if (it == m_write_files.end())
     {
       LOG_ERROR("invalid file_id {}", file_id);
-      return {nullptr, ""};
+      return nullptr;
     }
     return it->second;
   }
 
-  auto store_ctx::pop_ofstream(uint64_t file_id) -> std::pair<std::shared_ptr<std::ofstream>, std::string>
+  auto store_ctx::pop_write_file(uint64_t file_id) -> std::shared_ptr<store_file>
   {
-    auto lock = std::unique_lock{m_ofstream_mut};
-    auto it = m_ofstreams.find(file_id);
-    if (it == m_ofstreams.end())
+    auto lock = std::unique_lock{m_write_files_mut};
+    auto it = m_write_files.find(file_id);
+    if (it == m_write_files.end())
     {
       LOG_ERROR("invalid file_id {}", file_id);
-      return {nullptr, ""};
+      return nullptr;
     }
     auto res = std::move(it->second);
-    m_ofstreams.erase(it);
+    m_write_files.erase(it);
     return res;
   }
 
-  auto store_ctx::peek_ifstream(uint64_t file_id) -> std::pair<std::shared_ptr<std::ifstream>, std::string>
+  auto store_ctx::peek_read_file(uint64_t file_id) -> std::shared_ptr<store_file>
   {
-    auto lock = std::unique_lock{m_ifstreams_mtx};
-    auto it = m_ifstreams.find(file_id);
-    if (it == m_ifstreams.end())
+    auto lock = std::unique_lock{m_read_files_mut};
+    auto it = m_read_files.find(file_id);
+    if (it == m_read_files.end())
     {
-      return {nullptr, ""};
+      return nullptr;
     }
     return it->second;
   }
 
-  auto store_ctx::pop_ifstream(uint64_t file_id) -> std::pair<std::shared_ptr<std::ifstream>, std::string>
+  auto store_ctx::pop_read_file(uint64_t file_id) -> std::shared_ptr<store_file>
   {
-    auto lock = std::unique_lock{m_ifstreams_mtx};
-    auto it = m_ifstreams.find(file_id);
-    if (it == m_ifstreams.end())
+    auto lock = std::unique_lock{m_read_files_mut};
+    auto it = m_read_files.find(file_id);
+    if (it == m_read_files.end())
     {
-      return {nullptr, ""};
+      return nullptr;
     }
     auto res = std::move(it->second);
-    m_ifstreams.erase(it);
+    m_read_files.erase(it);
     return res;
   }
 
-  auto store_ctx::create_ofstream(std::string_view rel_path, uint64_t file_size) -> std::shared_ptr<std::ofstream>
+  auto store_ctx::create_store_file(std::string_view rel_path, uint64_t file_size) -> std::shared_ptr<store_file>
   {
+    if (!ensure_flat_dir(rel_path))
+    {
+      return nullptr;
+    }
+
     auto abs_path = std::format("{}/{}", m_root_path, rel_path);
-    auto ofs = std::make_shared<std::ofstream>(abs_path, std::ios::binary);
-    if (!ofs->is_open())
+    auto file = std::make_shared<store_file>();
+    file->fd = open(abs_path.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file->fd < 0)
     {
+      LOG_ERROR(std::format("create file '{}' failed, {}", abs_path, strerror(errno)));
       return nullptr;
     }
+    file->rel_path = rel_path;
+
+    /* 预留真实的磁盘空间，而不是空洞，写入时无需再分配块。文件系统不支持时退化为扩展文件大小 */
+    if (file_size != 0 && fallocate(file->fd, 0, 0, file_size) != 0)
+    {
+      if (errno != EOPNOTSUPP || ftruncate(file->fd, file_size) != 0)
+      {
+        LOG_ERROR(std::format("allocate {} bytes for file '{}' failed, {}", file_size, abs_path, strerror(errno)));
+        return nullptr;
+      }
+    }
+
+    /* 大文件绕过页缓存写入，不挤占下载的热点数据 */
+    auto direct_min = uint64_t{storage_config.performance.direct_io_min_mb} * 1024 * 1024;
+    if (direct_min != 0 && file_size >= direct_min)
+    {
+      file->direct_fd = open(abs_path.data(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+      file->direct_buf = file->direct_fd == -1 ? nullptr : storage_detail::alloc_direct_buffer();
+      if (file->direct_buf == nullptr)
+      {
+        LOG_WARN(std::format("open file '{}' with O_DIRECT failed, {}", abs_path, strerror(errno)));
+        if (file->direct_fd != -1)
+        {
+          close(file->direct_fd);
+          file->direct_fd = -1;
+        }
+      }
+    }
+    return file;
+  }
 
-    ofs->seekp(file_size - 1);
-    ofs->put(0);
-    ofs->seekp(0);
-    return ofs;
+  auto store_ctx::create_packed_file(std::string_view rel_path, uint64_t file_size) -> std::shared_ptr<store_file>
+  {
+    auto file = std::make_shared<store_file>();
+    file->rel_path = rel_path;
+    file->packed = true;
+    file->packed_data.reserve(file_size);
+    return file;
+  }
+
+  auto store_ctx::finish_direct_write(store_file &file) -> bool
+  {
+    /* 对齐的部分仍然通过 direct_fd 写入，剩余不足对齐长度的部分通过 fd 写入 */
+    auto start = file.offset - file.direct_len;
+    auto aligned = file.direct_len / storage_detail::direct_io_align * storage_detail::direct_io_align;
+    auto ok = storage_detail::pwrite_all(file.direct_fd, file.direct_buf, aligned, start) &&
+              storage_detail::pwrite_all(file.fd, file.direct_buf + aligned, file.direct_len - aligned, start + aligned);
+    if (!ok)
+    {
+      LOG_ERROR(std::format("write file '{}' failed, {}", file.rel_path, strerror(errno)));
+    }
+
+#ifdef ASIO_HAS_IO_URING
+    if (file.direct_uring_file)
+    {
+      auto ec = asio::error_code{};
+      file.direct_uring_file->release(ec);
+      file.direct_uring_file.reset();
+    }
+#endif
+    close(file.direct_fd);
+    file.direct_fd = -1;
+    storage_detail::free_direct_buffer(std::exchange(file.direct_buf, nullptr));
+    file.direct_len = 0;
+    return ok;
   }
 
   auto store_ctx::next_flat_path() -> std::string
@@ -321,6 +1125,34 @@ namespace storage
     return rel_path;
   }
 
+  auto store_ctx::ensure_flat_dir(std::string_view rel_path) -> bool
+  {
+    /* 同步来的 rel_path 由对端给出，不符合 XX/XX 格式时不缓存，每次都检查 */
+    auto flat_path = flat_of_rel_path(rel_path);
+    auto high = 0u;
+    auto low = 0u;
+    auto cached = flat_path.size() == 5 && flat_path[2] == '/' &&
+                  std::from_chars(flat_path.data(), flat_path.data() + 2, high, 16).ptr == flat_path.data() + 2 &&
+                  std::from_chars(flat_path.data() + 3, flat_path.data() + 5, low, 16).ptr == flat_path.data() + 5;
+    if (cached && m_flat_dirs[high << 8 | low])
+    {
+      return true;
+    }
+
+    auto ec = std::error_code{};
+    std::filesystem::create_directories(std::format("{}/{}", m_root_path, flat_path), ec);
+    if (ec)
+    {
+      LOG_ERROR(std::format("create directory '{}/{}' failed, {}", m_root_path, flat_path, ec.message()));
+      return false;
+    }
+    if (cached)
+    {
+      m_flat_dirs[high << 8 | low] = true;
+    }
+    return true;
+  }
+
   auto store_ctx::disk_space_is_enough(uint64_t size) -> bool
   {
     if (m_disk_free < size || m_disk_free < m_disk_total * 0.05)
@@ -339,7 +1171,7 @@ namespace storage
     }
 
     auto new_path = std::format("{}/{}", m_root_path, rel_path);
-    if (std::filesystem::exists(new_path))
+    if (std::filesystem::exists(new_path) || !ensure_flat_dir(rel_path))
     {
       return false;
     }
@@ -353,40 +1185,89 @@ namespace storage
       LOG_ERROR(std::format("copy from '{}' to '{}' failed, what: ", abs_path, new_path, err.what()));
       return false;
     }
+    m_index.put_from_disk(rel_path);
     return true;
   }
 
   store_ctx_group::store_ctx_group(const std::string &name, const std::vector<std::string> &paths)
       : m_name{name}
   {
-    for (const auto &path : paths)
+    /* 各个 store 通常位于不同的磁盘，并行初始化。异常在线程中捕获，全部结束后重新抛出，交由调用方处理 */
+    m_stores.resize(paths.size());
+    auto errors = std::vector<std::exception_ptr>(paths.size());
     {
-      m_stores.emplace_back(std::make_shared<store_ctx>(path));
+      auto threads = std::vector<std::jthread>{};
+      for (auto i = 0uz; i < paths.size(); ++i)
+      {
+        threads.emplace_back([this, &paths, &errors, i]
+                             {
+                               try
+                               {
+                                 m_stores[i] = std::make_shared<store_ctx>(paths[i]);
+                               }
+                               catch (...)
+                               {
+                                 errors[i] = std::current_exception();
+                               } });
+      }
+    }
+    for (const auto &error : errors)
+    {
+      if (error)
+      {
+        std::rethrow_exception(error);
+      }
     }
   }
 
-  auto store_ctx_group::create_file(uint64_t file_size) -> std::optional<std::uint64_t>
+  auto store_ctx_group::async_create_file(uint64_t file_size) -> asio::awaitable<std::optional<uint64_t>>
   {
     for (auto [s, file_id] : iterate_store(++m_store_idx))
     {
-      if (s->create_file(file_id, file_size))
+      if (co_await s->run_io([&]
+                             { return s->create_file(file_id, file_size); }))
       {
-        return file_id;
+        co_return file_id;
       }
     }
-    return std::nullopt;
+    co_return std::nullopt;
   }
 
-  auto store_ctx_group::create_file(uint64_t file_size, std::string_view rel_path) -> std::optional<uint64_t>
+  auto store_ctx_group::async_create_file(uint64_t file_size, std::string_view rel_path) -> asio::awaitable<std::optional<uint64_t>>
   {
     for (auto [s, file_id] : iterate_store(++m_store_idx))
     {
-      if (s->create_file(file_id, file_size, rel_path))
+      if (co_await s->run_io([&]
+                             { return s->create_file(file_id, file_size, rel_path); }))
       {
-        return file_id;
+        co_return file_id;
       }
     }
-    return std::nullopt;
+    co_return std::nullopt;
+  }
+
+  auto store_ctx_group::async_close_write_file(uint64_t file_id, std::string_view user_file_name) -> asio::awaitable<std::optional<std::pair<std::string, std::string>>>
+  {
+    auto s = m_stores[file_id % m_stores.size()];
+    co_await s->async_drain_write_file(file_id);
+    co_return co_await s->run_io([&]
+                                 { return s->close_write_file(file_id, user_file_name); });
+  }
+
+  auto store_ctx_group::async_close_write_file(uint64_t file_id) -> asio::awaitable<std::optional<std::pair<std::string, std::string>>>
+  {
+    auto s = m_stores[file_id % m_stores.size()];
+    co_await s->async_drain_write_file(file_id);
+    co_return co_await s->run_io([&]
+                                 { return s->close_write_file(file_id); });
+  }
+
+  auto store_ctx_group::async_abort_write_file(uint64_t file_id) -> asio::awaitable<void>
+  {
+    auto s = m_stores[file_id % m_stores.size()];
+    co_await s->async_drain_write_file(file_id);
+    co_await s->run_io([&]
+                       { s->abort_write_file(file_id); });
   }
 
   auto store_ctx_group::write_file(uint64_t file_id, std::span<char> data) -> bool
@@ -394,19 +1275,96 @@ namespace storage
     return m_stores[file_id % m_stores.size()]->append_data(file_id, data);
   }
 
-  auto store_ctx_group::open_read_file(std::string_view rel_path) -> std::optional<std::tuple<uint64_t, uint64_t, std::string>>
+  auto store_ctx_group::async_open_read_file(std::string_view rel_path) -> asio::awaitable<std::optional<std::tuple<uint64_t, uint64_t, std::string>>>
+  {
+    for (auto [s, file_id] : iterate_store(++m_store_idx))
+    {
+      if (auto file_size = co_await s->async_open_read_file(file_id, rel_path); file_size.has_value())
+      {
+        co_return std::tuple{file_id, file_size.value(), std::format("{}/{}", s->root_path(), rel_path)};
+      }
+    }
+
+    co_return std::nullopt;
+  }
+
+  auto store_ctx_group::async_probe_read_file(std::string_view rel_path) -> asio::awaitable<std::optional<std::tuple<uint64_t, uint64_t, std::string>>>
   {
     for (auto [s, file_id] : iterate_store(++m_store_idx))
     {
-      if (auto file_size = s->open_read_file(file_id, rel_path); file_size.has_value())
+      if (!s->index_recovered())
       {
-        return std::tuple{file_id, file_size.value(), std::format("{}/{}", s->root_path(), rel_path)};
+        continue;
+      }
+      if (auto file_size = co_await s->run_io([&]
+                                              { return s->probe_read_file(file_id, rel_path); });
+          file_size.has_value())
+      {
+        LOG_WARN(std::format("file '{}' not in index of '{}'", rel_path, s->root_path()));
+        co_return std::tuple{file_id, file_size.value(), std::format("{}/{}", s->root_path(), rel_path)};
       }
     }
 
+    co_return std::nullopt;
+  }
+
+  auto store_ctx_group::share_read_file(uint64_t origin_id) -> std::optional<uint64_t>
+  {
+    for (auto [s, file_id] : iterate_store(++m_store_idx))
+    {
+      if (s == store_of(origin_id))
+      {
+        return s->share_read_file(file_id, origin_id) ? std::optional{file_id} : std::nullopt;
+      }
+    }
     return std::nullopt;
   }
 
+  auto store_ctx_group::remove_file(std::string_view abs_path) -> bool
+  {
+    auto [store, rel_path] = find_store(abs_path);
+    if (!store)
+    {
+      LOG_ERROR(std::format("remove '{}' failed, not in {}", abs_path, m_name));
+      return false;
+    }
+    return store->remove_file(rel_path);
+  }
+
+  auto store_ctx_group::physical_path(std::string_view abs_path) -> std::string
+  {
+    auto [store, rel_path] = find_store(abs_path);
+    return store ? store->physical_path(rel_path) : std::string{abs_path};
+  }
+
+  auto store_ctx_group::async_file_crc32c(std::string_view abs_path) -> asio::awaitable<std::optional<uint32_t>>
+  {
+    auto [store, rel_path] = find_store(abs_path);
+    if (!store)
+    {
+      co_return get_file_crc32c(abs_path);
+    }
+    if (auto crc = store->indexed_crc32c(rel_path))
+    {
+      co_return crc;
+    }
+    co_return co_await store->run_io([&]
+                                     { return get_file_crc32c(abs_path); });
+  }
+
+  auto store_ctx_group::find_store(std::string_view abs_path) -> std::pair<std::shared_ptr<store_ctx>, std::string_view>
+  {
+    for (auto store : m_stores)
+    {
+      auto root_path = store->root_path();
+      if (abs_path.starts_with(root_path) && abs_path.size() > root_path.size() && abs_path[root_path.size()] == '/')
+      {
+        return {store, abs_path.substr(root_path.size() + 1)};
+      }
+    }
+    return {nullptr, {}};
+  }
+
   auto store_ctx_group::read_file(uint64_t file_id, uint64_t size) -> std::optional<std::vector<char>>
   {
     return m_stores[file_id % m_stores.size()]->read_file(file_id, size);
@@ -448,7 +1406,7 @@ namespace storage
     }
   }
 
-  auto store_ctx_group::copy_from_another_store(const std::string &abs_path) -> bool
+  auto store_ctx_group::async_copy_from_another_store(const std::string &abs_path) -> asio::awaitable<bool>
   {
     // 截取相对路径
     auto rel_path = std::string{};
@@ -468,7 +1426,7 @@ namespace storage
     if (rel_path.empty())
     {
       LOG_ERROR(std::format("invalid abs_path {}", abs_path));
-      return false;
+      co_return false;
     }
 
     auto file_size = std::filesystem::file_size(abs_path);
@@ -476,12 +1434,63 @@ namespace storage
     static auto idx = 0uz;
     for (auto i = 0uz; i < m_stores.size(); ++i)
     {
-      if (m_stores[(++idx) % m_stores.size()]->copy_from_another_store(file_size, abs_path, rel_path))
+      auto store = m_stores[(++idx) % m_stores.size()];
+      if (co_await store->run_io([&]
+                                 { return store->copy_from_another_store(file_size, abs_path, rel_path); }))
+      {
+        co_return true;
+      }
+    }
+    co_return false;
+  }
+
+  auto set_file_crc32c(std::string_view abs_path, uint32_t crc) -> bool
+  {
+    auto value = std::format("{:08x}", crc);
+    if (setxattr(std::string{abs_path}.data(), "user.dfs.crc32c", value.data(), value.size(), 0) != 0)
+    {
+      LOG_WARN(std::format("set crc32c of '{}' failed, {}", abs_path, strerror(errno)));
+      return false;
+    }
+    return true;
+  }
+
+  auto get_file_crc32c(std::string_view abs_path) -> std::optional<uint32_t>
+  {
+    auto path = std::string{abs_path};
+    char value[8];
+    if (getxattr(path.data(), "user.dfs.crc32c", value, sizeof(value)) == sizeof(value))
+    {
+      auto crc = uint32_t{};
+      if (std::from_chars(value, value + sizeof(value), crc, 16).ec == std::errc{})
       {
-        return true;
+        return crc;
       }
     }
-    return false;
+
+    /* 扩展属性不存在，读取整个文件计算 */
+    auto ifs = std::ifstream{path, std::ios::binary};
+    if (!ifs)
+    {
+      LOG_ERROR(std::format("open '{}' failed, {}", abs_path, strerror(errno)));
+      return std::nullopt;
+    }
+
+    auto crc = uint32_t{0};
+    auto buffer = std::vector<char>(1_MB);
+    while (ifs)
+    {
+      ifs.read(buffer.data(), buffer.size());
+      crc = common::crc32c(crc, {buffer.data(), (size_t)ifs.gcount()});
+    }
+    if (!ifs.eof())
+    {
+      LOG_ERROR(std::format("read '{}' failed", abs_path));
+      return std::nullopt;
+    }
+
+    set_file_crc32c(abs_path, crc);
+    return crc;
   }
 
-} // namespace storage
\ No newline at end of file
+} // namespace storage
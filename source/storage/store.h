@@ -1,11 +1,15 @@
 #pragma once
+#include "store_index.h"
+#include "volume.h"
+#include <asio.hpp>
 #include <atomic>
-#include <fstream>
+#include <functional>
 #include <generator>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 /*
@@ -18,9 +22,92 @@
   store_file_name，实际存储时的文件名（包括随机后缀），如 abc.txt_nIk6cAOx
 */
 
+namespace storage_detail
+{
+
+  /* 每个 root_path 下的扁平目录数量，00/00 到 FF/FF */
+  constexpr auto flat_dir_count = 256uz * 256;
+
+  /* 每个 store 缓存的 probe 未找到的 rel_path 数量，超过时清空 */
+  constexpr auto probe_miss_cache_size = 65536uz;
+
+} // namespace storage_detail
+
 namespace storage
 {
 
+  /**
+   * @brief 打开的文件，同一文件的读写是串行的，因此 offset 和 crc 无需加锁
+   *
+   * @param fd          文件描述符
+   * @param rel_path    相对路径
+   * @param offset      下一次读写的偏移
+   * @param crc         已写入数据的 CRC32C，只用于写入
+   * @param crc_valid   有数据通过 splice 写入时 crc 无效，需要读取文件计算
+   * @param unsynced    上次 fdatasync 之后写入的字节数
+   * @param end         读取的结束偏移，打包的文件为数据在卷中的结束位置
+   * @param begin       读取的起始偏移，打包的文件为数据在卷中的偏移
+   * @param fd_owner    共享其它读取的 fd 时为持有 fd 的文件，此时不关闭 fd
+   *
+   * 打包写入卷的小文件使用的字段：
+   * @param packed      数据缓存在 packed_data 中，关闭时一次写入卷
+   * @param packed_data 已写入的数据
+   *
+   * O_DIRECT 写入时使用的字段：
+   * @param direct_fd   以 O_DIRECT 打开的 fd，为 -1 时使用 fd 写入
+   * @param direct_buf  对齐的缓冲区，保存 [offset - direct_len, offset) 的数据，写满后通过 direct_fd 写入
+   * @param direct_len  缓冲区中的数据长度
+   *
+   * 异步写入使用的字段：
+   * @param pending_writes    已提交但未完成的写入数量
+   * @param drain_timer       等待写入全部完成，写入完成时取消
+   *
+   * io_uring 后端时使用的字段：
+   * @param uring_file        首次异步读写时创建
+   * @param direct_uring_file 首次异步写入 direct_fd 时创建
+   */
+  struct store_file
+  {
+    int fd = -1;
+    std::string rel_path;
+    uint64_t offset = 0;
+    uint32_t crc = 0;
+    bool crc_valid = true;
+    uint64_t unsynced = 0;
+    uint64_t end = 0;
+    uint64_t begin = 0;
+    std::shared_ptr<store_file> fd_owner;
+    bool packed = false;
+    std::vector<char> packed_data;
+    int direct_fd = -1;
+    char *direct_buf = nullptr;
+    uint64_t direct_len = 0;
+    uint32_t pending_writes = 0;
+    std::unique_ptr<asio::steady_timer> drain_timer;
+#ifdef ASIO_HAS_IO_URING
+    std::unique_ptr<asio::random_access_file> uring_file;
+    std::unique_ptr<asio::random_access_file> direct_uring_file;
+#endif
+
+    ~store_file();
+  };
+
+  /**
+   * @brief store 的 I/O 线程池统计
+   *
+   * @param depth       已提交但尚未开始执行的任务数量
+   * @param tasks       已执行的任务数量
+   * @param wait_us     任务在队列中等待的总时长
+   * @param max_wait_us 任务在队列中等待的最长时长
+   */
+  struct store_io_stats
+  {
+    uint64_t depth;
+    uint64_t tasks;
+    uint64_t wait_us;
+    uint64_t max_wait_us;
+  };
+
   class store_ctx
   {
   public:
@@ -28,6 +115,36 @@ namespace storage
 
     ~store_ctx() = default;
 
+    /**
+     * @brief 在 store 的 I/O 线程池中执行阻塞的磁盘操作，完成后在调用方的执行器上恢复协程。没有线程池时直接执行
+     *
+     */
+    template <typename Func>
+    auto run_io(Func func) -> asio::awaitable<std::invoke_result_t<Func>>
+    {
+      if (!m_io_pool)
+      {
+        co_return func();
+      }
+
+      ++m_io_depth;
+      auto queued = std::chrono::steady_clock::now();
+      co_return co_await asio::co_spawn(
+          m_io_pool->get_executor(),
+          [this, queued, &func]() -> asio::awaitable<std::invoke_result_t<Func>>
+          {
+            record_io_wait(queued);
+            co_return func();
+          },
+          asio::use_awaitable);
+    }
+
+    /**
+     * @brief I/O 线程池的统计
+     *
+     */
+    auto get_io_stats() -> store_io_stats;
+
     /**
      * @brief 创建文件
      *
@@ -49,7 +166,40 @@ namespace storage
     auto append_data(uint64_t file_id, std::span<char> data) -> bool;
 
     /**
-     * @brief 关闭写入流
+     * @brief 异步追加写入，io_uring 后端时由 io_uring 提交写入，否则在 I/O 线程池中写入，不阻塞 asio 线程
+     *
+     */
+    auto async_append_data(uint64_t file_id, std::span<char> data) -> asio::awaitable<bool>;
+
+    /**
+     * @brief 为零拷贝写入预留 size 字节，数据由调用方通过 splice 写入返回的 fd 和偏移，此后 write_crc32c 不再有效
+     *
+     * @return <fd, offset>
+     */
+    auto reserve_write(uint64_t file_id, uint64_t size) -> std::optional<std::pair<int, uint64_t>>;
+
+    /**
+     * @brief 等待已提交的异步写入全部完成。异步写入在提交时即确定偏移，同一文件可以有多个写入在途
+     *
+     */
+    auto async_drain_write_file(uint64_t file_id) -> asio::awaitable<void>;
+
+    /**
+     * @brief 在 I/O 线程池中执行对 file_id 的写入，如 reserve_write 之后的 splice，计入在途写入，关闭前会等待其完成
+     *
+     */
+    auto async_run_write(uint64_t file_id, std::function<bool()> write) -> asio::awaitable<bool>;
+
+    /**
+     * @brief 获取已写入数据的 CRC32C，在写入时增量计算
+     *
+     * @return 有数据通过 reserve_write 写入时返回 std::nullopt
+     *
+     */
+    auto write_crc32c(uint64_t file_id) -> std::optional<uint32_t>;
+
+    /**
+     * @brief 关闭写入的文件，并将已写入数据的 CRC32C 保存到文件的扩展属性
      *
      * @param user_file_name 用户提供文件名
      *
@@ -58,18 +208,45 @@ namespace storage
     auto close_write_file(uint64_t file_id, std::string_view user_file_name) -> std::optional<std::pair<std::string, std::string>>;
 
     /**
-     * @brief 关闭写入流
+     * @brief 关闭写入的文件，并将已写入数据的 CRC32C 保存到文件的扩展属性
      *
      */
     auto close_write_file(uint64_t file_id) -> std::optional<std::pair<std::string, std::string>>;
 
     /**
-     * @brief 打开读取流
+     * @brief 放弃未完成的写入，关闭并删除文件，不加入索引
+     *
+     */
+    auto abort_write_file(uint64_t file_id) -> void;
+
+    /**
+     * @brief 打开读取的文件，只打开索引中存在的文件
      *
      * @return 返回 file_size
      */
     auto open_read_file(uint64_t file_id, std::string_view rel_path) -> std::optional<uint64_t>;
 
+    /**
+     * @brief 索引命中时在 I/O 线程池中打开读取的文件
+     *
+     * @return 返回 file_size
+     */
+    auto async_open_read_file(uint64_t file_id, std::string_view rel_path) -> asio::awaitable<std::optional<uint64_t>>;
+
+    /**
+     * @brief 不经过索引直接打开读取的文件，成功时补充到索引中。索引没有截断或重建过时不查找磁盘，未找到的 rel_path 会被缓存
+     *
+     * @return 返回 file_size
+     */
+    auto probe_read_file(uint64_t file_id, std::string_view rel_path) -> std::optional<uint64_t>;
+
+    /**
+     * @brief 获取读取的文件在索引中记录的 CRC32C
+     *
+     * @return 写入时没有计算 CRC32C 时返回 std::nullopt
+     */
+    auto read_crc32c(uint64_t file_id) -> std::optional<uint32_t>;
+
     /**
      * @brief 读取文件内容
      *
@@ -85,11 +262,87 @@ namespace storage
     auto read_file(uint64_t file_id, char *dst, uint64_t size) -> std::optional<uint64_t>;
 
     /**
-     * @brief 关闭读取流
+     * @brief 异步读取文件内容，io_uring 后端时由 io_uring 提交读取，否则在 I/O 线程池中读取
+     *
+     * @return 返回实际读取的字节数
+     */
+    auto async_read_file(uint64_t file_id, char *dst, uint64_t size) -> asio::awaitable<std::optional<uint64_t>>;
+
+    /**
+     * @brief 为零拷贝读取预留最多 size 字节，数据由调用方通过 sendfile 从返回的 fd 和偏移读取
+     *
+     * @return <fd, offset, len, finish>，len 为实际预留的字节数，到达文件末尾时小于 size，finish 表示已预留到文件末尾
+     */
+    auto reserve_read(uint64_t file_id, uint64_t size) -> std::optional<std::tuple<int, uint64_t, uint64_t, bool>>;
+
+    /**
+     * @brief 以 origin_id 已打开的 fd 打开读取的文件，共享 fd 和预读状态，偏移从文件开头开始
+     *
+     * @return 返回 file_size，origin_id 未打开时返回 std::nullopt
+     */
+    auto share_read_file(uint64_t file_id, uint64_t origin_id) -> std::optional<uint64_t>;
+
+    /**
+     * @brief 关闭读取的文件
      *
      */
     auto close_read_file(uint64_t file_id) -> bool;
 
+    /**
+     * @brief 删除文件，并从索引中移除
+     *
+     */
+    auto remove_file(std::string_view rel_path) -> bool;
+
+    /**
+     * @brief 文件数据实际所在的路径，打包的文件为所在的卷
+     *
+     */
+    auto physical_path(std::string_view rel_path) -> std::string;
+
+    /**
+     * @brief 获取索引中记录的 CRC32C
+     *
+     * @return 文件不在索引中或写入时没有计算 CRC32C 时返回 std::nullopt
+     */
+    auto indexed_crc32c(std::string_view rel_path) -> std::optional<uint32_t>;
+
+    /**
+     * @brief 查找索引
+     *
+     */
+    auto find_index(std::string_view rel_path) -> std::optional<store_index_entry> { return m_index.find(rel_path); }
+
+    /**
+     * @brief 在索引的共享锁下遍历所有索引项
+     *
+     */
+    auto for_each_index(const std::function<void(std::string_view, const store_index_entry &)> &func) -> void { m_index.for_each(func); }
+
+    /**
+     * @brief 压缩已删除数据过多的卷
+     *
+     */
+    auto compact_volumes() -> void;
+
+    /**
+     * @brief 索引的文件数量
+     *
+     */
+    auto index_size() -> size_t { return m_index.size(); }
+
+    /**
+     * @brief 索引加载时是否截断或重建过，只有此时 probe_read_file 才查找磁盘
+     *
+     */
+    auto index_recovered() -> bool { return m_index.recovered(); }
+
+    /**
+     * @brief 卷的统计信息
+     *
+     */
+    auto get_volume_stats() -> volume_stats { return m_volumes.stats(); }
+
     /**
      * @brief 获取剩余可用空间，每隔一定调用次数，都会更新一次缓存
      *
@@ -108,6 +361,12 @@ namespace storage
      */
     auto root_path() -> std::string { return m_root_path; }
 
+    /**
+     * @brief 初始化耗时，单位毫秒
+     *
+     */
+    auto init_ms() -> uint64_t { return m_init_ms; }
+
     /**
      * @brief 生成一个有效的绝对路径
      *
@@ -125,36 +384,66 @@ namespace storage
 
   private:
     /**
-     * @brief 获取 ofstream
+     * @brief 获取写入的文件
      *
-     * @return <ofs, rel_path>
      */
-    auto peek_ofstream(uint64_t file_id) -> std::pair<std::shared_ptr<std::ofstream>, std::string>;
+    auto peek_write_file(uint64_t file_id) -> std::shared_ptr<store_file>;
 
     /**
-     * @brief 获取 ofstream 且会移除
+     * @brief 获取写入的文件且会移除
      *
-     * @return <ofs, rel_path>
      */
-    auto pop_ofstream(uint64_t file_id) -> std::pair<std::shared_ptr<std::ofstream>, std::string>;
+    auto pop_write_file(uint64_t file_id) -> std::shared_ptr<store_file>;
 
     /**
-     * @brief 获取 ifstream
+     * @brief 获取读取的文件
      *
      */
-    auto peek_ifstream(uint64_t file_id) -> std::pair<std::shared_ptr<std::ifstream>, std::string>;
+    auto peek_read_file(uint64_t file_id) -> std::shared_ptr<store_file>;
 
     /**
-     * @brief 获取 ifstream 且会移除
+     * @brief 获取读取的文件且会移除
      *
      */
-    auto pop_ifstream(uint64_t file_id) -> std::pair<std::shared_ptr<std::ifstream>, std::string>;
+    auto pop_read_file(uint64_t file_id) -> std::shared_ptr<store_file>;
 
     /**
-     * @brief 创建 ofstream，并填充空洞
+     * @brief 创建文件，并通过 fallocate 预留 file_size 的磁盘空间。文件不小于 direct_io_min_mb 时额外以 O_DIRECT 打开
      *
      */
-    auto create_ofstream(std::string_view rel_path, uint64_t file_size) -> std::shared_ptr<std::ofstream>;
+    auto create_store_file(std::string_view rel_path, uint64_t file_size) -> std::shared_ptr<store_file>;
+
+    /**
+     * @brief 写入 O_DIRECT 缓冲区中剩余的数据并关闭 direct_fd，此后的写入均通过 fd
+     *
+     */
+    auto finish_direct_write(store_file &file) -> bool;
+
+    /**
+     * @brief 打开读取的文件，不检查索引
+     *
+     * @return 返回 file_size
+     */
+    auto open_file(uint64_t file_id, std::string_view rel_path) -> std::optional<uint64_t>;
+
+    /**
+     * @brief 打开读取的打包文件
+     *
+     * @return 返回 file_size
+     */
+    auto open_packed_file(uint64_t file_id, std::string_view rel_path, store_index_entry entry) -> std::optional<uint64_t>;
+
+    /**
+     * @brief 任务开始执行时记录在队列中等待的时长
+     *
+     */
+    auto record_io_wait(std::chrono::steady_clock::time_point queued) -> void;
+
+    /**
+     * @brief 创建打包写入卷的文件，数据先缓存在内存中
+     *
+     */
+    auto create_packed_file(std::string_view rel_path, uint64_t file_size) -> std::shared_ptr<store_file>;
 
     /**
      * @brief 获取下一个扁平路径
@@ -175,6 +464,12 @@ namespace storage
      */
     auto valid_rel_path(std::string_view flat_path) -> std::string;
 
+    /**
+     * @brief 确保 rel_path 所在的扁平目录存在，每个扁平目录只在第一次使用时创建
+     *
+     */
+    auto ensure_flat_dir(std::string_view rel_path) -> bool;
+
     /**
      * @brief 减少磁盘缓存
      *
@@ -192,11 +487,28 @@ namespace storage
     std::atomic_uint16_t m_flat_idx = 0;  // 扁平路径索引
     uint64_t m_disk_total = 0;            // 磁盘总空间
     std::atomic_uint64_t m_disk_free = 0; // 磁盘可用空间
+    uint64_t m_init_ms = 0;               // 初始化耗时
+
+    /* 已确认存在的扁平目录，启动时不再逐个创建 65536 个目录 */
+    std::vector<std::atomic_bool> m_flat_dirs = std::vector<std::atomic_bool>(storage_detail::flat_dir_count);
+
+    std::map<uint64_t, std::shared_ptr<store_file>> m_read_files; // 读取中的文件
+    std::mutex m_read_files_mut;
+    std::map<uint64_t, std::shared_ptr<store_file>> m_write_files; // 写入中的文件
+    std::mutex m_write_files_mut;
 
-    std::map<uint64_t, std::pair<std::shared_ptr<std::ifstream>, std::string>> m_ifstreams; // <流, 相对路径>
-    std::mutex m_ifstreams_mtx;
-    std::map<uint64_t, std::pair<std::shared_ptr<std::ofstream>, std::string>> m_ofstreams; // <流, 相对路径>
-    std::mutex m_ofstream_mut;
+    store_index m_index;  // 文件索引
+
+    /* 索引恢复过时 probe 未找到的 rel_path，之后写入的文件都会进入索引，因此不会变为存在 */
+    std::unordered_set<std::string> m_probe_misses;
+    std::mutex m_probe_misses_mut;
+    volume_set m_volumes; // 小文件卷
+
+    std::unique_ptr<asio::thread_pool> m_io_pool; // 阻塞磁盘操作的线程池，io_threads_per_store 为 0 时为空
+    std::atomic_uint64_t m_io_depth = 0;
+    std::atomic_uint64_t m_io_tasks = 0;
+    std::atomic_uint64_t m_io_wait_us = 0;
+    std::atomic_uint64_t m_io_max_wait_us = 0;
   };
 
   /**
@@ -210,34 +522,106 @@ namespace storage
 
     ~store_ctx_group() = default;
 
-    auto create_file(uint64_t file_size) -> std::optional<uint64_t>;
+    /**
+     * @brief 在 I/O 线程池中创建文件
+     *
+     */
+    auto async_create_file(uint64_t file_size) -> asio::awaitable<std::optional<uint64_t>>;
 
-    auto create_file(uint64_t file_size, std::string_view rel_path) -> std::optional<uint64_t>;
+    auto async_create_file(uint64_t file_size, std::string_view rel_path) -> asio::awaitable<std::optional<uint64_t>>;
 
     auto write_file(uint64_t file_id, std::span<char> data) -> bool;
 
+    auto async_write_file(uint64_t file_id, std::span<char> data) -> asio::awaitable<bool> { return m_stores[file_id % m_stores.size()]->async_append_data(file_id, data); }
+
+    auto reserve_write(uint64_t file_id, uint64_t size) -> std::optional<std::pair<int, uint64_t>> { return m_stores[file_id % m_stores.size()]->reserve_write(file_id, size); }
+
+    auto async_drain_write_file(uint64_t file_id) -> asio::awaitable<void> { return m_stores[file_id % m_stores.size()]->async_drain_write_file(file_id); }
+
+    auto async_run_write(uint64_t file_id, std::function<bool()> write) -> asio::awaitable<bool> { return m_stores[file_id % m_stores.size()]->async_run_write(file_id, std::move(write)); }
+
     auto close_write_file(uint64_t file_id, std::string_view user_file_name) -> std::optional<std::pair<std::string, std::string>> { return m_stores[file_id % m_stores.size()]->close_write_file(file_id, user_file_name); }
 
     auto close_write_file(uint64_t file_id) -> std::optional<std::pair<std::string, std::string>> { return m_stores[file_id % m_stores.size()]->close_write_file(file_id); }
 
     /**
-     * @brief 打开文件
+     * @brief 在 I/O 线程池中关闭写入的文件
+     *
+     */
+    auto async_close_write_file(uint64_t file_id, std::string_view user_file_name) -> asio::awaitable<std::optional<std::pair<std::string, std::string>>>;
+
+    auto async_close_write_file(uint64_t file_id) -> asio::awaitable<std::optional<std::pair<std::string, std::string>>>;
+
+    /**
+     * @brief 放弃未完成的写入，等待线程池中已提交的写入完成后再关闭文件，避免关闭仍在使用的 fd
+     *
+     */
+    auto async_abort_write_file(uint64_t file_id) -> asio::awaitable<void>;
+
+    auto write_crc32c(uint64_t file_id) -> std::optional<uint32_t> { return m_stores[file_id % m_stores.size()]->write_crc32c(file_id); }
+
+    /**
+     * @brief 打开文件，通过各个 store 的索引查找文件所在的 store，只在索引命中时在 I/O 线程池中打开
+     *
+     * @return 返回 <file_id, file_size, abs_path>
+     */
+    auto async_open_read_file(std::string_view rel_path) -> asio::awaitable<std::optional<std::tuple<uint64_t, uint64_t, std::string>>>;
+
+    /**
+     * @brief 依次尝试在每个 store 上打开文件，用于索引中没有记录的文件（如崩溃前尚未写入索引）
      *
      * @return 返回 <file_id, file_size, abs_path>
      */
-    auto open_read_file(std::string_view rel_path) -> std::optional<std::tuple<uint64_t, uint64_t, std::string>>;
+    auto async_probe_read_file(std::string_view rel_path) -> asio::awaitable<std::optional<std::tuple<uint64_t, uint64_t, std::string>>>;
+
+    auto read_crc32c(uint64_t file_id) -> std::optional<uint32_t> { return m_stores[file_id % m_stores.size()]->read_crc32c(file_id); }
+
+    /**
+     * @brief 删除 abs_path 所在 store 上的文件，并从索引中移除
+     *
+     */
+    auto remove_file(std::string_view abs_path) -> bool;
+
+    /**
+     * @brief 文件数据实际所在的路径，打包的文件为所在的卷，用于持久化
+     *
+     */
+    auto physical_path(std::string_view abs_path) -> std::string;
+
+    /**
+     * @brief 获取文件的 CRC32C，优先使用索引中的记录，否则在 I/O 线程池中读取文件计算
+     *
+     */
+    auto async_file_crc32c(std::string_view abs_path) -> asio::awaitable<std::optional<uint32_t>>;
 
     auto read_file(uint64_t file_id, uint64_t size) -> std::optional<std::vector<char>>;
 
     auto read_file(uint64_t file_id, char *dst, uint64_t size) -> std::optional<uint64_t>;
 
+    auto async_read_file(uint64_t file_id, char *dst, uint64_t size) -> asio::awaitable<std::optional<uint64_t>> { return m_stores[file_id % m_stores.size()]->async_read_file(file_id, dst, size); }
+
+    auto reserve_read(uint64_t file_id, uint64_t size) -> std::optional<std::tuple<int, uint64_t, uint64_t, bool>> { return m_stores[file_id % m_stores.size()]->reserve_read(file_id, size); }
+
     auto close_read_file(uint64_t file_id) -> bool { return m_stores[file_id % m_stores.size()]->close_read_file(file_id); }
 
     /**
-     * @brief 从另一个 store 中拷贝文件
+     * @brief 在 origin_id 所在的 store 上分配新的 file_id，共享 origin_id 的 fd
+     *
+     * @return 返回新的 file_id
+     */
+    auto share_read_file(uint64_t origin_id) -> std::optional<uint64_t>;
+
+    /**
+     * @brief file_id 所在的 store
+     *
+     */
+    auto store_of(uint64_t file_id) -> std::shared_ptr<store_ctx> { return m_stores[file_id % m_stores.size()]; }
+
+    /**
+     * @brief 在 I/O 线程池中从另一个 store 中拷贝文件
      *
      */
-    auto copy_from_another_store(const std::string &abs_path) -> bool;
+    auto async_copy_from_another_store(const std::string &abs_path) -> asio::awaitable<bool>;
 
     /**
      * @brief 生成有效的绝对路径
@@ -264,6 +648,13 @@ namespace storage
      */
     auto stores() -> std::vector<std::shared_ptr<store_ctx>> { return m_stores; }
 
+    /**
+     * @brief 查找 abs_path 所在的 store
+     *
+     * @return store 和 rel_path，不属于本组时 store 为空
+     */
+    auto find_store(std::string_view abs_path) -> std::pair<std::shared_ptr<store_ctx>, std::string_view>;
+
   private:
     /**
      * @brief 从 idx 开始遍历所有 store
@@ -282,4 +673,17 @@ namespace storage
     /* 表达式 `idx % m_stores.size()` 可以获取具体的 store，对于 store，可以通过 idx 获取具体的文件 */
     std::atomic_uint64_t m_store_idx = 0;
   };
+
+  /**
+   * @brief 将文件的 CRC32C 保存到扩展属性 user.dfs.crc32c
+   *
+   */
+  auto set_file_crc32c(std::string_view abs_path, uint32_t crc) -> bool;
+
+  /**
+   * @brief 读取文件的 CRC32C，扩展属性不存在时（如旧版本写入或迁移后的文件）读取整个文件计算并保存
+   *
+   */
+  auto get_file_crc32c(std::string_view abs_path) -> std::optional<uint32_t>;
+
 } // namespace storage
@@ -0,0 +1,372 @@
+#include "store_index.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <common/log.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <mutex>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace storage_detail
+{
+
+  /**
+   * @brief 写入 fd，直到全部写入
+   *
+   */
+  auto write_all(int fd, const char *data, size_t size) -> bool
+  {
+    for (auto written = 0uz; written < size;)
+    {
+      auto n = write(fd, data + written, size - written);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        return false;
+      }
+      written += n;
+    }
+    return true;
+  }
+
+  /**
+   * @brief 序列化一条记录
+   *
+   */
+  auto encode_index_record(std::string &out, store_index_op op, std::string_view rel_path, const storage::store_index_entry &entry) -> void
+  {
+    auto record = store_index_record{
+        .op = std::to_underlying(op),
+        .crc_valid = entry.crc_valid,
+        .path_len = (uint16_t)rel_path.size(),
+        .crc32c = entry.crc32c,
+        .size = entry.size,
+        .ctime = entry.ctime,
+        .mtime = entry.mtime,
+        .volume = entry.volume,
+        .offset = entry.offset,
+    };
+    out.append((const char *)&record, sizeof(record));
+    out.append(rel_path);
+  }
+
+} // namespace storage_detail
+
+namespace storage
+{
+
+  using namespace storage_detail;
+
+  store_index::store_index(std::string_view root_path)
+      : m_root_path{root_path},
+        m_log_path{std::format("{}/{}", root_path, store_index_file_name)}
+  {
+  }
+
+  store_index::~store_index()
+  {
+    if (m_log_fd != -1)
+    {
+      close(m_log_fd);
+    }
+  }
+
+  auto store_index::load() -> bool
+  {
+    auto lock = std::unique_lock{m_mut};
+    auto begin = std::chrono::steady_clock::now();
+    auto rebuilt = !replay();
+    if (rebuilt)
+    {
+      LOG_INFO(std::format("rebuild index of '{}'", m_root_path));
+      m_recovered = true;
+      m_entries.clear();
+      rebuild();
+    }
+
+    /* 重建后或日志中过期记录过多时重写日志 */
+    if (m_log_fd == -1 || m_log_records > m_entries.size() * store_index_compact_ratio)
+    {
+      compact();
+    }
+    LOG_INFO(std::format("load index of '{}' suc, {} files, cost {}ms", m_root_path, m_entries.size(),
+                         std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count()));
+    return rebuilt;
+  }
+
+  auto store_index::find(std::string_view rel_path) -> std::optional<store_index_entry>
+  {
+    auto lock = std::shared_lock{m_mut};
+    auto it = m_entries.find(rel_path);
+    if (it == m_entries.end())
+    {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
+  auto store_index::put(std::string_view rel_path, store_index_entry entry) -> void
+  {
+    auto lock = std::unique_lock{m_mut};
+    m_entries.insert_or_assign(std::string{rel_path}, entry);
+    append_record(store_index_op::put, rel_path, entry);
+  }
+
+  auto store_index::put_from_disk(std::string_view rel_path) -> bool
+  {
+    auto entry = read_index_entry(std::format("{}/{}", m_root_path, rel_path));
+    if (!entry)
+    {
+      return false;
+    }
+    put(rel_path, entry.value());
+    return true;
+  }
+
+  auto store_index::relocate(std::string_view rel_path, uint32_t volume, uint64_t offset, store_index_entry entry) -> bool
+  {
+    auto lock = std::unique_lock{m_mut};
+    auto it = m_entries.find(rel_path);
+    if (it == m_entries.end() || it->second.volume != volume || it->second.offset != offset)
+    {
+      return false;
+    }
+    it->second = entry;
+    append_record(store_index_op::put, rel_path, entry);
+    return true;
+  }
+
+  auto store_index::erase(std::string_view rel_path) -> std::optional<store_index_entry>
+  {
+    auto lock = std::unique_lock{m_mut};
+    auto it = m_entries.find(rel_path);
+    if (it == m_entries.end())
+    {
+      return std::nullopt;
+    }
+    auto entry = it->second;
+    m_entries.erase(it);
+    append_record(store_index_op::erase, rel_path, {});
+    return entry;
+  }
+
+  auto store_index::for_each(const std::function<void(std::string_view, const store_index_entry &)> &func) -> void
+  {
+    auto lock = std::shared_lock{m_mut};
+    for (const auto &[rel_path, entry] : m_entries)
+    {
+      func(rel_path, entry);
+    }
+  }
+
+  auto store_index::size() -> size_t
+  {
+    auto lock = std::shared_lock{m_mut};
+    return m_entries.size();
+  }
+
+  auto store_index::replay() -> bool
+  {
+    auto fd = open(m_log_path.data(), O_RDWR | O_APPEND | O_CLOEXEC);
+    if (fd == -1)
+    {
+      return false;
+    }
+
+    struct stat st{};
+    auto data = std::string{};
+    if (fstat(fd, &st) == 0)
+    {
+      data.resize(st.st_size);
+    }
+    for (auto idx = 0uz; idx < data.size();)
+    {
+      auto n = pread(fd, data.data() + idx, data.size() - idx, idx);
+      if (n <= 0)
+      {
+        data.resize(idx);
+        break;
+      }
+      idx += n;
+    }
+
+    auto header = (const store_index_header *)data.data();
+    if (data.size() < sizeof(store_index_header) || header->magic != store_index_magic || header->version != store_index_version)
+    {
+      LOG_WARN(std::format("invalid index '{}'", m_log_path));
+      close(fd);
+      return false;
+    }
+
+    auto offset = sizeof(store_index_header);
+    while (offset + sizeof(store_index_record) <= data.size())
+    {
+      auto record = (const store_index_record *)(data.data() + offset);
+      if (offset + sizeof(store_index_record) + record->path_len > data.size() ||
+          record->op > std::to_underlying(store_index_op::erase))
+      {
+        break;
+      }
+
+      auto rel_path = std::string{data.data() + offset + sizeof(store_index_record), record->path_len};
+      if (record->op == std::to_underlying(store_index_op::put))
+      {
+        m_entries.insert_or_assign(std::move(rel_path), store_index_entry{
+                                                            .size = record->size,
+                                                            .crc32c = record->crc32c,
+                                                            .crc_valid = record->crc_valid != 0,
+                                                            .ctime = record->ctime,
+                                                            .mtime = record->mtime,
+                                                            .volume = record->volume,
+                                                            .offset = record->offset,
+                                                        });
+      }
+      else
+      {
+        m_entries.erase(rel_path);
+      }
+      offset += sizeof(store_index_record) + record->path_len;
+      ++m_log_records;
+    }
+
+    /* 写入记录时崩溃，截断不完整的部分，之后的记录从此处追加 */
+    if (offset != data.size())
+    {
+      LOG_WARN(std::format("truncate index '{}' from {} to {} bytes", m_log_path, data.size(), offset));
+      m_recovered = true;
+      if (ftruncate(fd, offset) != 0)
+      {
+        LOG_ERROR(std::format("truncate index '{}' failed, {}", m_log_path, strerror(errno)));
+      }
+    }
+
+    m_log_fd = fd;
+    return true;
+  }
+
+  auto store_index::rebuild() -> void
+  {
+    /* 每个线程依次领取一级扁平目录，扫描结果在线程内汇总后再合并 */
+    auto next_dir = std::atomic_uint32_t{0};
+    auto merge_mut = std::mutex{};
+    auto worker = [&]
+    {
+      auto entries = std::vector<std::pair<std::string, store_index_entry>>{};
+      for (auto dir = next_dir++; dir < 256; dir = next_dir++)
+      {
+        auto ec = std::error_code{};
+        auto top = std::format("{}/{:02X}", m_root_path, dir);
+        for (auto it = std::filesystem::recursive_directory_iterator{top, ec}; !ec && it != std::filesystem::recursive_directory_iterator{}; it.increment(ec))
+        {
+          if (!it->is_regular_file(ec))
+          {
+            continue;
+          }
+          auto abs_path = it->path().string();
+          if (auto entry = read_index_entry(abs_path))
+          {
+            entries.emplace_back(abs_path.substr(m_root_path.size() + 1), entry.value());
+          }
+        }
+      }
+
+      auto lock = std::unique_lock{merge_mut};
+      for (auto &[rel_path, entry] : entries)
+      {
+        m_entries.insert_or_assign(std::move(rel_path), entry);
+      }
+    };
+
+    auto threads = std::vector<std::jthread>{};
+    auto count = std::clamp(std::thread::hardware_concurrency(), 1u, store_index_rebuild_threads);
+    for (auto i = 0u; i < count; ++i)
+    {
+      threads.emplace_back(worker);
+    }
+  }
+
+  auto store_index::compact() -> bool
+  {
+    auto data = std::string{};
+    auto header = store_index_header{.magic = store_index_magic, .version = store_index_version};
+    data.append((const char *)&header, sizeof(header));
+    for (const auto &[rel_path, entry] : m_entries)
+    {
+      encode_index_record(data, store_index_op::put, rel_path, entry);
+    }
+
+    /* 先写入临时文件再重命名，任何时刻磁盘上都有完整的日志 */
+    auto tmp_path = std::format("{}.tmp", m_log_path);
+    auto fd = open(tmp_path.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1 || !write_all(fd, data.data(), data.size()) || fdatasync(fd) != 0 || rename(tmp_path.data(), m_log_path.data()) != 0)
+    {
+      LOG_ERROR(std::format("write index '{}' failed, {}", m_log_path, strerror(errno)));
+      if (fd != -1)
+      {
+        close(fd);
+      }
+      return false;
+    }
+    close(fd);
+
+    if (m_log_fd != -1)
+    {
+      close(m_log_fd);
+    }
+    m_log_fd = open(m_log_path.data(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    m_log_records = m_entries.size();
+    return m_log_fd != -1;
+  }
+
+  auto store_index::append_record(store_index_op op, std::string_view rel_path, const store_index_entry &entry) -> void
+  {
+    if (m_log_fd == -1)
+    {
+      return;
+    }
+
+    /* 一次 write 写入完整的记录，O_APPEND 保证记录之间不会交错 */
+    auto data = std::string{};
+    encode_index_record(data, op, rel_path, entry);
+    if (!write_all(m_log_fd, data.data(), data.size()))
+    {
+      LOG_ERROR(std::format("append index '{}' failed, {}", m_log_path, strerror(errno)));
+      return;
+    }
+    ++m_log_records;
+  }
+
+  auto read_index_entry(std::string_view abs_path) -> std::optional<store_index_entry>
+  {
+    auto path = std::string{abs_path};
+    struct stat st{};
+    if (stat(path.data(), &st) != 0)
+    {
+      return std::nullopt;
+    }
+
+    auto entry = store_index_entry{
+        .size = (uint64_t)st.st_size,
+        .crc32c = 0,
+        .crc_valid = false,
+        .ctime = st.st_ctime,
+        .mtime = st.st_mtime,
+    };
+
+    char value[8];
+    if (getxattr(path.data(), "user.dfs.crc32c", value, sizeof(value)) == sizeof(value))
+    {
+      entry.crc_valid = std::from_chars(value, value + sizeof(value), entry.crc32c, 16).ec == std::errc{};
+    }
+    return entry;
+  }
+
+} // namespace storage
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace storage_detail
+{
+
+  /* 索引日志的文件名，位于 root_path 下，以 . 开头，遍历存储文件时跳过 */
+  constexpr auto store_index_file_name = std::string_view{".index"};
+
+  constexpr auto store_index_magic = uint32_t{0x49534644}; // "DFSI"
+
+  constexpr auto store_index_version = uint32_t{2};
+
+  /* 日志记录数超过索引项数的该倍数时，启动时重写日志 */
+  constexpr auto store_index_compact_ratio = 2u;
+
+  /* 重建索引时扫描磁盘的最大线程数 */
+  constexpr auto store_index_rebuild_threads = 16u;
+
+  /**
+   * @brief 索引日志的文件头
+   *
+   */
+  struct store_index_header
+  {
+    uint32_t magic;
+    uint32_t version;
+  };
+
+  /**
+   * @brief 索引日志的记录，其后紧跟 path_len 字节的 rel_path
+   *
+   * @param op        store_index_op
+   * @param crc_valid crc32c 是否有效
+   * @param path_len  rel_path 的长度
+   */
+  struct store_index_record
+  {
+    uint8_t op;
+    uint8_t crc_valid;
+    uint16_t path_len;
+    uint32_t crc32c;
+    uint64_t size;
+    int64_t ctime;
+    int64_t mtime;
+    uint32_t volume;
+    uint32_t reserved;
+    uint64_t offset;
+  };
+  static_assert(sizeof(store_index_record) == 48);
+
+  enum class store_index_op : uint8_t
+  {
+    put,
+    erase,
+  };
+
+  /**
+   * @brief 支持以 std::string_view 查找 std::string 键
+   *
+   */
+  struct store_index_hash
+  {
+    using is_transparent = void;
+
+    auto operator()(std::string_view str) const -> size_t { return std::hash<std::string_view>{}(str); }
+  };
+
+} // namespace storage_detail
+
+namespace storage
+{
+
+  /**
+   * @brief 索引项
+   *
+   * @param size        文件大小
+   * @param crc32c      文件的 CRC32C，crc_valid 为 false 时无效
+   * @param crc_valid   写入时是否计算了 CRC32C
+   * @param ctime       创建时间，单位秒
+   * @param mtime       修改时间，单位秒
+   * @param volume      打包存储时所在卷的编号，为 0 时是独立的文件
+   * @param offset      打包存储时数据在卷中的偏移
+   */
+  struct store_index_entry
+  {
+    uint64_t size;
+    uint32_t crc32c;
+    bool crc_valid;
+    int64_t ctime;
+    int64_t mtime;
+    uint32_t volume = 0;
+    uint64_t offset = 0;
+  };
+
+  /**
+   * @brief store 的文件索引，rel_path 到文件信息的映射
+   *
+   * 索引全部缓存在内存中，修改以追加日志的方式写入 root_path/.index。启动时回放日志，日志不存在或损坏时并行扫描磁盘重建。
+   * 日志末尾不完整的记录（写入时崩溃）会被截断，崩溃前尚未写入日志的文件由 store_ctx_group::async_probe_read_file 找到后补充，
+   * 只有截断或重建过的索引才需要这样查找。
+   */
+  class store_index
+  {
+  public:
+    store_index(std::string_view root_path);
+
+    ~store_index();
+
+    /**
+     * @brief 加载索引，日志不存在或损坏时从磁盘重建
+     *
+     * @return 是否重建了索引，重建时只包含独立的文件
+     */
+    auto load() -> bool;
+
+    /**
+     * @brief 查找文件
+     *
+     */
+    auto find(std::string_view rel_path) -> std::optional<store_index_entry>;
+
+    /**
+     * @brief 添加或更新文件
+     *
+     */
+    auto put(std::string_view rel_path, store_index_entry entry) -> void;
+
+    /**
+     * @brief 读取磁盘上的文件信息，添加或更新文件
+     *
+     * @return 文件不存在时返回 false
+     */
+    auto put_from_disk(std::string_view rel_path) -> bool;
+
+    /**
+     * @brief 仍位于卷 volume 的 offset 处时，更新文件的位置
+     *
+     * @return 文件已被移除或移动时返回 false
+     */
+    auto relocate(std::string_view rel_path, uint32_t volume, uint64_t offset, store_index_entry entry) -> bool;
+
+    /**
+     * @brief 移除文件
+     *
+     * @return 被移除的索引项，不存在时返回 std::nullopt
+     */
+    auto erase(std::string_view rel_path) -> std::optional<store_index_entry>;
+
+    /**
+     * @brief 在共享锁下遍历所有索引项，func 中不能修改索引
+     *
+     */
+    auto for_each(const std::function<void(std::string_view, const store_index_entry &)> &func) -> void;
+
+    /**
+     * @brief 索引的文件数量
+     *
+     */
+    auto size() -> size_t;
+
+    /**
+     * @brief 加载时是否截断了日志或重建了索引，此时崩溃前写入的文件可能不在索引中
+     *
+     */
+    auto recovered() -> bool { return m_recovered; }
+
+  private:
+    /**
+     * @brief 回放日志
+     *
+     * @return 日志不存在或文件头无效时返回 false
+     */
+    auto replay() -> bool;
+
+    /**
+     * @brief 按 256 个一级扁平目录并行扫描磁盘
+     *
+     */
+    auto rebuild() -> void;
+
+    /**
+     * @brief 将当前的索引写入新的日志，替换旧日志
+     *
+     */
+    auto compact() -> bool;
+
+    /**
+     * @brief 追加一条记录，调用方持有 m_mut
+     *
+     */
+    auto append_record(store_index_op op, std::string_view rel_path, const store_index_entry &entry) -> void;
+
+  private:
+    std::string m_root_path;
+    std::string m_log_path;
+    int m_log_fd = -1;
+    uint64_t m_log_records = 0;
+    bool m_recovered = false;
+
+    std::unordered_map<std::string, store_index_entry, storage_detail::store_index_hash, std::equal_to<>> m_entries;
+    std::shared_mutex m_mut;
+  };
+
+  /**
+   * @brief 读取磁盘上的文件信息，crc32c 取自扩展属性，不存在时无效
+   *
+   */
+  auto read_index_entry(std::string_view abs_path) -> std::optional<store_index_entry>;
+
+} // namespace storage
@@ -1,5 +1,7 @@
 #include "store_util.h"
 #include "config.h"
+#include <common/log.h>
+#include <thread>
 
 namespace storage
 {
@@ -8,8 +10,34 @@ namespace storage
 
   auto init_store_group() -> void
   {
-    hot_store_group_ = std::make_shared<store_ctx_group>("hot_store_group", storage_config.server.hot_paths);
-    cold_store_group_ = std::make_shared<store_ctx_group>("cold_store_group", storage_config.server.cold_paths);
+    auto begin = std::chrono::steady_clock::now();
+    {
+      /* 冷热两组 store 并行初始化 */
+      auto cold = std::jthread{[]
+                               { cold_store_group_ = std::make_shared<store_ctx_group>("cold_store_group", storage_config.server.cold_paths); }};
+      hot_store_group_ = std::make_shared<store_ctx_group>("hot_store_group", storage_config.server.hot_paths);
+    }
+    store_group_init_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    LOG_INFO(std::format("init store group suc, cost {}ms", store_group_init_ms));
+  }
+
+  auto start_volume_compact_service() -> void
+  {
+    std::thread{[]
+                {
+                  while (true)
+                  {
+                    std::this_thread::sleep_for(volume_compact_interval);
+                    for (auto group : store_groups())
+                    {
+                      for (auto store : group->stores())
+                      {
+                        store->compact_volumes();
+                      }
+                    }
+                  }
+                }}
+        .detach();
   }
 
   auto hot_store_group() -> std::shared_ptr<store_ctx_group>
@@ -10,6 +10,11 @@ namespace storage_detail
 
   inline auto cold_store_group_ = std::shared_ptr<store_ctx_group>{};
 
+  inline auto store_group_init_ms = uint64_t{0}; // 初始化所有 store group 的耗时
+
+  /* 检查是否有卷需要压缩的间隔 */
+  constexpr auto volume_compact_interval = std::chrono::minutes{10};
+
 } // namespace storage_detail
 
 namespace storage
@@ -20,6 +25,12 @@ namespace storage
    */
   auto init_store_group() -> void;
 
+  /**
+   * @brief 启动后台压缩小文件卷的线程
+   *
+   */
+  auto start_volume_compact_service() -> void;
+
   /**
    * @brief 获取 hot store group
    *
@@ -2,9 +2,11 @@
 #include "config.h"
 #include "server_for_storage.h"
 #include "store_util.h"
+#include <algorithm>
 #include <common/exception.h>
 #include <common/util.h>
-#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <limits>
 
 namespace storage_detail
 {
@@ -27,7 +29,11 @@ namespace storage_detail
       auto total_file = 0;
       for (const auto &rel_path : pop_not_synced_files())
       {
-        auto res = hot_store_group()->open_read_file(rel_path);
+        auto res = co_await hot_store_group()->async_open_read_file(rel_path);
+        if (!res)
+        {
+          res = co_await hot_store_group()->async_probe_read_file(rel_path);
+        }
         if (!res)
         {
           LOG_WARN("open not synced file {} failed", rel_path);
@@ -35,7 +41,10 @@ namespace storage_detail
         }
         auto [file_id, file_size, abs_path] = res.value();
 
-        if (file_size <= storage_config.performance.zero_copy_limit * 1_MB)
+        /* 有对端协商了压缩时读到内存中发送，以便压缩 */
+        auto compress = std::ranges::any_of(registed_storages(), [&](const auto &s_conn)
+                                            { return s_conn->compresses(file_size); });
+        if (storage_config.performance.zero_copy_limit != 0 && !compress)
         {
           co_await sync_file_zero_copy(rel_path, file_id, file_size, abs_path);
         }
@@ -60,9 +69,38 @@ namespace storage_detail
     *(uint64_t *)request_to_send->data = common::htonll(file_size);
     std::copy(rel_path.begin(), rel_path.end(), request_to_send->data + sizeof(uint64_t));
 
+    /* 协商了校验的对端在 filesize 后携带 crc32c */
+    auto crc = std::optional<uint32_t>{};
+    auto request_with_crc = common::proto_frame_ptr{};
+
     for (auto s_conn : registed_storages())
     {
-      auto response_recved = co_await s_conn->send_request_and_wait_response(request_to_send);
+      auto request = request_to_send;
+      if (s_conn->capabilities().has(common::CAP_CHECKSUM_CRC32C))
+      {
+        if (!request_with_crc)
+        {
+          crc = hot_store_group()->read_crc32c(file_id);
+          if (!crc)
+          {
+            crc = co_await hot_store_group()->async_file_crc32c(abs_path);
+          }
+          if (!crc)
+          {
+            LOG_ERROR("get crc32c of {} failed", abs_path);
+            push_not_synced_file(rel_path);
+            co_return std::vector<std::shared_ptr<common::connection>>{};
+          }
+
+          request_with_crc = common::create_frame(common::proto_cmd::ss_upload_sync_start, common::frame_type::request, sizeof(uint64_t) + sizeof(uint32_t) + rel_path.size());
+          *(uint64_t *)request_with_crc->data = common::htonll(file_size);
+          *(uint32_t *)(request_with_crc->data + sizeof(uint64_t)) = htonl(crc.value());
+          std::copy(rel_path.begin(), rel_path.end(), request_with_crc->data + sizeof(uint64_t) + sizeof(uint32_t));
+        }
+        request = request_with_crc;
+      }
+
+      auto response_recved = co_await s_conn->send_request_and_wait_response(request);
       if (!response_recved || response_recved->stat != 0)
       {
         LOG_ERROR("storage {} is unable to sync file {} {}", s_conn->address(), abs_path, response_recved ? response_recved->stat : -1);
@@ -92,7 +130,7 @@ namespace storage_detail
     auto request_to_send = common::create_frame(common::proto_cmd::ss_upload_sync, common::frame_type::request, 5_MB);
     while (true)
     {
-      auto read_len = hot_store_group()->read_file(file_id, request_to_send->data, 5 * 1024 * 1024);
+      auto read_len = co_await hot_store_group()->async_read_file(file_id, request_to_send->data, 5_MB);
       if (!read_len.has_value())
       {
         break;
@@ -127,52 +165,48 @@ namespace storage_detail
 
     LOG_INFO("sync {} with zero copy", abs_path);
 
-    /* 零拷贝优化 */
-    auto file_fd = open(abs_path.data(), O_RDONLY);
-    if (file_fd < 0)
+    /* 所有 storage 使用相同的分段 */
+    auto segment = std::numeric_limits<uint64_t>::max();
+    for (auto storage : valid_storages)
     {
-      LOG_ERROR("open file {} failed, {}", abs_path, strerror(errno));
-      co_return false;
+      segment = std::min(segment, zero_copy_segment_size(*storage));
     }
 
-    for (auto storage : valid_storages)
+    /* 零拷贝优化，分段发送，最后一段的 stat 为 FRAME_STAT_FINISH */
+    auto finish = false;
+    while (!finish)
     {
-      auto id = co_await storage->send_request_without_data(common::proto_frame{.cmd = common::proto_cmd::ss_upload_sync, .stat = 255, .data_len = (uint32_t)file_size});
-
-      auto rest_to_send = file_size;
-      auto offset = off_t{0};
-      while (rest_to_send > 0)
+      auto target = hot_store_group()->reserve_read(file_id, segment);
+      if (!target)
       {
-        auto n = sendfile(storage->native_socket(), file_fd, &offset, rest_to_send);
-        if (-1 == n)
-        {
-          if (errno == EAGAIN || errno == EINTR)
-          {
-            co_await asio::post(asio::use_awaitable);
-            continue;
-          }
-
-          LOG_CRITICAL("send file {} failed, {}", abs_path, strerror(errno));
-          break;
-        }
-
-        rest_to_send -= n;
-        LOG_DEBUG("send {} bytes, rest to send {} bytes", n, rest_to_send);
+        co_return false;
       }
 
-      if (rest_to_send != 0)
+      auto [file_fd, offset, len, last] = target.value();
+      finish = last;
+      if (!finish)
       {
-        continue;
+        posix_fadvise(file_fd, offset + len, segment, POSIX_FADV_WILLNEED);
       }
 
-      auto response_recved = co_await storage->recv_response(id.value());
-      if (!response_recved || response_recved->stat != 0)
+      auto frame = common::proto_frame{.cmd = common::proto_cmd::ss_upload_sync, .stat = finish ? common::FRAME_STAT_FINISH : common::FRAME_STAT_OK, .data_len = (uint32_t)len};
+      for (auto storage : valid_storages)
       {
-        LOG_ERROR("sync file {} append failed, {}", abs_path, response_recved ? response_recved->stat : -1);
-        continue;
+        auto id = co_await storage->send_request_with_file(frame, file_fd, offset);
+        if (!id)
+        {
+          LOG_ERROR("send file {} to {} failed", abs_path, storage->address());
+          continue;
+        }
+
+        auto response_recved = co_await storage->recv_response(id.value());
+        if (!response_recved || response_recved->stat != 0)
+        {
+          LOG_ERROR("sync file {} append failed, {}", abs_path, response_recved ? response_recved->stat : -1);
+          continue;
+        }
       }
     }
-
     co_return true;
   }
 
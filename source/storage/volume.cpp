@@ -0,0 +1,362 @@
+#include "volume.h"
+#include "config.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <common/log.h>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace storage_detail
+{
+
+  volume_file::~volume_file()
+  {
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+  }
+
+  /**
+   * @brief 读取 fd 的指定偏移，直到读满 size 字节
+   *
+   */
+  auto pread_all(int fd, char *data, uint64_t size, uint64_t offset) -> bool
+  {
+    for (auto idx = 0uz; idx < size;)
+    {
+      auto n = pread(fd, data + idx, size - idx, offset + idx);
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n <= 0)
+      {
+        return false;
+      }
+      idx += n;
+    }
+    return true;
+  }
+
+  /**
+   * @brief 序列化 needle，长度为 volume_needle_len
+   *
+   */
+  auto encode_needle(std::string_view rel_path, std::span<const char> data, uint32_t crc, int64_t ctime) -> std::vector<char>
+  {
+    auto header = volume_needle_header{
+        .magic = volume_needle_magic,
+        .flags = 0,
+        .reserved = 0,
+        .path_len = (uint16_t)rel_path.size(),
+        .crc32c = crc,
+        .reserved2 = 0,
+        .size = data.size(),
+        .ctime = ctime,
+    };
+    auto buffer = std::vector<char>(volume_needle_len(rel_path.size(), data.size()), 0);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    std::memcpy(buffer.data() + sizeof(header), rel_path.data(), rel_path.size());
+    std::memcpy(buffer.data() + sizeof(header) + rel_path.size(), data.data(), data.size());
+    return buffer;
+  }
+
+} // namespace storage_detail
+
+namespace storage
+{
+
+  using namespace storage_detail;
+
+  volume_set::volume_set(std::string_view root_path, store_index &index)
+      : m_root_path{root_path},
+        m_dir{std::format("{}/{}", root_path, volume_dir_name)},
+        m_index{index}
+  {
+  }
+
+  auto volume_set::load(bool reindex) -> void
+  {
+    auto ec = std::error_code{};
+    std::filesystem::create_directories(m_dir, ec);
+    for (auto it = std::filesystem::directory_iterator{m_dir, ec}; !ec && it != std::filesystem::directory_iterator{}; it.increment(ec))
+    {
+      auto name = it->path().filename().string();
+      auto volume = uint32_t{0};
+      if (!name.ends_with(".vol") || std::from_chars(name.data(), name.data() + name.size() - 4, volume, 16).ec != std::errc{} || volume == 0)
+      {
+        continue;
+      }
+
+      auto file = std::make_shared<volume_file>();
+      file->fd = ::open(it->path().c_str(), O_RDWR | O_CLOEXEC);
+      struct stat st{};
+      if (file->fd == -1 || fstat(file->fd, &st) != 0)
+      {
+        LOG_ERROR(std::format("open volume '{}' failed, {}", it->path().string(), strerror(errno)));
+        continue;
+      }
+
+      /* 写入时崩溃留下的不完整 needle 之后的数据从对齐的位置追加 */
+      file->end = ((uint64_t)st.st_size + volume_needle_align - 1) / volume_needle_align * volume_needle_align;
+      m_volumes[volume] = file;
+      m_active = std::max(m_active, volume);
+    }
+
+    /* 重建的索引只包含独立的文件，打包的文件从卷中恢复 */
+    if (reindex)
+    {
+      for (auto &[volume, file] : m_volumes)
+      {
+        scan(volume, *file, [&](std::string_view rel_path, const volume_needle_header &header, uint64_t offset)
+             {
+               if ((header.flags & volume_needle_deleted) == 0)
+               {
+                 m_index.put(rel_path, {
+                                           .size = header.size,
+                                           .crc32c = header.crc32c,
+                                           .crc_valid = true,
+                                           .ctime = header.ctime,
+                                           .mtime = header.ctime,
+                                           .volume = volume,
+                                           .offset = offset,
+                                       });
+               }
+               return true;
+             });
+      }
+    }
+
+    auto missing = 0uz;
+    m_index.for_each([&](std::string_view rel_path, const store_index_entry &entry)
+                     {
+                       if (entry.volume == 0)
+                       {
+                         return;
+                       }
+                       if (auto it = m_volumes.find(entry.volume); it != m_volumes.end())
+                       {
+                         it->second->live += volume_needle_len(rel_path.size(), entry.size);
+                       }
+                       else
+                       {
+                         ++missing;
+                       }
+                     });
+    if (missing != 0)
+    {
+      LOG_ERROR(std::format("{} packed files of '{}' refer to missing volumes", missing, m_root_path));
+    }
+
+    auto stat = stats();
+    LOG_INFO(std::format("load volumes of '{}' suc, {} volumes, {} bytes, {} dead bytes", m_root_path, stat.volumes, stat.bytes, stat.dead_bytes));
+  }
+
+  auto volume_set::append(std::string_view rel_path, std::span<const char> data, uint32_t crc) -> bool
+  {
+    /* 头部、路径和数据一次写入 */
+    auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    auto buffer = encode_needle(rel_path, data, crc, now);
+    auto res = allocate(buffer.size());
+    if (!res)
+    {
+      return false;
+    }
+    auto [volume, file, offset] = res.value();
+    if (!pwrite_all(file->fd, buffer.data(), buffer.size(), offset))
+    {
+      LOG_ERROR(std::format("write needle '{}' to volume '{}' failed, {}", rel_path, volume_path(volume), strerror(errno)));
+      auto lock = std::unique_lock{m_mut};
+      file->live -= buffer.size();
+      return false;
+    }
+
+    m_index.put(rel_path, {
+                              .size = data.size(),
+                              .crc32c = crc,
+                              .crc_valid = true,
+                              .ctime = now,
+                              .mtime = now,
+                              .volume = volume,
+                              .offset = offset + sizeof(volume_needle_header) + rel_path.size(),
+                          });
+    return true;
+  }
+
+  auto volume_set::open(uint32_t volume) -> int
+  {
+    auto lock = std::shared_lock{m_mut};
+    auto it = m_volumes.find(volume);
+    return it == m_volumes.end() ? -1 : fcntl(it->second->fd, F_DUPFD_CLOEXEC, 0);
+  }
+
+  auto volume_set::erase(std::string_view rel_path, const store_index_entry &entry) -> void
+  {
+    auto file = std::shared_ptr<volume_file>{};
+    {
+      auto lock = std::unique_lock{m_mut};
+      auto it = m_volumes.find(entry.volume);
+      if (it == m_volumes.end())
+      {
+        return;
+      }
+      file = it->second;
+      file->live -= volume_needle_len(rel_path.size(), entry.size);
+    }
+
+    /* 标记删除，重建索引时跳过 */
+    auto header_offset = entry.offset - rel_path.size() - sizeof(volume_needle_header);
+    auto flags = volume_needle_deleted;
+    if (!pwrite_all(file->fd, (const char *)&flags, sizeof(flags), header_offset + offsetof(volume_needle_header, flags)))
+    {
+      LOG_ERROR(std::format("mark needle '{}' deleted failed, {}", rel_path, strerror(errno)));
+    }
+  }
+
+  auto volume_set::compact(uint32_t dead_percent) -> void
+  {
+    auto candidates = std::vector<std::pair<uint32_t, std::shared_ptr<volume_file>>>{};
+    {
+      auto lock = std::shared_lock{m_mut};
+      for (const auto &[volume, file] : m_volumes)
+      {
+        if (volume != m_active && file->end != 0 && (file->end - file->live) * 100 >= file->end * dead_percent)
+        {
+          candidates.emplace_back(volume, file);
+        }
+      }
+    }
+
+    for (const auto &[volume, file] : candidates)
+    {
+      auto begin = std::chrono::steady_clock::now();
+      auto needles = std::vector<std::pair<std::string, store_index_entry>>{};
+      m_index.for_each([&](std::string_view rel_path, const store_index_entry &entry)
+                       {
+                         if (entry.volume == volume)
+                         {
+                           needles.emplace_back(rel_path, entry);
+                         }
+                       });
+
+      /* 逐个搬移仍被引用的 needle，搬移期间被删除的 needle 不会写回索引 */
+      auto ok = true;
+      auto data = std::vector<char>{};
+      for (const auto &[rel_path, entry] : needles)
+      {
+        data.resize(entry.size);
+        auto len = volume_needle_len(rel_path.size(), entry.size);
+        auto res = pread_all(file->fd, data.data(), data.size(), entry.offset) ? allocate(len) : std::nullopt;
+        if (!res)
+        {
+          ok = false;
+          break;
+        }
+
+        auto [new_volume, new_file, offset] = res.value();
+        auto buffer = encode_needle(rel_path, data, entry.crc32c, entry.ctime);
+        auto new_entry = entry;
+        new_entry.volume = new_volume;
+        new_entry.offset = offset + sizeof(volume_needle_header) + rel_path.size();
+        if (!pwrite_all(new_file->fd, buffer.data(), buffer.size(), offset) || !m_index.relocate(rel_path, volume, entry.offset, new_entry))
+        {
+          auto lock = std::unique_lock{m_mut};
+          new_file->live -= len;
+        }
+      }
+
+      if (!ok)
+      {
+        LOG_ERROR(std::format("compact volume '{}' failed, {}", volume_path(volume), strerror(errno)));
+        continue;
+      }
+
+      /* 已打开的 fd 仍然可以读取删除的卷 */
+      {
+        auto lock = std::unique_lock{m_mut};
+        m_volumes.erase(volume);
+      }
+      unlink(volume_path(volume).data());
+      LOG_INFO(std::format("compact volume '{}' suc, move {} files, reclaim {} bytes, cost {}ms", volume_path(volume), needles.size(), file->end - file->live,
+                           std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count()));
+    }
+  }
+
+  auto volume_set::volume_path(uint32_t volume) -> std::string
+  {
+    return std::format("{}/{:08X}.vol", m_dir, volume);
+  }
+
+  auto volume_set::stats() -> volume_stats
+  {
+    auto lock = std::shared_lock{m_mut};
+    auto stat = volume_stats{.volumes = m_volumes.size(), .bytes = 0, .dead_bytes = 0};
+    for (const auto &[volume, file] : m_volumes)
+    {
+      stat.bytes += file->end;
+      stat.dead_bytes += file->end - file->live;
+    }
+    return stat;
+  }
+
+  auto volume_set::scan(uint32_t volume, volume_file &file, const std::function<bool(std::string_view, const volume_needle_header &, uint64_t)> &func) -> void
+  {
+    auto header = volume_needle_header{};
+    auto rel_path = std::string{};
+    for (auto offset = 0uz; offset + sizeof(header) <= file.end;)
+    {
+      if (!pread_all(file.fd, (char *)&header, sizeof(header), offset) || header.magic != volume_needle_magic)
+      {
+        break;
+      }
+
+      /* 末尾不完整的 needle */
+      auto len = volume_needle_len(header.path_len, header.size);
+      rel_path.resize(header.path_len);
+      if (offset + len > file.end || !pread_all(file.fd, rel_path.data(), rel_path.size(), offset + sizeof(header)))
+      {
+        LOG_WARN(std::format("truncated needle at {} of volume '{}'", offset, volume_path(volume)));
+        break;
+      }
+
+      if (!func(rel_path, header, offset + sizeof(header) + header.path_len))
+      {
+        break;
+      }
+      offset += len;
+    }
+  }
+
+  auto volume_set::allocate(uint64_t len) -> std::optional<std::tuple<uint32_t, std::shared_ptr<volume_file>, uint64_t>>
+  {
+    auto lock = std::unique_lock{m_mut};
+    auto it = m_volumes.find(m_active);
+    auto volume_size = uint64_t{storage_config.performance.volume_size_mb} * 1024 * 1024;
+    if (it == m_volumes.end() || (it->second->end != 0 && it->second->end + len > volume_size))
+    {
+      auto volume = m_active + 1;
+      auto file = std::make_shared<volume_file>();
+      file->fd = ::open(volume_path(volume).data(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+      if (file->fd == -1)
+      {
+        LOG_ERROR(std::format("create volume '{}' failed, {}", volume_path(volume), strerror(errno)));
+        return std::nullopt;
+      }
+      it = m_volumes.emplace(volume, file).first;
+      m_active = volume;
+    }
+
+    auto offset = it->second->end;
+    it->second->end += len;
+    it->second->live += len;
+    return std::tuple{it->first, it->second, offset};
+  }
+
+} // namespace storage
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "store_index.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+namespace storage_detail
+{
+
+  /* 卷文件所在的目录，位于 root_path 下，以 . 开头，遍历存储文件时跳过 */
+  constexpr auto volume_dir_name = std::string_view{".volumes"};
+
+  constexpr auto volume_needle_magic = uint32_t{0x4E534644}; // "DFSN"
+
+  /* needle 在卷中按该长度对齐 */
+  constexpr auto volume_needle_align = 8uz;
+
+  /* 已删除的 needle */
+  constexpr auto volume_needle_deleted = uint8_t{1};
+
+  /**
+   * @brief 卷中每个 needle 的头部，其后依次为 path_len 字节的 rel_path 和 size 字节的数据
+   *
+   * @param flags   volume_needle_deleted
+   * @param ctime   写入时间，单位秒
+   */
+  struct volume_needle_header
+  {
+    uint32_t magic;
+    uint8_t flags;
+    uint8_t reserved;
+    uint16_t path_len;
+    uint32_t crc32c;
+    uint32_t reserved2;
+    uint64_t size;
+    int64_t ctime;
+  };
+  static_assert(sizeof(volume_needle_header) == 32);
+
+  /**
+   * @brief needle 在卷中占用的长度
+   *
+   */
+  constexpr auto volume_needle_len(uint64_t path_len, uint64_t size) -> uint64_t
+  {
+    return (sizeof(volume_needle_header) + path_len + size + volume_needle_align - 1) / volume_needle_align * volume_needle_align;
+  }
+
+  /**
+   * @brief 写入 fd 的指定偏移，直到全部写入，定义于 store.cpp
+   *
+   */
+  auto pwrite_all(int fd, const char *data, uint64_t size, uint64_t offset) -> bool;
+
+  /**
+   * @brief 打开的卷
+   *
+   * @param fd    读写使用的文件描述符
+   * @param end   已分配的长度，下一个 needle 的偏移
+   * @param live  索引中仍然引用的 needle 占用的长度
+   */
+  struct volume_file
+  {
+    int fd = -1;
+    uint64_t end = 0;
+    uint64_t live = 0;
+
+    ~volume_file();
+  };
+
+} // namespace storage_detail
+
+namespace storage
+{
+
+  /**
+   * @brief 卷的统计信息
+   *
+   */
+  struct volume_stats
+  {
+    uint64_t volumes;
+    uint64_t bytes;
+    uint64_t dead_bytes;
+  };
+
+  /**
+   * @brief store 的小文件卷，小文件作为 needle 追加写入 root_path/.volumes 下的卷文件
+   *
+   * needle 的位置、长度和 CRC32C 记录在 store_index 中，rel_path 仍然可以访问打包的文件。只有最新的卷会被追加，
+   * 其余的卷在删除的数据超过一定比例后由 compact 把仍被引用的 needle 搬到最新的卷中，然后删除。
+   */
+  class volume_set
+  {
+  public:
+    volume_set(std::string_view root_path, store_index &index);
+
+    /**
+     * @brief 打开所有卷，根据索引统计每个卷中仍被引用的数据
+     *
+     * @param reindex 索引是从磁盘重建的，扫描卷中的 needle 补充到索引
+     */
+    auto load(bool reindex) -> void;
+
+    /**
+     * @brief 追加一个 needle，并写入索引
+     *
+     * @return 是否成功
+     */
+    auto append(std::string_view rel_path, std::span<const char> data, uint32_t crc) -> bool;
+
+    /**
+     * @brief 打开 needle 所在的卷
+     *
+     * @return 复制的 fd，由调用方关闭。卷已被压缩删除时返回 -1
+     */
+    auto open(uint32_t volume) -> int;
+
+    /**
+     * @brief 标记 needle 为已删除，调用方已从索引中移除
+     *
+     */
+    auto erase(std::string_view rel_path, const store_index_entry &entry) -> void;
+
+    /**
+     * @brief 压缩删除的数据超过 dead_percent 的卷
+     *
+     */
+    auto compact(uint32_t dead_percent) -> void;
+
+    /**
+     * @brief 卷的路径
+     *
+     */
+    auto volume_path(uint32_t volume) -> std::string;
+
+    /**
+     * @brief 卷的数量、总长度和已删除数据的长度
+     *
+     */
+    auto stats() -> volume_stats;
+
+  private:
+    /**
+     * @brief 扫描卷中的 needle
+     *
+     * @param func 参数为 rel_path、header 和 数据的偏移，返回 false 时停止扫描
+     */
+    auto scan(uint32_t volume, storage_detail::volume_file &file, const std::function<bool(std::string_view, const storage_detail::volume_needle_header &, uint64_t)> &func) -> void;
+
+    /**
+     * @brief 为长度为 len 的 needle 分配位置，当前的卷写满时创建新卷
+     *
+     * @return <卷编号, 卷, needle 的偏移>
+     */
+    auto allocate(uint64_t len) -> std::optional<std::tuple<uint32_t, std::shared_ptr<storage_detail::volume_file>, uint64_t>>;
+
+  private:
+    std::string m_root_path;
+    std::string m_dir;
+    store_index &m_index;
+
+    std::map<uint32_t, std::shared_ptr<storage_detail::volume_file>> m_volumes;
+    uint32_t m_active = 0; // 正在追加的卷
+    std::shared_mutex m_mut;
+  };
+
+} // namespace storage
@@ -0,0 +1,36 @@
+#include <chrono>
+#include <common/crc32c.h>
+#include <print>
+#include <random>
+#include <vector>
+
+/* 测试 crc32c 查表实现与 SSE4.2 实现的吞吐 */
+template <typename Func>
+auto bench(std::string_view name, const std::vector<char> &data, int times, Func func) {
+  auto crc = uint32_t{0};
+  auto begin = std::chrono::steady_clock::now();
+  for (auto i = 0; i < times; ++i) {
+    crc = func(crc, data.data(), data.size());
+  }
+  auto end = std::chrono::steady_clock::now();
+  auto seconds = std::chrono::duration<double>(end - begin).count();
+  std::println("{:<8} crc {:08x}  {:.2f} GB/s", name, crc, 1.0 * data.size() * times / seconds / 1024 / 1024 / 1024);
+}
+
+auto main() -> int {
+  auto data = std::vector<char>(64 * 1024 * 1024);
+  auto engine = std::mt19937{42};
+  for (auto &c : data) {
+    c = (char)engine();
+  }
+
+  auto times = 16;
+  bench("sw", data, times, common_detail::crc32c_sw);
+  if (common_detail::crc32c_hw_supported()) {
+    bench("hw", data, times, common_detail::crc32c_hw);
+  } else {
+    std::println("hw       not supported");
+  }
+  bench("dispatch", data, times, [](uint32_t crc, const char *data, size_t len) { return common::crc32c(crc, {data, len}); });
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <print>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/* 比较 storage 写入文件的几种方式：ofstream 空洞文件、ftruncate + pwrite、fallocate + pwrite、fallocate + O_DIRECT */
+auto show_usage() {
+  std::println("Usage: bench_file_write <dir> <file_size_mb> <chunk_kb> [times]");
+}
+
+constexpr auto align = 4096uz;
+
+auto file_size = 0uz;
+auto chunk_size = 0uz;
+auto data = std::vector<char>{};
+
+/* 旧的实现，seekp 到末尾写入一个字节形成空洞，之后通过 ofstream 顺序写入 */
+auto write_ofstream(const std::string &path) -> bool {
+  auto ofs = std::ofstream{path, std::ios::binary};
+  ofs.seekp(file_size - 1);
+  ofs.put(0);
+  ofs.seekp(0);
+  for (auto idx = 0uz; idx < file_size; idx += chunk_size) {
+    ofs.write(data.data() + idx, std::min(chunk_size, file_size - idx));
+  }
+  ofs.flush();
+  return ofs.good();
+}
+
+auto pwrite_all(int fd, const char *buf, size_t size, off_t offset) -> bool {
+  for (auto written = 0uz; written < size;) {
+    auto n = pwrite(fd, buf + written, size - written, offset + written);
+    if (n < 0 && errno != EINTR) {
+      return false;
+    }
+    written += std::max<ssize_t>(n, 0);
+  }
+  return true;
+}
+
+auto write_pwrite(const std::string &path, bool use_fallocate) -> bool {
+  auto fd = open(path.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  auto ok = use_fallocate ? fallocate(fd, 0, 0, file_size) == 0 : ftruncate(fd, file_size) == 0;
+  for (auto idx = 0uz; ok && idx < file_size; idx += chunk_size) {
+    ok = pwrite_all(fd, data.data() + idx, std::min(chunk_size, file_size - idx), idx);
+  }
+  close(fd);
+  return ok;
+}
+
+/* 数据先拷贝到对齐的缓冲区，与 store_ctx 的 O_DIRECT 写入方式一致 */
+auto write_direct(const std::string &path) -> bool {
+  auto fd = open(path.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  auto direct_fd = open(path.data(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+  if (fd < 0 || direct_fd < 0) {
+    std::println("open with O_DIRECT failed, {}", strerror(errno));
+    return false;
+  }
+
+  auto buffer_size = 4uz * 1024 * 1024;
+  auto buffer = (char *)std::aligned_alloc(align, buffer_size);
+  auto ok = fallocate(fd, 0, 0, file_size) == 0;
+  auto len = 0uz;
+  auto offset = 0uz;
+  for (auto idx = 0uz; ok && idx < file_size;) {
+    auto n = std::min({chunk_size, file_size - idx, buffer_size - len});
+    std::memcpy(buffer + len, data.data() + idx, n);
+    len += n;
+    idx += n;
+    if (len == buffer_size) {
+      ok = pwrite_all(direct_fd, buffer, len, offset);
+      offset += len;
+      len = 0;
+    }
+  }
+
+  auto aligned = len / align * align;
+  ok = ok && pwrite_all(direct_fd, buffer, aligned, offset) && pwrite_all(fd, buffer + aligned, len - aligned, offset + aligned);
+  free(buffer);
+  close(direct_fd);
+  close(fd);
+  return ok;
+}
+
+auto data_sync(const std::string &path) -> void {
+  auto fd = open(path.data(), O_WRONLY | O_CLOEXEC);
+  fdatasync(fd);
+  close(fd);
+}
+
+auto bench(std::string_view name, const std::string &dir, int times, std::function<bool(const std::string &)> func) {
+  auto path = std::format("{}/bench_file_write_{}", dir, name);
+  auto write_seconds = 0.;
+  auto sync_seconds = 0.;
+  for (auto i = 0; i < times; ++i) {
+    auto begin = std::chrono::steady_clock::now();
+    if (!func(path)) {
+      std::println("{:<18} failed, {}", name, strerror(errno));
+      unlink(path.data());
+      return;
+    }
+    auto written = std::chrono::steady_clock::now();
+    data_sync(path);
+    auto synced = std::chrono::steady_clock::now();
+    write_seconds += std::chrono::duration<double>(written - begin).count();
+    sync_seconds += std::chrono::duration<double>(synced - written).count();
+    unlink(path.data());
+  }
+
+  auto mb = 1.0 * file_size * times / 1024 / 1024;
+  std::println("{:<18} write {:8.1f} MB/s  write + fdatasync {:8.1f} MB/s", name, mb / write_seconds, mb / (write_seconds + sync_seconds));
+}
+
+auto main(int argc, char *argv[]) -> int {
+  if (argc < 4) {
+    show_usage();
+    return -1;
+  }
+
+  auto dir = std::string{argv[1]};
+  file_size = std::stoull(argv[2]) * 1024 * 1024;
+  chunk_size = std::stoull(argv[3]) * 1024;
+  auto times = argc > 4 ? std::stoi(argv[4]) : 4;
+  if (file_size == 0 || chunk_size == 0) {
+    show_usage();
+    return -1;
+  }
+
+  data.resize(file_size);
+  auto engine = std::mt19937{42};
+  for (auto &c : data) {
+    c = (char)engine();
+  }
+
+  bench("ofstream", dir, times, write_ofstream);
+  bench("ftruncate+pwrite", dir, times, [](const std::string &path) { return write_pwrite(path, false); });
+  bench("fallocate+pwrite", dir, times, [](const std::string &path) { return write_pwrite(path, true); });
+  bench("fallocate+direct", dir, times, write_direct);
+  return 0;
+}
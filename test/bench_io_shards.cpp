@@ -0,0 +1,161 @@
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <common/io_shards.h>
+#include <memory>
+#include <print>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* 比较共享 io_context + strand 与每个线程独占 io_context + SO_REUSEPORT 两种模型下，小请求往返的吞吐 */
+auto show_usage() {
+  std::println("Usage: bench_io_shards [port] [connections] [seconds] [payload]");
+  std::println("  each mode is measured with 1, 4 and 16 server threads");
+}
+
+constexpr auto thread_counts = {1u, 4u, 16u};
+
+auto port = uint16_t{19527};
+auto connections = 256u;
+auto seconds = 5u;
+auto payload = 64uz;
+auto finished = std::atomic_uint64_t{0};
+auto running = std::atomic_bool{false};
+
+/* 与 common::connection 一致，每个连接的处理都运行在 strand 上 */
+auto echo(asio::ip::tcp::socket sock) -> asio::awaitable<void> {
+  auto buffer = std::vector<char>(payload);
+  while (true) {
+    auto [ec, n] = co_await asio::async_read(sock, asio::buffer(buffer), asio::as_tuple(asio::use_awaitable));
+    if (ec) {
+      co_return;
+    }
+    auto [ec_1, n_1] = co_await asio::async_write(sock, asio::buffer(buffer), asio::as_tuple(asio::use_awaitable));
+    if (ec_1) {
+      co_return;
+    }
+  }
+}
+
+auto accept_loop(asio::ip::tcp::acceptor &acceptor) -> asio::awaitable<void> {
+  while (true) {
+    auto [ec, sock] = co_await acceptor.async_accept(asio::make_strand(acceptor.get_executor()), asio::as_tuple(asio::use_awaitable));
+    if (ec) {
+      co_return;
+    }
+    sock.set_option(asio::ip::tcp::no_delay(true));
+    auto executor = sock.get_executor();
+    asio::co_spawn(executor, echo(std::move(sock)), asio::detached);
+  }
+}
+
+auto make_acceptor(asio::io_context &io, bool reuse_port) -> std::unique_ptr<asio::ip::tcp::acceptor> {
+  auto ep = asio::ip::tcp::endpoint{asio::ip::make_address("127.0.0.1"), port};
+  auto acceptor = std::make_unique<asio::ip::tcp::acceptor>(io);
+  acceptor->open(ep.protocol());
+  acceptor->set_option(asio::socket_base::reuse_address(true));
+  if (reuse_port) {
+    acceptor->set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+  }
+  acceptor->bind(ep);
+  acceptor->listen();
+  return acceptor;
+}
+
+auto ping(asio::ip::tcp::socket sock) -> asio::awaitable<void> {
+  auto buffer = std::vector<char>(payload, 'x');
+  while (running) {
+    auto [ec, n] = co_await asio::async_write(sock, asio::buffer(buffer), asio::as_tuple(asio::use_awaitable));
+    auto [ec_1, n_1] = co_await asio::async_read(sock, asio::buffer(buffer), asio::as_tuple(asio::use_awaitable));
+    if (ec || ec_1) {
+      co_return;
+    }
+    ++finished;
+  }
+}
+
+/* 客户端使用独立的线程，连接建立后计时 */
+auto run_client(uint32_t client_threads) -> double {
+  auto io = asio::io_context{};
+  auto socks = std::vector<asio::ip::tcp::socket>{};
+  for (auto i = 0u; i < connections; ++i) {
+    auto sock = asio::ip::tcp::socket{io};
+    sock.connect({asio::ip::make_address("127.0.0.1"), port});
+    sock.set_option(asio::ip::tcp::no_delay(true));
+    socks.push_back(std::move(sock));
+  }
+
+  finished = 0;
+  running = true;
+  for (auto &sock : socks) {
+    asio::co_spawn(io, ping(std::move(sock)), asio::detached);
+  }
+
+  auto threads = std::vector<std::jthread>{};
+  for (auto i = 0u; i < client_threads; ++i) {
+    threads.emplace_back([&io] { io.run(); });
+  }
+  auto begin = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds{seconds});
+  auto count = finished.load();
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  running = false;
+  io.stop();
+  return count / elapsed;
+}
+
+auto bench_shared(uint32_t thread_count) -> double {
+  auto io = asio::io_context{(int)thread_count};
+  auto acceptor = make_acceptor(io, false);
+  asio::co_spawn(io, accept_loop(*acceptor), asio::detached);
+
+  auto threads = std::vector<std::jthread>{};
+  for (auto i = 0u; i < thread_count; ++i) {
+    threads.emplace_back([&io] { io.run(); });
+  }
+  auto res = run_client(std::max(thread_count, 4u));
+  io.stop();
+  return res;
+}
+
+auto bench_sharded(uint32_t thread_count) -> double {
+  auto shards = common::io_shards{thread_count};
+  auto acceptors = std::vector<std::unique_ptr<asio::ip::tcp::acceptor>>{};
+  for (auto i = 0u; i < shards.size(); ++i) {
+    acceptors.push_back(make_acceptor(shards.context(i), true));
+    asio::co_spawn(shards.context(i), accept_loop(*acceptors.back()), asio::detached);
+  }
+
+  auto threads = std::vector<std::jthread>{};
+  for (auto i = 0u; i < shards.size(); ++i) {
+    threads.emplace_back([&shards, i] {
+      common::pin_thread_to_cpu(i);
+      shards.context(i).run();
+    });
+  }
+  auto res = run_client(std::max(thread_count, 4u));
+  for (auto i = 0u; i < shards.size(); ++i) {
+    shards.context(i).stop();
+  }
+  return res;
+}
+
+auto main(int argc, char *argv[]) -> int {
+  if (argc > 1 && std::string{argv[1]} == "-h") {
+    show_usage();
+    return 0;
+  }
+  port = argc > 1 ? (uint16_t)std::stoul(argv[1]) : port;
+  connections = argc > 2 ? std::stoul(argv[2]) : connections;
+  seconds = argc > 3 ? std::stoul(argv[3]) : seconds;
+  payload = argc > 4 ? std::stoull(argv[4]) : payload;
+
+  std::println("{} connections, {} bytes payload, {}s per case", connections, payload, seconds);
+  for (auto thread_count : thread_counts) {
+    auto shared = bench_shared(thread_count);
+    auto sharded = bench_sharded(thread_count);
+    std::println("{:>2} threads  shared {:>10.0f} req/s  sharded {:>10.0f} req/s  {:+.1f}%", thread_count, shared, sharded, (sharded / shared - 1) * 100);
+  }
+  return 0;
+}
@@ -1,16 +1,19 @@
 #include <common/connection.h>
 #include <common/log.h>
 #include <common/util.h>
+#include <deque>
 #include <print>
 #include <proto.pb.h>
 
 auto show_usage() {
-  std::println("Usage: bench_upload_file <fork_times> <times> <file_size>");
+  std::println("Usage: bench_upload_file <fork_times> <times> <file_size> [window]");
+  std::println("  window  chunks in flight with upload_mode::stream, 0 means upload_mode::normal (default 0)");
 }
 
 auto io = asio::io_context{};
 auto master_conn = std::shared_ptr<common::connection>{};
 auto file_to_write = std::string{};
+auto upload_window = 0u;
 
 auto upload_file(uint64_t file_size) -> asio::awaitable<void> {
 
@@ -34,31 +37,68 @@ auto upload_file(uint64_t file_size) -> asio::awaitable<void> {
     co_return;
   });
 
-  request_to_send = common::create_frame(common::proto_cmd::cs_upload_start, common::frame_type::request, sizeof(uint64_t));
-  *((uint64_t *)request_to_send->data) = common::htonll(file_size);
+  auto ack_every = std::max(upload_window / 2, 1u);
+  request_to_send = common::create_frame(common::proto_cmd::cs_upload_start, common::frame_type::request, sizeof(common::cs_upload_start_request));
+  *((common::cs_upload_start_request *)request_to_send->data) = {
+      .file_size = common::htonll(file_size),
+      .mode = static_cast<common::upload_mode>(htonl(std::to_underlying(upload_window == 0 ? common::upload_mode::normal : common::upload_mode::stream))),
+      .ack_every = htonl(ack_every),
+  };
   response = co_await storage_conn->send_request_and_wait_response(request_to_send);
-  if (!response || response->stat != common::FRAME_STAT_OK) {
+  if (!response || response->stat != common::FRAME_STAT_OK || response->data_len != sizeof(uint32_t)) {
     LOG_ERROR("upload file failed, ", response ? response->stat : -1);
     co_return;
   }
 
+  /* 每个数据块都带有 transfer_id，upload_mode::stream 时还带有序号 */
+  auto transfer_id = *(uint32_t *)response->data; /* 保持网络字节序 */
+  auto header_len = sizeof(common::cs_upload_chunk_header);
   auto idx = 0uz;
-  request_to_send = common::create_frame(common::proto_cmd::cs_upload, common::frame_type::request, 1_MB);
+  auto seq = 0u;
+  auto ack_ids = std::deque<uint16_t>{};
+  request_to_send = common::create_frame(common::proto_cmd::cs_upload, common::frame_type::request, header_len + 1_MB);
   while (idx < file_size) {
     auto end_idx = std::min(idx + 1_MB, file_size);
-    request_to_send->data_len = (uint32_t)(end_idx - idx);
+    request_to_send->data_len = (uint32_t)(header_len + end_idx - idx);
     LOG_INFO("end_idx {}, idx {}, file_size {}", end_idx, idx, file_size);
-    std::memcpy(request_to_send->data, file_to_write.data() + idx, end_idx - idx);
+    std::memcpy(request_to_send->data + header_len, file_to_write.data() + idx, end_idx - idx);
+    idx = end_idx;
+    *(common::cs_upload_chunk_header *)request_to_send->data = {.transfer_id = transfer_id, .seq = htonl(seq)};
+
+    if (upload_window == 0) {
+      response = co_await storage_conn->send_request_and_wait_response(request_to_send);
+      if (!response || response->stat != 0) {
+        LOG_ERROR("upload failed {}", response ? response->stat : -1);
+        co_return;
+      }
+      continue;
+    }
 
-    response = co_await storage_conn->send_request_and_wait_response(request_to_send);
-    if (!response || response->stat != 0) {
-      LOG_ERROR("upload failed {}", response ? response->stat : -1);
+    if ((seq++ + 1) % ack_every != 0) {
+      if (!co_await storage_conn->send_request_without_response(request_to_send)) {
+        LOG_ERROR("upload failed");
+        co_return;
+      }
+    } else if (auto id = co_await storage_conn->send_request(request_to_send); id) {
+      ack_ids.push_back(id.value());
+    } else {
+      LOG_ERROR("upload failed");
       co_return;
     }
-    idx = end_idx;
+
+    while (ack_ids.size() * ack_every >= upload_window || (idx == file_size && !ack_ids.empty())) {
+      response = co_await storage_conn->recv_response(ack_ids.front());
+      ack_ids.pop_front();
+      if (!response || response->stat != 0) {
+        LOG_ERROR("upload failed {}", response ? response->stat : -1);
+        co_return;
+      }
+    }
   }
 
-  response = co_await storage_conn->send_request_and_wait_response(common::proto_frame{.cmd = common::proto_cmd::cs_upload, .stat = common::FRAME_STAT_FINISH});
+  request_to_send = common::create_frame(common::proto_cmd::cs_upload, common::frame_type::request, header_len, common::FRAME_STAT_FINISH);
+  *(common::cs_upload_chunk_header *)request_to_send->data = {.transfer_id = transfer_id, .seq = htonl(seq)};
+  response = co_await storage_conn->send_request_and_wait_response(request_to_send);
   if (!response || response->stat != 0) {
     LOG_ERROR("upload failed {}", response ? response->stat : -1);
     co_return;
@@ -80,7 +120,7 @@ auto run(uint64_t times, uint64_t file_size) -> asio::awaitable<void> {
 }
 
 auto main(int argc, char *argv[]) -> int {
-  if (argc != 4) {
+  if (argc != 4 && argc != 5) {
     show_usage();
     return -1;
   }
@@ -91,6 +131,7 @@ auto main(int argc, char *argv[]) -> int {
   auto fork_times = std::stoll(argv[1]) - 1;
   auto times = std::stoll(argv[2]);
   auto file_size = std::stoll(argv[3]);
+  upload_window = argc == 5 ? std::stoul(argv[4]) : 0;
 
   file_to_write = common::random_string(file_size);
 
@@ -0,0 +1,187 @@
+#include <common/connection.h>
+#include <common/log.h>
+#include <common/util.h>
+#include <optional>
+#include <print>
+#include <proto.pb.h>
+
+/* 上传一个小于零拷贝分段的文件，从上传的 storage 下载，再等待同步后从同组的其它 storage 下载，校验内容一致 */
+auto show_usage() {
+  std::println("Usage: test_small_file_transfer [file_size] [sync_timeout]");
+  std::println("  file_size     bytes of the uploaded file, smaller than one zero copy segment (default 4096)");
+  std::println("  sync_timeout  seconds to wait for the file to be synced to the other storages (default 240)");
+}
+
+auto io = asio::io_context{};
+auto master_conn = std::shared_ptr<common::connection>{};
+auto file_size = 4096uz;
+auto sync_timeout = 240u;
+auto failed = false;
+
+auto connect_to(const std::string &ip, uint16_t port) -> asio::awaitable<std::shared_ptr<common::connection>> {
+  auto conn = co_await common::connection::connect_to(ip, port);
+  if (conn) {
+    conn->start([](std::shared_ptr<common::proto_frame>, std::shared_ptr<common::connection>) -> asio::awaitable<void> {
+      co_return;
+    });
+  }
+  co_return conn;
+}
+
+/* 返回带组号的文件路径 */
+auto upload_file(const std::string &content) -> asio::awaitable<std::optional<std::string>> {
+  auto request_to_send = common::create_frame(common::proto_cmd::cm_fetch_one_storage, common::frame_type::request, sizeof(uint64_t));
+  *((uint64_t *)request_to_send->data) = common::htonll(content.size());
+  auto response = co_await master_conn->send_request_and_wait_response(request_to_send);
+  auto storage = proto::cm_fetch_one_storage_response{};
+  if (!response || response->stat != common::FRAME_STAT_OK || !storage.ParseFromArray(response->data, response->data_len)) {
+    LOG_ERROR("fetch storage failed, {}", response ? response->stat : -1);
+    co_return std::nullopt;
+  }
+
+  auto storage_conn = co_await connect_to(storage.s_info().ip(), storage.s_info().port());
+  if (!storage_conn) {
+    LOG_ERROR("connect to storage {}:{} failed", storage.s_info().ip(), storage.s_info().port());
+    co_return std::nullopt;
+  }
+
+  request_to_send = common::create_frame(common::proto_cmd::cs_upload_start, common::frame_type::request, sizeof(common::cs_upload_start_request));
+  *((common::cs_upload_start_request *)request_to_send->data) = {
+      .file_size = common::htonll(content.size()),
+      .mode = static_cast<common::upload_mode>(htonl(std::to_underlying(common::upload_mode::normal))),
+      .ack_every = htonl(1),
+  };
+  response = co_await storage_conn->send_request_and_wait_response(request_to_send);
+  if (!response || response->stat != common::FRAME_STAT_OK || response->data_len != sizeof(uint32_t)) {
+    LOG_ERROR("cs_upload_start failed, {}", response ? response->stat : -1);
+    co_return std::nullopt;
+  }
+  auto transfer_id = *(uint32_t *)response->data; /* 保持网络字节序 */
+
+  auto header_len = sizeof(common::cs_upload_chunk_header);
+  request_to_send = common::create_frame(common::proto_cmd::cs_upload, common::frame_type::request, header_len + content.size());
+  *(common::cs_upload_chunk_header *)request_to_send->data = {.transfer_id = transfer_id, .seq = htonl(0)};
+  std::copy(content.begin(), content.end(), request_to_send->data + header_len);
+  response = co_await storage_conn->send_request_and_wait_response(request_to_send);
+  if (!response || response->stat != common::FRAME_STAT_OK) {
+    LOG_ERROR("cs_upload failed, {}", response ? response->stat : -1);
+    co_return std::nullopt;
+  }
+
+  auto file_name = std::string{"small.bin"};
+  request_to_send = common::create_frame(common::proto_cmd::cs_upload, common::frame_type::request, header_len + file_name.size(), common::FRAME_STAT_FINISH);
+  *(common::cs_upload_chunk_header *)request_to_send->data = {.transfer_id = transfer_id, .seq = htonl(1)};
+  std::copy(file_name.begin(), file_name.end(), request_to_send->data + header_len);
+  response = co_await storage_conn->send_request_and_wait_response(request_to_send);
+  if (!response || response->stat != common::FRAME_STAT_OK) {
+    LOG_ERROR("cs_upload finish failed, {}", response ? response->stat : -1);
+    co_return std::nullopt;
+  }
+  co_await storage_conn->close();
+  co_return std::string{response->data, response->data_len};
+}
+
+/* 文件不存在或下载失败时返回 std::nullopt */
+auto download_file(std::shared_ptr<common::connection> conn, const std::string &rel_path) -> asio::awaitable<std::optional<std::string>> {
+  auto request_to_send = common::create_frame(common::proto_cmd::cs_download_start, common::frame_type::request, rel_path.size());
+  std::copy(rel_path.begin(), rel_path.end(), request_to_send->data);
+  auto response = co_await conn->send_request_and_wait_response(request_to_send);
+  if (!response || response->stat != common::FRAME_STAT_OK) {
+    co_return std::nullopt;
+  }
+
+  auto download_request = common::create_frame(common::proto_cmd::cs_download, common::frame_type::request, sizeof(uint32_t));
+  *(uint32_t *)download_request->data = *(uint32_t *)(response->data + sizeof(uint64_t));
+  auto content = std::string{};
+  while (true) {
+    response = co_await conn->send_request_and_wait_response(download_request);
+    if (!response || (response->stat != common::FRAME_STAT_OK && response->stat != common::FRAME_STAT_FINISH)) {
+      LOG_ERROR("cs_download {} failed, {}", rel_path, response ? response->stat : -1);
+      co_return std::nullopt;
+    }
+    content.append(response->data, response->data_len);
+    if (response->stat == common::FRAME_STAT_FINISH) {
+      co_return content;
+    }
+  }
+}
+
+auto check(std::string_view what, const std::optional<std::string> &downloaded, const std::string &content) -> void {
+  if (!downloaded) {
+    std::println("FAIL {}: download failed", what);
+    failed = true;
+  } else if (downloaded.value() != content) {
+    std::println("FAIL {}: {} bytes downloaded, {} bytes expected", what, downloaded->size(), content.size());
+    failed = true;
+  } else {
+    std::println("ok   {}", what);
+  }
+}
+
+auto run() -> asio::awaitable<void> {
+  master_conn = co_await connect_to("127.0.0.1", 8888);
+  if (!master_conn) {
+    std::println("FAIL connect to master");
+    failed = true;
+    co_return;
+  }
+
+  auto content = common::random_string(file_size);
+  auto path = co_await upload_file(content);
+  if (!path) {
+    std::println("FAIL upload");
+    failed = true;
+    co_return;
+  }
+  auto group_id = (uint32_t)std::stoul(path->substr(0, path->find_first_of('/')));
+  auto rel_path = path->substr(path->find_first_of('/') + 1);
+  std::println("uploaded {} bytes to {}", file_size, path.value());
+
+  auto request_to_send = common::create_frame(common::proto_cmd::cm_fetch_group_storages, common::frame_type::request, sizeof(uint32_t));
+  *((uint32_t *)request_to_send->data) = htonl(group_id);
+  auto response = co_await master_conn->send_request_and_wait_response(request_to_send);
+  auto storages = proto::cm_fetch_group_storages_response{};
+  if (!response || response->stat != common::FRAME_STAT_OK || !storages.ParseFromArray(response->data, response->data_len)) {
+    std::println("FAIL fetch group {}", group_id);
+    failed = true;
+    co_return;
+  }
+
+  /* 上传的 storage 立即可以下载，其它 storage 等待同步完成 */
+  auto timer = asio::steady_timer{io};
+  for (auto s_info : storages.s_infos()) {
+    auto what = std::format("download from {}:{}", s_info.ip(), s_info.port());
+    auto conn = co_await connect_to(s_info.ip(), s_info.port());
+    if (!conn) {
+      check(what, std::nullopt, content);
+      continue;
+    }
+
+    auto downloaded = co_await download_file(conn, rel_path);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{sync_timeout};
+    while (!downloaded && std::chrono::steady_clock::now() < deadline) {
+      timer.expires_after(std::chrono::seconds{5});
+      co_await timer.async_wait(asio::use_awaitable);
+      downloaded = co_await download_file(conn, rel_path);
+    }
+    check(what, downloaded, content);
+    co_await conn->close();
+  }
+  co_await master_conn->close();
+}
+
+auto main(int argc, char *argv[]) -> int {
+  if (argc > 1 && std::string{argv[1]} == "-h") {
+    show_usage();
+    return 0;
+  }
+  file_size = argc > 1 ? std::stoull(argv[1]) : file_size;
+  sync_timeout = argc > 2 ? std::stoul(argv[2]) : sync_timeout;
+
+  spdlog::set_level(spdlog::level::info);
+  spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] %^[%l] [%s:%#]%$ %v");
+
+  asio::co_spawn(io, run(), asio::detached);
+  io.run();
+  return failed ? 1 : 0;
+}
@@ -15,6 +15,22 @@ add_packages("protobuf-cpp")
 add_requires("spdlog")
 add_packages("spdlog")
 
+add_requires("lz4")
+add_packages("lz4")
+
+-- xmake f --io_uring=y 启用 io_uring 后端，asio 的 socket 和文件操作均通过 io_uring 提交，默认使用 epoll
+option("io_uring")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Use io_uring instead of epoll for socket and file I/O")
+option_end()
+
+if has_config("io_uring") then
+    add_requires("liburing")
+    add_packages("liburing")
+    add_defines("ASIO_HAS_IO_URING", "ASIO_DISABLE_EPOLL")
+end
+
 
 add_cxxflags("-Wall")
 add_ldflags("-lstdc++exp")